@@ -0,0 +1,119 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Instrumentation, so the diagnostics can diagnose themselves.
+ *
+ * These get called from interrupt handlers and from the sampling loops,
+ * so they need to be cheap. Each core has its own set of counters and
+ * histograms, so there's no locking, a core only ever adds to its own.
+ * Reading them from the other core might catch one half updated, which
+ * doesn't matter for what they're used for.
+ *
+ * Timing comes straight from the raw low word of the microsecond timer.
+ * It wraps every 71 minutes, which is fine for timing things which take
+ * microseconds.
+ */
+
+#include "pico/stdlib.h"
+#include "hardware/timer.h"
+#include "hardware/clocks.h"
+
+#include "instrument.h"
+
+static volatile uint32_t       counter[2][NUM_INST_COUNTERS];
+static volatile INST_HIST_DATA hist_data[2][NUM_INST_HISTOGRAMS];
+
+uint32_t __time_critical_func(inst_now)( void )
+{
+  return timer_hw->timerawl;
+}
+
+void __time_critical_func(inst_count)( INST_COUNTER index )
+{
+  counter[get_core_num()][index]++;
+}
+
+void __time_critical_func(inst_add)( INST_COUNTER index, uint32_t value )
+{
+  counter[get_core_num()][index] += value;
+}
+
+void __time_critical_func(inst_hist_record)( INST_HISTOGRAM index, uint32_t value )
+{
+  volatile INST_HIST_DATA *hist = &hist_data[get_core_num()][index];
+
+  /* log2 of the value picks the bucket */
+  uint32_t bucket = (value < 2) ? 0 : 31 - __builtin_clz( value );
+  if( bucket >= INST_HIST_BUCKETS )
+    bucket = INST_HIST_BUCKETS-1;
+
+  hist->bucket[bucket]++;
+  hist->count++;
+  hist->total += value;
+  if( value > hist->max )
+    hist->max = value;
+}
+
+/* Record the time since start_us, which came from inst_now() */
+void __time_critical_func(inst_hist_since)( INST_HISTOGRAM index, uint32_t start_us )
+{
+  inst_hist_record( index, inst_now() - start_us );
+}
+
+/*
+ * Add up both cores' counters and histograms. Each core's totals only
+ * ever go up, so a difference between two snapshots is a rate.
+ */
+void inst_snapshot( INST_SNAPSHOT *snapshot )
+{
+  for( uint32_t index = 0; index < NUM_INST_COUNTERS; index++ )
+    snapshot->counter[index] = counter[0][index] + counter[1][index];
+
+  for( uint32_t index = 0; index < NUM_INST_HISTOGRAMS; index++ )
+  {
+    INST_HIST_DATA *hist = &snapshot->hist[index];
+
+    for( uint32_t bucket = 0; bucket < INST_HIST_BUCKETS; bucket++ )
+      hist->bucket[bucket] = hist_data[0][index].bucket[bucket] + hist_data[1][index].bucket[bucket];
+
+    hist->count = hist_data[0][index].count + hist_data[1][index].count;
+    hist->total = hist_data[0][index].total + hist_data[1][index].total;
+    hist->max   = (hist_data[0][index].max > hist_data[1][index].max) ? hist_data[0][index].max : hist_data[1][index].max;
+  }
+}
+
+uint32_t inst_hist_mean( const INST_HIST_DATA *hist )
+{
+  return (hist->count == 0) ? 0 : hist->total / hist->count;
+}
+
+/* Free run SysTick from the processor clock. Each core has its own, this starts the caller's */
+void inst_cycles_start( void )
+{
+  systick_hw->csr = 0;
+  systick_hw->rvr = 0x00FFFFFF;
+  systick_hw->cvr = 0;
+  systick_hw->csr = 0x5;                /* Enable, count the processor clock, no interrupt */
+}
+
+uint32_t inst_cycles_to_ns( uint32_t cycles )
+{
+  return (uint32_t)(((uint64_t)cycles * 1000000) / (clock_get_hz( clk_sys ) / 1000));
+}
@@ -0,0 +1,88 @@
+#ifndef __INSTRUMENT_H
+#define __INSTRUMENT_H
+
+#include "pico/stdlib.h"
+#include "hardware/structs/systick.h"
+
+/*
+ * Counters and histograms for keeping an eye on the firmware itself.
+ * Both Picos have the same set, not all of them mean anything on both.
+ */
+typedef enum
+{
+  INST_GPIO_IRQ,                        // GPIO interrupts handled
+  INST_GPIO_IRQ_MERGED,                 // Ones with both edges latched, so at least one edge came too soon to get its own
+  INST_LINK_TX_BYTES,                   // Bytes sent over the Pico-Pico link
+  INST_LINK_RX_BYTES,                   // Bytes received over the link
+  INST_LINK_ABANDONED,                  // Waits on the link which were given up on
+  INST_LINK_TIMEOUTS,                   // Waits on the link which timed out
+  INST_LINK_BAD_FRAMES,                 // Link frames which arrived wrong
+  INST_LINK_RESYNCS,                    // Times the link was brought back in step
+  INST_SAMPLES,                         // Samples taken by the bus sampling loops
+  INST_SAMPLE_US,                       // Time those loops spent sampling
+  INST_GAP_SAMPLES,                     // Samples which had the gap since the last one timed
+  INST_SAMPLE_SLOW_GAPS,                // Of those, the ones more than 2 T-states after the one before
+
+  NUM_INST_COUNTERS
+}
+INST_COUNTER;
+
+typedef enum
+{
+  INST_HIST_GPIO_IRQ,                   // Time in a GPIO interrupt handler, us
+  INST_HIST_LINK_ACK,                   // Time waiting for the other end to ack a byte, us
+  INST_HIST_OLED_FRAME,                 // Time to send a frame to the OLED, us
+  INST_HIST_TEST_RUN,                   // Time a page's tests took, ms
+  INST_HIST_SAMPLE_GAP,                 // Longest gap between two samples in a sampling run, ns
+
+  NUM_INST_HISTOGRAMS
+}
+INST_HISTOGRAM;
+
+/*
+ * Bucket n holds values from 2^n to 2^(n+1)-1, apart from the first
+ * which holds 0 and 1, and the last which holds everything bigger.
+ */
+#define INST_HIST_BUCKETS 16
+
+typedef struct
+{
+  uint32_t bucket[INST_HIST_BUCKETS];
+  uint32_t count;
+  uint32_t total;
+  uint32_t max;
+}
+INST_HIST_DATA;
+
+/* Everything, added up across the cores. Pico2 sends one of these over the link */
+typedef struct
+{
+  uint32_t       counter[NUM_INST_COUNTERS];
+  INST_HIST_DATA hist[NUM_INST_HISTOGRAMS];
+}
+INST_SNAPSHOT;
+
+uint32_t inst_now( void );
+void     inst_count( INST_COUNTER counter );
+void     inst_add( INST_COUNTER counter, uint32_t value );
+void     inst_hist_record( INST_HISTOGRAM hist, uint32_t value );
+void     inst_hist_since( INST_HISTOGRAM hist, uint32_t start_us );
+void     inst_snapshot( INST_SNAPSHOT *snapshot );
+uint32_t inst_hist_mean( const INST_HIST_DATA *hist );
+
+/*
+ * SysTick counts processor cycles, down, in 24 bits. That's fine enough
+ * to time one trip round a sampling loop, which the microsecond timer
+ * isn't. Take the difference of two readings with INST_CYCLES_DIFF.
+ */
+#define INST_CYCLES_DIFF(earlier,later) (((earlier) - (later)) & 0x00FFFFFF)
+
+void     inst_cycles_start( void );
+uint32_t inst_cycles_to_ns( uint32_t cycles );
+
+static inline uint32_t inst_cycles( void )
+{
+  return systick_hw->cvr;
+}
+
+#endif
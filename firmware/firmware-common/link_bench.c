@@ -0,0 +1,259 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Pico-Pico link soak test.
+ *
+ * The link's meant to be fast, this says how fast, and whether it stays
+ * up. It's built into the pico1_linkbench and pico2_linkbench programs,
+ * which do nothing else, and into the host's linkbench, which runs both
+ * ends over an in-memory link so the protocol can be tried without the
+ * hardware.
+ *
+ * It uses the same CRC checked frames as the tests, the same rate
+ * negotiation, and the same recovery. When a frame times out or arrives
+ * wrong the link is out of step, Pico1's end resyncs it before the next
+ * one and Pico2's end waits for that.
+ */
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "link_common.h"
+#include "link_bench.h"
+
+/*
+ * Before anything else. The stop check is for the host, which has to
+ * get its Pico2 thread out of its wait. The Picos have no reason to
+ * stop and pass NULL.
+ */
+void link_bench_start( bool (*stop)( void ) )
+{
+  link_set_abort_check( stop );
+}
+
+void link_bench_reset( LINK_BENCH_STATS *stats )
+{
+  stats->transfers         = 0;
+  stats->bytes             = 0;
+  stats->timeouts          = 0;
+  stats->checksum_failures = 0;
+  stats->resyncs           = 0;
+  stats->max_us            = 0;
+  stats->num_latencies     = 0;
+}
+
+/*
+ * Keep a round trip time. Small frames manage far more round trips in a
+ * report's time than there's room for, and keeping the first ones would
+ * say nothing about the rest. This is reservoir sampling: once it's full,
+ * each new one replaces a random one with the chance that leaves every
+ * round trip so far equally likely to be in there. The longest is kept
+ * separately, so a spike can't be missed.
+ */
+static void keep_latency( LINK_BENCH_STATS *stats, uint32_t latency_us )
+{
+  static uint32_t random = 0x9E3779B9;
+
+  if( latency_us > stats->max_us )
+    stats->max_us = latency_us;
+
+  if( stats->num_latencies < LINK_BENCH_MAX_SAMPLES )
+  {
+    stats->latency_us[stats->num_latencies++] = latency_us;
+    return;
+  }
+
+  random ^= random << 13; random ^= random >> 17; random ^= random << 5;
+
+  uint32_t slot = random % stats->transfers;
+  if( slot < LINK_BENCH_MAX_SAMPLES )
+    stats->latency_us[slot] = latency_us;
+}
+
+/* What went wrong, which the link has already marked out of step */
+static void failed( LINK_RESULT result, LINK_BENCH_STATS *stats )
+{
+  if( result == LINK_BAD_FRAME )
+    stats->checksum_failures++;
+  else if( result != LINK_OUT_OF_STEP )
+    stats->timeouts++;
+}
+
+/* The sync byte, the length and the CRC, on top of the payload */
+#define FRAME_OVERHEAD 5
+
+/* Gets the link in step if it isn't, returns false if that couldn't be done */
+static bool resync( PIO pio, int linkin_sm, int linkout_sm, LINK_BENCH_STATS *stats )
+{
+  if( !link_out_of_step( pio ) )
+    return true;
+
+  if( !link_resync( pio, linkout_sm, linkin_sm ) )
+  {
+    stats->timeouts++;
+    return false;
+  }
+  stats->resyncs++;
+
+  return true;
+}
+
+/*
+ * Pico1's end. An empty frame, which the soak test doesn't otherwise
+ * send, tells Pico2's end to negotiate the link's rate. Returns the bit
+ * rate the link ends up at.
+ */
+uint32_t link_bench_negotiate( PIO pio, int linkin_sm, int linkout_sm, LINK_BENCH_STATS *stats )
+{
+  if( resync( pio, linkin_sm, linkout_sm, stats ) &&
+      (link_send_frame( pio, linkout_sm, linkin_sm, NULL, 0, LINK_REPLY_TIMEOUT_US ) == LINK_OK) )
+  {
+    link_rate_lead( pio, linkout_sm, linkin_sm );
+  }
+
+  return link_bit_rate( pio );
+}
+
+/*
+ * Pico1's end. Send a frame of the given size, and wait for it to come
+ * back. Returns false if it didn't, or it came back wrong.
+ */
+bool link_bench_transfer( PIO pio, int linkin_sm, int linkout_sm, uint32_t size, LINK_BENCH_STATS *stats )
+{
+  static uint8_t  sent[LINK_BENCH_MAX_PAYLOAD];
+  static uint8_t  received[LINK_BENCH_MAX_PAYLOAD];
+  static uint32_t pattern = 0x12345678;
+
+  if( size > LINK_BENCH_MAX_PAYLOAD )
+    size = LINK_BENCH_MAX_PAYLOAD;
+
+  if( !resync( pio, linkin_sm, linkout_sm, stats ) )
+    return false;
+
+  /* Different every time, so a byte stuck in a FIFO can't pass for the right one */
+  for( uint32_t index = 0; index < size; index++ )
+  {
+    pattern ^= pattern << 13; pattern ^= pattern >> 17; pattern ^= pattern << 5;
+    sent[index] = (uint8_t)pattern;
+  }
+
+  uint32_t start_us = time_us_32();
+
+  LINK_RESULT result = link_send_frame( pio, linkout_sm, linkin_sm, sent, size, LINK_REPLY_TIMEOUT_US );
+  if( result == LINK_OK )
+    result = link_receive_frame( pio, linkin_sm, linkout_sm, received, size, LINK_REPLY_TIMEOUT_US );
+  if( result != LINK_OK )
+  {
+    failed( result, stats );
+    return false;
+  }
+
+  uint32_t latency_us = time_us_32() - start_us;
+
+  stats->transfers++;
+  stats->bytes += 2 * (FRAME_OVERHEAD + size);
+  keep_latency( stats, latency_us );
+
+  /* The CRC passed both ways, so this would be the echo that's wrong */
+  if( memcmp( sent, received, size ) )
+  {
+    stats->checksum_failures++;
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ * Pico2's end. Wait for a frame and send it back. Returns false if it
+ * didn't arrive right, or couldn't be sent back.
+ */
+bool link_bench_echo( PIO pio, int linkin_sm, int linkout_sm, LINK_BENCH_STATS *stats )
+{
+  static uint8_t payload[LINK_BENCH_MAX_PAYLOAD];
+
+  if( link_out_of_step( pio ) )
+  {
+    if( !link_wait_for_resync( pio, linkin_sm, linkout_sm ) )
+      return false;
+    stats->resyncs++;
+  }
+
+  /* Nothing arriving at all isn't a timeout, the other end might not have started */
+  uint32_t size;
+  LINK_RESULT result = link_receive_frame_upto( pio, linkin_sm, linkout_sm, payload, sizeof(payload), &size, LINK_WAIT_FOREVER );
+  /* An empty frame is Pico1 wanting to negotiate the link's rate */
+  if( (result == LINK_OK) && (size == 0) )
+  {
+    link_rate_follow( pio, linkin_sm, linkout_sm );
+    return true;
+  }
+  if( result == LINK_OK )
+    result = link_send_frame( pio, linkout_sm, linkin_sm, payload, size, LINK_REPLY_TIMEOUT_US );
+  if( result != LINK_OK )
+  {
+    if( result != LINK_ABANDONED )
+      failed( result, stats );
+    return false;
+  }
+
+  stats->transfers++;
+  stats->bytes += 2 * (FRAME_OVERHEAD + size);
+
+  return true;
+}
+
+static int compare_latency( const void *a, const void *b )
+{
+  uint32_t first  = *(const uint32_t*)a;
+  uint32_t second = *(const uint32_t*)b;
+
+  return (first > second) - (first < second);
+}
+
+static uint32_t percentile( const LINK_BENCH_STATS *stats, uint32_t percent )
+{
+  if( stats->num_latencies == 0 )
+    return 0;
+
+  uint32_t index = (stats->num_latencies * percent) / 100;
+  if( index >= stats->num_latencies )
+    index = stats->num_latencies - 1;
+
+  return stats->latency_us[index];
+}
+
+/* Sum up the stats gathered over elapsed_us. The latencies get sorted */
+void link_bench_report( LINK_BENCH_STATS *stats, uint32_t elapsed_us, LINK_BENCH_REPORT *report )
+{
+  qsort( stats->latency_us, stats->num_latencies, sizeof(stats->latency_us[0]), compare_latency );
+
+  report->bytes_per_sec     = elapsed_us ? (uint32_t)(((uint64_t)stats->bytes * 1000000) / elapsed_us) : 0;
+  report->transfers         = stats->transfers;
+  report->timeouts          = stats->timeouts;
+  report->checksum_failures = stats->checksum_failures;
+  report->resyncs           = stats->resyncs;
+  report->p50_us            = percentile( stats, 50 );
+  report->p90_us            = percentile( stats, 90 );
+  report->p99_us            = percentile( stats, 99 );
+  report->max_us            = stats->max_us;
+}
@@ -0,0 +1,52 @@
+#ifndef __LINK_BENCH_H
+#define __LINK_BENCH_H
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+
+/*
+ * Soak test for the Pico-Pico link. Pico1's end sends frames and times
+ * how long they take to come back, Pico2's end sends them straight back.
+ * The host's linkbench runs the same code over an in-memory link.
+ *
+ * The frames are the link's own, see link_send_frame(), so this
+ * measures what the tests get.
+ */
+#define LINK_BENCH_MAX_PAYLOAD  256
+#define LINK_BENCH_MAX_SAMPLES  4096
+
+typedef struct
+{
+  uint32_t transfers;                   // Round trips, or echoes, completed
+  uint32_t bytes;                       // Bytes moved, both ways, headers and checksums included
+  uint32_t timeouts;                    // Frames abandoned part way, waiting for the other end
+  uint32_t checksum_failures;           // Frames with a bad CRC, or whose echoed contents were wrong
+  uint32_t resyncs;                     // Times the link was brought back in step
+  uint32_t max_us;                      // Longest round trip, of all of them
+  uint32_t num_latencies;               // Round trip times, a fair sample of up to LINK_BENCH_MAX_SAMPLES of them
+  uint32_t latency_us[LINK_BENCH_MAX_SAMPLES];
+}
+LINK_BENCH_STATS;
+
+typedef struct
+{
+  uint32_t bytes_per_sec;
+  uint32_t transfers;
+  uint32_t timeouts;
+  uint32_t checksum_failures;
+  uint32_t resyncs;
+  uint32_t p50_us;
+  uint32_t p90_us;
+  uint32_t p99_us;
+  uint32_t max_us;
+}
+LINK_BENCH_REPORT;
+
+void link_bench_start( bool (*stop)( void ) );
+void link_bench_reset( LINK_BENCH_STATS *stats );
+uint32_t link_bench_negotiate( PIO pio, int linkin_sm, int linkout_sm, LINK_BENCH_STATS *stats );
+bool link_bench_transfer( PIO pio, int linkin_sm, int linkout_sm, uint32_t size, LINK_BENCH_STATS *stats );
+bool link_bench_echo( PIO pio, int linkin_sm, int linkout_sm, LINK_BENCH_STATS *stats );
+void link_bench_report( LINK_BENCH_STATS *stats, uint32_t elapsed_us, LINK_BENCH_REPORT *report );
+
+#endif
@@ -32,8 +32,114 @@
 #include "pico/stdlib.h"
 #include "hardware/pio.h"
 #include "hardware/clocks.h"
+#include <string.h>
 
 #include "link_common.h"
+#include "instrument.h"
+
+/*
+ * Nothing on the link is allowed to wedge it. Once a transfer has
+ * started, the bytes and ACKs follow each other within microseconds, so
+ * one which hasn't turned up after LINK_BYTE_TIMEOUT_US isn't coming.
+ * How long to wait for the other side to start is up to the caller, it
+ * can be forever. On top of that, Pico1 sometimes has to give up because
+ * the user's moved on. If there's an abort check and it says so, and
+ * nothing's come over the link for a while, the wait's abandoned.
+ *
+ * Whenever a wait gives up, or a frame arrives wrong, the two sides can
+ * no longer be sure where the other one is, so the link is marked out
+ * of step. Frames aren't sent or received again until Pico1 has run
+ * link_resync() and Pico2 has met it in link_wait_for_resync().
+ */
+#define LINK_BYTE_TIMEOUT_US 10000
+
+/* Long enough after a failure that the other side has timed out too */
+#define LINK_QUIET_US        (2 * LINK_BYTE_TIMEOUT_US)
+
+#define LINK_RESYNC_ATTEMPTS 3
+
+#define LINK_FRAME_SYNC      0xA5
+
+/*
+ * The link starts at 10Mbit/s, 8 PIO clocks a bit at 80MHz, which is
+ * what picoputer.pio sets up. Pico1 tries the faster ones in turn once
+ * the link's up, see link_rate_lead(), and they settle on the fastest
+ * the wiring between them copes with. None faster than the system clock
+ * can be had, so at the standard 125MHz that's 15.6Mbit/s at most.
+ */
+static const uint32_t link_rate_pio_hz[] =
+{
+  80000000, 100000000, 125000000, 160000000, 200000000, 250000000
+};
+#define NUM_LINK_RATES (sizeof(link_rate_pio_hz) / sizeof(link_rate_pio_hz[0]))
+
+/* Round trips of the test pattern a rate has to get through, all of them right */
+#define LINK_RATE_TRIAL_ROUNDS 16
+#define LINK_RATE_TRIAL_BYTES  64
+
+/* Long enough for the last word to leave at the old rate, and the other side to change */
+#define LINK_RATE_SETTLE_US    20
+
+/* Pico2 drops back to the starting rate if a resync doesn't come at a faster one */
+#define LINK_RATE_FALLBACK_US  500000
+
+/* Ends the negotiation, Pico2 stays where it is */
+#define LINK_RATE_DONE         0xFFFFFFFF
+
+static bool (*abort_check)( void ) = NULL;
+
+/*
+ * Both sides start out of step, the first resync gets them together.
+ * A Pico only has the one link, but it's kept by PIO so the host's
+ * link simulation can run both ends.
+ */
+static bool out_of_step[NUM_PIOS] = { [0 ... NUM_PIOS-1] = true };
+
+/* Index into link_rate_pio_hz[] each link's running at */
+static uint32_t link_rate[NUM_PIOS];
+
+void link_set_abort_check( bool (*check)( void ) )
+{
+  abort_check = check;
+}
+
+bool link_out_of_step( PIO pio )
+{
+  return out_of_step[pio_get_index( pio )];
+}
+
+/* For when the protocol above the frames has gone wrong */
+void link_lost_step( PIO pio )
+{
+  out_of_step[pio_get_index( pio )] = true;
+}
+
+/*
+ * Whether to stop waiting. timeout_us is how long the wait can go on with
+ * nothing arriving, LINK_WAIT_FOREVER for no limit.
+ */
+static bool link_gave_up( PIO pio, uint32_t idle_since_us, uint32_t timeout_us, LINK_RESULT *result )
+{
+  uint32_t idle_us = time_us_32() - idle_since_us;
+
+  if( (timeout_us != LINK_WAIT_FOREVER) && (idle_us > timeout_us) )
+  {
+    inst_count( INST_LINK_TIMEOUTS );
+    link_lost_step( pio );
+    *result = LINK_TIMEOUT;
+    return true;
+  }
+
+  if( (abort_check != NULL) && (idle_us > LINK_BYTE_TIMEOUT_US) && abort_check() )
+  {
+    inst_count( INST_LINK_ABANDONED );
+    link_lost_step( pio );
+    *result = LINK_ABANDONED;
+    return true;
+  }
+
+  return false;
+}
 
 /*
  * Receive a byte from the link. The received value goes into the given location,
@@ -81,11 +187,13 @@ static link_received_t receive_byte( PIO pio, int linkin_sm, uint8_t *received_v
 
 
 /*
- * Receive a byte and ACK it back to the sender
+ * Receive a byte and ACK it back to the sender. An ACK turning up when
+ * a byte's expected is left over from something which went wrong, it's
+ * thrown away.
  */
 link_received_t ui_link_receive_acked_byte( PIO pio, int linkin_sm, int linkout_sm, uint8_t *received_value )
 {
-  if( receive_byte( pio, linkin_sm, received_value ) == LINK_BYTE_NONE )
+  if( receive_byte( pio, linkin_sm, received_value ) != LINK_BYTE_DATA )
     return LINK_BYTE_NONE;
 
   ui_link_send_ack_to_link( pio, linkout_sm );
@@ -95,16 +203,41 @@ link_received_t ui_link_receive_acked_byte( PIO pio, int linkin_sm, int linkout_
 
 
 /*
- * Receive a number of bytes into the given buffer. Bytes are acknowledged.
+ * Receive bytes into the given buffer, acknowledging each one. The
+ * first can take up to timeout_us to arrive, the rest have to follow
+ * straight on.
  */
-void ui_link_receive_buffer( PIO pio, int linkin_sm, int linkout_sm, uint8_t *data, uint32_t count )
+static LINK_RESULT receive_bytes( PIO pio, int linkin_sm, int linkout_sm, uint8_t *data, uint32_t count, uint32_t timeout_us )
 {
+  LINK_RESULT result;
+  uint32_t    idle_since_us = time_us_32();
+
   while( count )
   {
-    while( ui_link_receive_acked_byte( pio, linkin_sm, linkout_sm, data ) == LINK_BYTE_NONE );
+    while( ui_link_receive_acked_byte( pio, linkin_sm, linkout_sm, data ) == LINK_BYTE_NONE )
+    {
+      if( link_gave_up( pio, idle_since_us, timeout_us, &result ) )
+	return result;
+    }
+    idle_since_us = time_us_32();
+    timeout_us    = LINK_BYTE_TIMEOUT_US;
+    inst_count( INST_LINK_RX_BYTES );
+
     data++;
     count--;
   }
+
+  return LINK_OK;
+}
+
+
+/*
+ * Receive a number of bytes into the given buffer. Bytes are acknowledged.
+ * Returns false if the wait was abandoned, or timed out part way.
+ */
+bool ui_link_receive_buffer( PIO pio, int linkin_sm, int linkout_sm, uint8_t *data, uint32_t count )
+{
+  return receive_bytes( pio, linkin_sm, linkout_sm, data, count, LINK_WAIT_FOREVER ) == LINK_OK;
 }
 
 
@@ -118,69 +251,450 @@ void ui_link_send_ack_to_link( PIO pio, int linkout_sm )
 }
 
 
+/* A frame that's wrong leaves the sender wherever it is, so the link's out of step */
+static LINK_RESULT bad_frame( PIO pio )
+{
+  inst_count( INST_LINK_BAD_FRAMES );
+  link_lost_step( pio );
+  return LINK_BAD_FRAME;
+}
+
+
 /*
- * Send a byte and wait for the receiver to acknowledge it.
+ * Send a byte and wait up to timeout_us for the receiver to acknowledge
+ * it. If the other side sends something instead it's not receiving,
+ * so it's not where this side thinks it is.
  */
-void ui_link_send_byte( PIO pio, int linkout_sm, int linkin_sm, uint8_t data )
+static LINK_RESULT send_byte( PIO pio, int linkout_sm, int linkin_sm, uint8_t data, uint32_t timeout_us )
 {
+  LINK_RESULT     result;
+  link_received_t received;
+
   pio_sm_put_blocking(pio, linkout_sm, 0x200 | (((uint32_t)data ^ 0xff)<<1));
 
-  while( receive_byte( pio, linkin_sm, NULL ) != LINK_BYTE_ACK );
-}
+  uint32_t idle_since_us = time_us_32();
+  while( (received = receive_byte( pio, linkin_sm, NULL )) != LINK_BYTE_ACK )
+  {
+    if( received == LINK_BYTE_DATA )
+      return bad_frame( pio );
+
+    if( link_gave_up( pio, idle_since_us, timeout_us, &result ) )
+      return result;
+  }
 
+  inst_hist_since( INST_HIST_LINK_ACK, idle_since_us );
+  inst_count( INST_LINK_TX_BYTES );
 
-/*
- * Send a buffer of bytes. All bytes are acknowledged.
- */
-void ui_link_send_buffer( PIO pio, int linkout_sm, int linkin_sm, const uint8_t *data, uint32_t count )
+  return LINK_OK;
+}
+
+/* Send bytes, the first can take up to timeout_us to be acknowledged, the rest have to follow on */
+static LINK_RESULT send_bytes( PIO pio, int linkout_sm, int linkin_sm, const uint8_t *data, uint32_t count, uint32_t timeout_us )
 {
   while( count )
   {
-    ui_link_send_byte( pio, linkout_sm, linkin_sm, *data );
+    LINK_RESULT result = send_byte( pio, linkout_sm, linkin_sm, *data, timeout_us );
+    if( result != LINK_OK )
+      return result;
+
+    timeout_us = LINK_BYTE_TIMEOUT_US;
     data++;
     count--;
   }
+
+  return LINK_OK;
+}
+
+
+/*
+ * Send a byte and wait for the receiver to acknowledge it. Returns false
+ * if the wait was abandoned, or timed out.
+ */
+bool ui_link_send_byte( PIO pio, int linkout_sm, int linkin_sm, uint8_t data )
+{
+  return send_byte( pio, linkout_sm, linkin_sm, data, LINK_BYTE_TIMEOUT_US ) == LINK_OK;
+}
+
+
+/*
+ * Send a buffer of bytes. All bytes are acknowledged. Returns false if
+ * the wait for one of them was abandoned, or timed out.
+ */
+bool ui_link_send_buffer( PIO pio, int linkout_sm, int linkin_sm, const uint8_t *data, uint32_t count )
+{
+  return send_bytes( pio, linkout_sm, linkin_sm, data, count, LINK_BYTE_TIMEOUT_US ) == LINK_OK;
+}
+
+
+/*
+ * CRC-16/CCITT, polynomial 0x1021, starting from 0xFFFF. The ACKs only
+ * say a byte arrived, not that it arrived right, this catches the
+ * ones which didn't.
+ */
+static uint16_t crc16( uint16_t crc, const uint8_t *data, uint32_t count )
+{
+  while( count-- )
+  {
+    crc ^= (uint16_t)(*data++) << 8;
+    for( uint32_t bit = 0; bit < 8; bit++ )
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+  }
+
+  return crc;
+}
+
+
+/*
+ * Send a frame: a sync byte, the 16 bit length, the data, then the CRC
+ * of all that. The other side has up to timeout_us to start taking it.
+ */
+LINK_RESULT link_send_frame( PIO pio, int linkout_sm, int linkin_sm, const void *data, uint32_t count, uint32_t timeout_us )
+{
+  if( link_out_of_step( pio ) )
+    return LINK_OUT_OF_STEP;
+
+  uint8_t header[3] = { LINK_FRAME_SYNC, count & 0xFF, (count >> 8) & 0xFF };
+
+  uint16_t crc = crc16( 0xFFFF, header, sizeof(header) );
+  crc = crc16( crc, data, count );
+  uint8_t trailer[2] = { crc & 0xFF, crc >> 8 };
+
+  LINK_RESULT result = send_bytes( pio, linkout_sm, linkin_sm, header, sizeof(header), timeout_us );
+  if( result == LINK_OK )
+    result = send_bytes( pio, linkout_sm, linkin_sm, data, count, LINK_BYTE_TIMEOUT_US );
+  if( result == LINK_OK )
+    result = send_bytes( pio, linkout_sm, linkin_sm, trailer, sizeof(trailer), LINK_BYTE_TIMEOUT_US );
+
+  return result;
+}
+
+
+/*
+ * Receive a frame of up to max bytes, see link_send_frame(). The other
+ * side has up to timeout_us to start sending it. The length it turned
+ * out to be goes in *length.
+ */
+LINK_RESULT link_receive_frame_upto( PIO pio, int linkin_sm, int linkout_sm, void *data, uint32_t max, uint32_t *length, uint32_t timeout_us )
+{
+  if( link_out_of_step( pio ) )
+    return LINK_OUT_OF_STEP;
+
+  /* Something other than the sync byte means this side's not where it thinks it is */
+  uint8_t header[3];
+  LINK_RESULT result = receive_bytes( pio, linkin_sm, linkout_sm, &header[0], 1, timeout_us );
+  if( result != LINK_OK )
+    return result;
+  if( header[0] != LINK_FRAME_SYNC )
+    return bad_frame( pio );
+
+  result = receive_bytes( pio, linkin_sm, linkout_sm, &header[1], 2, LINK_BYTE_TIMEOUT_US );
+  if( result != LINK_OK )
+    return result;
+
+  uint32_t count = header[1] | (header[2] << 8);
+  if( count > max )
+    return bad_frame( pio );
+
+  uint8_t trailer[2];
+  result = receive_bytes( pio, linkin_sm, linkout_sm, data, count, LINK_BYTE_TIMEOUT_US );
+  if( result == LINK_OK )
+    result = receive_bytes( pio, linkin_sm, linkout_sm, trailer, sizeof(trailer), LINK_BYTE_TIMEOUT_US );
+  if( result != LINK_OK )
+    return result;
+
+  uint16_t crc = crc16( 0xFFFF, header, sizeof(header) );
+  crc = crc16( crc, data, count );
+  if( crc != (trailer[0] | (trailer[1] << 8)) )
+    return bad_frame( pio );
+
+  *length = count;
+  return LINK_OK;
+}
+
+
+/* Receive a frame which has to be exactly count bytes long */
+LINK_RESULT link_receive_frame( PIO pio, int linkin_sm, int linkout_sm, void *data, uint32_t count, uint32_t timeout_us )
+{
+  uint32_t length;
+  LINK_RESULT result = link_receive_frame_upto( pio, linkin_sm, linkout_sm, data, count, &length, timeout_us );
+
+  if( (result == LINK_OK) && (length != count) )
+    return bad_frame( pio );
+
+  return result;
+}
+
+
+/* Throw away whatever's arriving until nothing has for a while */
+static void wait_for_quiet( PIO pio, int linkin_sm )
+{
+  uint32_t quiet_since_us = time_us_32();
+  while( (time_us_32() - quiet_since_us) < LINK_QUIET_US )
+  {
+    if( receive_byte( pio, linkin_sm, NULL ) != LINK_BYTE_NONE )
+      quiet_since_us = time_us_32();
+  }
 }
 
 
 /*
  * Send a magic sequence of known bytes. This marries up with the
  * wait_for_init_sequence() function and is used to initialise the
- * link. It gets the two sides in sync.
+ * link. It gets the two sides in sync. Returns false if the other
+ * side didn't answer.
  */
-void ui_link_send_init_sequence( PIO pio, int linkout_sm, int linkin_sm )
+bool ui_link_send_init_sequence( PIO pio, int linkout_sm, int linkin_sm )
 {
   const uint8_t init_msg[] = { 0x02, 0x04, 0x08, 0 };
-  ui_link_send_buffer( pio, linkout_sm, linkin_sm, init_msg, sizeof(init_msg) );
+  if( send_bytes( pio, linkout_sm, linkin_sm, init_msg, sizeof(init_msg), LINK_BYTE_TIMEOUT_US ) != LINK_OK )
+    return false;
 
-  while( receive_byte( pio, linkin_sm, NULL ) != LINK_BYTE_ACK );
+  LINK_RESULT result;
+  uint32_t    idle_since_us = time_us_32();
+  while( receive_byte( pio, linkin_sm, NULL ) != LINK_BYTE_ACK )
+  {
+    if( link_gave_up( pio, idle_since_us, LINK_BYTE_TIMEOUT_US, &result ) )
+      return false;
+  }
+
+  return true;
 }
 
 
 /*
- * Wait for the initialisation sequence sent by the send_init_sequence()
- * function.
+ * Wait for the init sequence, for up to timeout_us in all, however much
+ * arrives that isn't it.
  */
-void ui_link_wait_for_init_sequence( PIO pio, int linkin_sm, int linkout_sm )
+static bool wait_for_init_sequence( PIO pio, int linkin_sm, int linkout_sm, uint32_t timeout_us )
 {
-  uint8_t init_msg[] = { 0x02, 0x04, 0x08, 0 };
-  uint8_t *init_msg_ptr = init_msg;
-  while(1)
+  const uint8_t init_msg[] = { 0x02, 0x04, 0x08, 0 };
+  uint32_t start_us = time_us_32();
+  uint32_t matched  = 0;
+  while( matched < sizeof(init_msg) )
   {
-    uint8_t chr;
-    while( ui_link_receive_acked_byte( pio, linkin_sm, linkout_sm, &chr ) == LINK_BYTE_NONE );
-    if( chr == *init_msg_ptr )
+    LINK_RESULT result;
+    uint8_t     chr;
+    uint32_t    idle_since_us = time_us_32();
+    while( ui_link_receive_acked_byte( pio, linkin_sm, linkout_sm, &chr ) == LINK_BYTE_NONE )
     {
-      init_msg_ptr++;
-      if( chr == '\0' )
-	break;
+      if( (timeout_us != LINK_WAIT_FOREVER) && ((time_us_32() - start_us) > timeout_us) )
+	return false;
+
+      if( link_gave_up( pio, idle_since_us, LINK_WAIT_FOREVER, &result ) )
+	return false;
     }
+
+    /* A byte which breaks the sequence might be the start of the real one */
+    if( chr == init_msg[matched] )
+      matched++;
     else
+      matched = (chr == init_msg[0]) ? 1 : 0;
+  }
+  ui_link_send_ack_to_link( pio, linkout_sm );
+
+  return true;
+}
+
+
+/*
+ * Wait for the initialisation sequence sent by the send_init_sequence()
+ * function. Waits forever, unless there's an abort check and it says
+ * to give up, in which case it returns false.
+ */
+bool ui_link_wait_for_init_sequence( PIO pio, int linkin_sm, int linkout_sm )
+{
+  return wait_for_init_sequence( pio, linkin_sm, linkout_sm, LINK_WAIT_FOREVER );
+}
+
+
+/*
+ * Run both state machines at the given rate. Whatever's going out at
+ * the old one is let go first.
+ */
+static void set_link_rate( PIO pio, int linkout_sm, int linkin_sm, uint32_t rate )
+{
+  while( !pio_sm_is_tx_fifo_empty( pio, linkout_sm ) );
+  busy_wait_us( LINK_RATE_SETTLE_US );
+
+  float div = (float)clock_get_hz( clk_sys ) / link_rate_pio_hz[rate];
+  pio_sm_set_clkdiv( pio, linkout_sm, div );
+  pio_sm_set_clkdiv( pio, linkin_sm,  div );
+
+  link_rate[pio_get_index( pio )] = rate;
+}
+
+/* The rate the link's running at, in bits a second */
+uint32_t link_bit_rate( PIO pio )
+{
+  return link_rate_pio_hz[link_rate[pio_get_index( pio )]] / 8;
+}
+
+
+/*
+ * Pico1's side of getting the link back in step. Wait for whatever the
+ * other side was sending to stop, so it's given up too and is waiting
+ * for the init sequence, then send it. If that doesn't work at a
+ * negotiated rate, Pico2 will have dropped back to the starting rate,
+ * so try that.
+ */
+bool link_resync( PIO pio, int linkout_sm, int linkin_sm )
+{
+  for( uint32_t attempt = 0; attempt < 2 * LINK_RESYNC_ATTEMPTS; attempt++ )
+  {
+    if( (attempt == LINK_RESYNC_ATTEMPTS) && (link_rate[pio_get_index( pio )] != 0) )
+      set_link_rate( pio, linkout_sm, linkin_sm, 0 );
+
+    wait_for_quiet( pio, linkin_sm );
+
+    if( ui_link_send_init_sequence( pio, linkout_sm, linkin_sm ) )
     {
-      init_msg_ptr = init_msg;
+      inst_count( INST_LINK_RESYNCS );
+      out_of_step[pio_get_index( pio )] = false;
+      return true;
     }
   }
-  ui_link_send_ack_to_link( pio, linkout_sm );
+
+  return false;
+}
+
+
+/*
+ * Pico2's side. Returns false if the abort check said to give up. If
+ * Pico1 doesn't turn up at a negotiated rate it's dropped back to the
+ * starting one, see above, so this does too.
+ */
+bool link_wait_for_resync( PIO pio, int linkin_sm, int linkout_sm )
+{
+  bool in_step = false;
+
+  if( link_rate[pio_get_index( pio )] != 0 )
+  {
+    in_step = wait_for_init_sequence( pio, linkin_sm, linkout_sm, LINK_RATE_FALLBACK_US );
+    if( !in_step )
+      set_link_rate( pio, linkout_sm, linkin_sm, 0 );
+  }
+
+  if( !in_step && !wait_for_init_sequence( pio, linkin_sm, linkout_sm, LINK_WAIT_FOREVER ) )
+    return false;
+
+  inst_count( INST_LINK_RESYNCS );
+  out_of_step[pio_get_index( pio )] = false;
+  return true;
+}
+
+
+/* Worst cases for the line, both levels held, every edge, then a count */
+static void trial_pattern( uint8_t *pattern )
+{
+  static const uint8_t worst[] = { 0x00, 0xFF, 0x55, 0xAA };
+
+  for( uint32_t index = 0; index < LINK_RATE_TRIAL_BYTES; index++ )
+    pattern[index] = (index < 32) ? worst[index / 8] : index;
+}
+
+
+/*
+ * Pico1's side of negotiating the link's rate. The link has to be in
+ * step, and Pico2 in link_rate_follow(). For each faster rate Pico1
+ * proposes it at the rate which is known to work, both change, and
+ * the test pattern goes back and forth. If every round trip's right
+ * Pico1 says so, at the new rate, and that's the one to beat. The first
+ * rate which fails ends it, both go back to the last one which worked,
+ * and the link is resynced there. Returns the bit rate it ended up at.
+ */
+uint32_t link_rate_lead( PIO pio, int linkout_sm, int linkin_sm )
+{
+  uint8_t pattern[LINK_RATE_TRIAL_BYTES];
+  uint8_t echo[LINK_RATE_TRIAL_BYTES];
+  trial_pattern( pattern );
+
+  uint32_t good = link_rate[pio_get_index( pio )];
+
+  for( uint32_t rate = good + 1;
+       (rate < NUM_LINK_RATES) && (link_rate_pio_hz[rate] <= clock_get_hz( clk_sys ));
+       rate++ )
+  {
+    if( link_send_frame( pio, linkout_sm, linkin_sm, &rate, sizeof(rate), LINK_REPLY_TIMEOUT_US ) != LINK_OK )
+      return link_bit_rate( pio );
+
+    /* Pico2 changes as soon as the proposal's in, give it time to */
+    set_link_rate( pio, linkout_sm, linkin_sm, rate );
+    busy_wait_us( 5 * LINK_RATE_SETTLE_US );
+
+    bool passed = true;
+    for( uint32_t round = 0; passed && (round < LINK_RATE_TRIAL_ROUNDS); round++ )
+    {
+      passed = (link_send_frame( pio, linkout_sm, linkin_sm, pattern, sizeof(pattern), LINK_REPLY_TIMEOUT_US ) == LINK_OK) &&
+	       (link_receive_frame( pio, linkin_sm, linkout_sm, echo, sizeof(echo), LINK_REPLY_TIMEOUT_US ) == LINK_OK) &&
+	       (memcmp( pattern, echo, sizeof(pattern) ) == 0);
+    }
+
+    uint32_t verdict = passed;
+    if( passed )
+      passed = (link_send_frame( pio, linkout_sm, linkin_sm, &verdict, sizeof(verdict), LINK_REPLY_TIMEOUT_US ) == LINK_OK);
+
+    if( !passed )
+    {
+      /* Make sure Pico2 has given up on this rate too before resyncing at the old one */
+      link_lost_step( pio );
+      set_link_rate( pio, linkout_sm, linkin_sm, good );
+      busy_wait_us( 2 * LINK_REPLY_TIMEOUT_US );
+      link_resync( pio, linkout_sm, linkin_sm );
+
+      return link_bit_rate( pio );
+    }
+
+    good = rate;
+  }
+
+  uint32_t done = LINK_RATE_DONE;
+  link_send_frame( pio, linkout_sm, linkin_sm, &done, sizeof(done), LINK_REPLY_TIMEOUT_US );
+
+  return link_bit_rate( pio );
+}
+
+
+/*
+ * Pico2's side, see link_rate_lead(). Returns when Pico1 says it's done,
+ * or when a rate fails. In that case the link's left out of step at the
+ * last rate which worked, for Pico1 to resync.
+ */
+void link_rate_follow( PIO pio, int linkin_sm, int linkout_sm )
+{
+  uint8_t  pattern[LINK_RATE_TRIAL_BYTES];
+  uint32_t good = link_rate[pio_get_index( pio )];
+
+  while( 1 )
+  {
+    uint32_t rate;
+    if( link_receive_frame( pio, linkin_sm, linkout_sm, &rate, sizeof(rate), LINK_REPLY_TIMEOUT_US ) != LINK_OK )
+      return;
+
+    if( (rate >= NUM_LINK_RATES) || (link_rate_pio_hz[rate] > clock_get_hz( clk_sys )) )
+      return;
+
+    set_link_rate( pio, linkout_sm, linkin_sm, rate );
+
+    bool passed = true;
+    for( uint32_t round = 0; passed && (round < LINK_RATE_TRIAL_ROUNDS); round++ )
+    {
+      passed = (link_receive_frame( pio, linkin_sm, linkout_sm, pattern, sizeof(pattern), LINK_REPLY_TIMEOUT_US ) == LINK_OK) &&
+	       (link_send_frame( pio, linkout_sm, linkin_sm, pattern, sizeof(pattern), LINK_REPLY_TIMEOUT_US ) == LINK_OK);
+    }
+
+    uint32_t verdict = 0;
+    if( passed )
+      passed = (link_receive_frame( pio, linkin_sm, linkout_sm, &verdict, sizeof(verdict), LINK_REPLY_TIMEOUT_US ) == LINK_OK) && verdict;
+
+    if( !passed )
+    {
+      link_lost_step( pio );
+      set_link_rate( pio, linkout_sm, linkin_sm, good );
+      return;
+    }
+
+    good = rate;
+  }
 }
 
 
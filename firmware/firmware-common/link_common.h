@@ -31,17 +31,53 @@ typedef enum
 }
 link_received_t;
 
+typedef enum
+{
+  LINK_OK,
+  LINK_TIMEOUT,                         // The other side didn't answer in time
+  LINK_BAD_FRAME,                       // A frame arrived with a bad sync byte, length or CRC
+  LINK_ABANDONED,                       // The abort check said to give up
+  LINK_OUT_OF_STEP                      // Nothing goes over the link until it's resynced
+}
+LINK_RESULT;
+
+/*
+ * For the timeout_us arguments. Pico2 answers as soon as Pico1 drops the
+ * signal, so Pico1 doesn't wait long for a reply.
+ */
+#define LINK_WAIT_FOREVER     0
+#define LINK_REPLY_TIMEOUT_US 100000
+
 /* This is in the PIO source code, it's based on AM's transputer link */
 bool picoputerlinkin_get( PIO pio, uint sm, uint32_t *value );
 
 link_received_t ui_link_receive_acked_byte( PIO pio, int linkin_sm, int linkout_sm, uint8_t *received_value );
-void            ui_link_receive_buffer( PIO pio, int linkin_sm, int linkout_sm, uint8_t *data, uint32_t count );
+bool            ui_link_receive_buffer( PIO pio, int linkin_sm, int linkout_sm, uint8_t *data, uint32_t count );
 void            ui_link_send_ack_to_link( PIO pio, int linkout_sm );
-void            ui_link_send_byte( PIO pio, int linkout_sm, int linkin_sm, uint8_t data );
-void            ui_link_send_buffer( PIO pio, int linkout_sm, int linkin_sm, const uint8_t *data, uint32_t count );
+bool            ui_link_send_byte( PIO pio, int linkout_sm, int linkin_sm, uint8_t data );
+bool            ui_link_send_buffer( PIO pio, int linkout_sm, int linkin_sm, const uint8_t *data, uint32_t count );
+
+/* Lets a wait for the other side be abandoned, see link_common.c */
+void            link_set_abort_check( bool (*check)( void ) );
+
+bool            ui_link_send_init_sequence( PIO pio, int linkout_sm, int linkin_sm );
+bool            ui_link_wait_for_init_sequence( PIO pio, int linkin_sm, int linkout_sm );
+
+/* CRC checked frames, see link_common.c */
+LINK_RESULT     link_send_frame( PIO pio, int linkout_sm, int linkin_sm, const void *data, uint32_t count, uint32_t timeout_us );
+LINK_RESULT     link_receive_frame( PIO pio, int linkin_sm, int linkout_sm, void *data, uint32_t count, uint32_t timeout_us );
+LINK_RESULT     link_receive_frame_upto( PIO pio, int linkin_sm, int linkout_sm, void *data, uint32_t max, uint32_t *length, uint32_t timeout_us );
+
+/* Getting the two sides back in step, Pico1 resyncs, Pico2 waits for it */
+bool            link_out_of_step( PIO pio );
+void            link_lost_step( PIO pio );
+bool            link_resync( PIO pio, int linkout_sm, int linkin_sm );
+bool            link_wait_for_resync( PIO pio, int linkin_sm, int linkout_sm );
 
-void            ui_link_send_init_sequence( PIO pio, int linkout_sm, int linkin_sm );
-void            ui_link_wait_for_init_sequence( PIO pio, int linkin_sm, int linkout_sm );
+/* Settling on the fastest rate the link copes with, Pico1 leads, Pico2 follows */
+uint32_t        link_rate_lead( PIO pio, int linkout_sm, int linkin_sm );
+void            link_rate_follow( PIO pio, int linkin_sm, int linkout_sm );
+uint32_t        link_bit_rate( PIO pio );
 
 /* 16 bit checksum, might be useful */
 uint16_t fletcher16( uint8_t *data, int count );
@@ -0,0 +1,256 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Logic analyser capture, with a pre and post trigger window.
+ *
+ * A PIO state machine samples every GPIO on both edges of the Z80 clock,
+ * and DMA copies the samples into a ring buffer which is continuously
+ * overwritten. A second state machine watches for the trigger condition
+ * and raises a PIO IRQ flag when it sees it. Once the requested number of
+ * samples after the trigger have arrived, everything is stopped and the
+ * ring holds the samples either side of it.
+ *
+ * At 3.5MHz that's 7 million samples a second, which the PIO and DMA
+ * handle without the core being involved. The core only watches for the
+ * trigger, and the DMA transfer count to know when to stop.
+ *
+ * This code is compiled and linked into both the UI and IO Pico applications.
+ */
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+
+#include "logic_capture.h"
+#include "logic_capture.pio.h"
+
+/* Where the samples go */
+static uint32_t la_ring[LA_RING_SAMPLES] __attribute__((aligned(LA_RING_BYTES)));
+
+/*
+ * The DMA is given this many transfers, which at 7MHz lasts about 10
+ * minutes. That's far longer than any capture is expected to run for.
+ */
+#define LA_DMA_COUNT 0xFFFFFFFF
+
+/*
+ * The core sees the trigger a few samples after the event, because the
+ * samples are sat in the FIFO for a while and the core takes a moment to
+ * notice. The trigger sample is found properly afterwards by looking
+ * this far either side of where the core thought it was.
+ */
+#define LA_TRIGGER_SLOP 16
+
+/* Number of samples the DMA has written so far */
+static inline uint32_t samples_written( uint dma_chan )
+{
+  return LA_DMA_COUNT - dma_hw->ch[dma_chan].transfer_count;
+}
+
+/*
+ * True if the given sample meets the trigger condition. This is the
+ * software version of what the trigger PIO programs look for.
+ */
+static bool trigger_condition( const LA_TRIGGER *trigger, uint32_t sample )
+{
+  switch( trigger->type )
+  {
+  case LA_TRIGGER_FALLING_EDGE:
+    return (sample & (1u << trigger->pin)) == 0;
+
+  case LA_TRIGGER_BOTH_LOW:
+    return (sample & ((1u << trigger->pin) | (1u << trigger->second_pin))) == 0;
+
+  case LA_TRIGGER_DATA8:
+    return ((sample >> trigger->pin) & 0xFF) == trigger->value;
+
+  case LA_TRIGGER_ADDRESS16:
+    return (((sample >> trigger->pin) & 0xFFFF) == trigger->value) &&
+           ((sample & (1u << trigger->second_pin)) == 0);
+  }
+
+  return false;
+}
+
+/*
+ * Run a capture. The trigger isn't armed until there are enough samples
+ * in the ring to satisfy the pre-trigger count. Once it fires, the
+ * capture continues until the post-trigger count has arrived.
+ *
+ * still_running() is polled throughout, if it returns false the capture
+ * is abandoned. In that case the capture holds the last samples taken,
+ * and is marked as not triggered.
+ *
+ * Returns the value of capture->triggered.
+ */
+bool la_capture( PIO pio, uint clk_pin, const LA_TRIGGER *trigger,
+		 uint32_t pre_samples, uint32_t post_samples,
+		 bool (*still_running)( void ), LA_CAPTURE *capture )
+{
+  if( pre_samples + post_samples > LA_MAX_SAMPLES )
+    panic("Logic analyser capture of %d samples is too big", pre_samples + post_samples);
+
+  /* Capture state machine */
+  uint capture_offset = pio_add_program( pio, &la_capture_program );
+  uint capture_sm     = pio_claim_unused_sm( pio, true );
+  la_capture_program_init( pio, capture_sm, capture_offset, clk_pin );
+
+  /* Trigger state machine, which program depends on the trigger condition */
+  const pio_program_t *trigger_program;
+  switch( trigger->type )
+  {
+  case LA_TRIGGER_FALLING_EDGE: trigger_program = &la_trigger_edge_program;     break;
+  case LA_TRIGGER_BOTH_LOW:     trigger_program = &la_trigger_both_low_program; break;
+  case LA_TRIGGER_DATA8:        trigger_program = &la_trigger_data8_program;    break;
+  case LA_TRIGGER_ADDRESS16:    trigger_program = &la_trigger_address_program;  break;
+  default:
+    panic("Logic analyser trigger type %d unknown", trigger->type);
+  }
+
+  uint trigger_offset = pio_add_program( pio, trigger_program );
+  uint trigger_sm     = pio_claim_unused_sm( pio, true );
+
+  switch( trigger->type )
+  {
+  case LA_TRIGGER_FALLING_EDGE:
+    la_trigger_edge_program_init( pio, trigger_sm, trigger_offset, trigger->pin );
+    break;
+  case LA_TRIGGER_BOTH_LOW:
+    la_trigger_both_low_program_init( pio, trigger_sm, trigger_offset, trigger->pin, trigger->second_pin );
+    break;
+  case LA_TRIGGER_DATA8:
+    la_trigger_data8_program_init( pio, trigger_sm, trigger_offset, trigger->pin );
+    pio_sm_put( pio, trigger_sm, trigger->value );
+    break;
+  case LA_TRIGGER_ADDRESS16:
+    la_trigger_address_program_init( pio, trigger_sm, trigger_offset, trigger->pin );
+    pio_sm_put( pio, trigger_sm, trigger->value );
+    break;
+  }
+  pio_interrupt_clear( pio, 0 );
+
+  /* DMA from the capture state machine's FIFO into the ring */
+  uint dma_chan = dma_claim_unused_channel( true );
+  dma_channel_config dma_config = dma_channel_get_default_config( dma_chan );
+  channel_config_set_transfer_data_size( &dma_config, DMA_SIZE_32 );
+  channel_config_set_read_increment( &dma_config, false );
+  channel_config_set_write_increment( &dma_config, true );
+  channel_config_set_ring( &dma_config, true, LA_RING_BITS );
+  channel_config_set_dreq( &dma_config, pio_get_dreq( pio, capture_sm, false ) );
+  dma_channel_configure( dma_chan, &dma_config, la_ring, &pio->rxf[capture_sm], LA_DMA_COUNT, true );
+
+  pio_sm_set_enabled( pio, capture_sm, true );
+
+  /* Fill the pre-trigger part of the ring before the trigger is armed */
+  bool     running   = true;
+  bool     triggered = false;
+  uint32_t trigger_written = 0;
+
+  while( running && (samples_written( dma_chan ) < pre_samples + LA_TRIGGER_SLOP) )
+    running = still_running();
+
+  if( running )
+    pio_sm_set_enabled( pio, trigger_sm, true );
+
+  /* Wait for the trigger */
+  while( running && !triggered )
+  {
+    if( pio_interrupt_get( pio, 0 ) )
+    {
+      trigger_written = samples_written( dma_chan );
+      triggered = true;
+    }
+    else
+    {
+      running = still_running();
+    }
+  }
+
+  /* Wait for the post-trigger samples, plus a few to find the real trigger point */
+  while( running && triggered &&
+	 (samples_written( dma_chan ) - trigger_written < post_samples + LA_TRIGGER_SLOP) )
+    running = still_running();
+
+  /* Freeze everything */
+  pio_sm_set_enabled( pio, trigger_sm, false );
+  pio_sm_set_enabled( pio, capture_sm, false );
+  dma_channel_abort( dma_chan );
+
+  uint32_t total_written = samples_written( dma_chan );
+
+  dma_channel_unclaim( dma_chan );
+  pio_sm_clear_fifos( pio, capture_sm );
+  pio_sm_clear_fifos( pio, trigger_sm );
+  pio_sm_unclaim( pio, capture_sm );
+  pio_sm_unclaim( pio, trigger_sm );
+  pio_remove_program( pio, &la_capture_program, capture_offset );
+  pio_remove_program( pio, trigger_program, trigger_offset );
+  pio_interrupt_clear( pio, 0 );
+
+  if( triggered && running )
+  {
+    /*
+     * Find the sample where the condition actually became true. It's
+     * the earliest one in the window around where the core noticed the
+     * trigger which meets the condition when the sample before it didn't.
+     * If there isn't one the line glitched faster than the sampling, in
+     * which case the core's idea of it will have to do.
+     */
+    uint32_t trigger_sample = trigger_written - 1;
+    for( uint32_t written = trigger_written - LA_TRIGGER_SLOP; written < trigger_written + LA_TRIGGER_SLOP; written++ )
+    {
+      if(  trigger_condition( trigger, la_ring[ written      % LA_RING_SAMPLES] ) &&
+	  !trigger_condition( trigger, la_ring[(written - 1) % LA_RING_SAMPLES] ) )
+      {
+	trigger_sample = written;
+	break;
+      }
+    }
+
+    capture->triggered      = true;
+    capture->start          = (trigger_sample - pre_samples) % LA_RING_SAMPLES;
+    capture->num_samples    = pre_samples + 1 + post_samples;
+    capture->trigger_sample = pre_samples;
+  }
+  else
+  {
+    /* Stopped without a trigger, hand back whatever came last */
+    uint32_t num_samples = pre_samples + 1 + post_samples;
+    if( num_samples > total_written )
+      num_samples = total_written;
+
+    capture->triggered      = false;
+    capture->start          = (total_written - num_samples) % LA_RING_SAMPLES;
+    capture->num_samples    = num_samples;
+    capture->trigger_sample = num_samples;
+  }
+
+  return capture->triggered;
+}
+
+
+/*
+ * Fetch a sample from a completed capture. sample is counted from the
+ * start of the capture, the ring wrap is taken care of here.
+ */
+uint32_t la_capture_sample( const LA_CAPTURE *capture, uint32_t sample )
+{
+  return la_ring[ (capture->start + sample) % LA_RING_SAMPLES ];
+}
@@ -0,0 +1,70 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __LOGIC_CAPTURE_H
+#define __LOGIC_CAPTURE_H
+
+#include "hardware/pio.h"
+
+/*
+ * The ring buffer the samples go into. DMA wraps it, which needs it to
+ * be a power of 2 in size and aligned to that size. 32KB is the largest
+ * ring the DMA can do.
+ */
+#define LA_RING_BITS    15
+#define LA_RING_BYTES   (1 << LA_RING_BITS)
+#define LA_RING_SAMPLES (LA_RING_BYTES / sizeof(uint32_t))
+
+/* The most pre and post trigger samples which can be asked for, in total */
+#define LA_MAX_SAMPLES  (LA_RING_SAMPLES - 64)
+
+typedef enum
+{
+  LA_TRIGGER_FALLING_EDGE,        // pin goes low
+  LA_TRIGGER_BOTH_LOW,            // pin and second_pin both low
+  LA_TRIGGER_DATA8,               // 8 lines from pin match value
+  LA_TRIGGER_ADDRESS16,           // 16 lines from pin match value while second_pin (MREQ) is low
+}
+LA_TRIGGER_TYPE;
+
+typedef struct
+{
+  LA_TRIGGER_TYPE type;
+  uint32_t        pin;
+  uint32_t        second_pin;     // For BOTH_LOW and ADDRESS16. For ADDRESS16 it must be pin+16
+  uint32_t        value;          // For DATA8 and ADDRESS16
+}
+LA_TRIGGER;
+
+/* A completed capture. Samples are GPIO states, one per clock edge */
+typedef struct
+{
+  bool     triggered;             // False if the capture stopped without the trigger firing
+  uint32_t start;                 // Ring index of the first sample
+  uint32_t num_samples;           // Number of samples in the capture
+  uint32_t trigger_sample;        // Which of those samples is the trigger
+}
+LA_CAPTURE;
+
+bool     la_capture( PIO pio, uint clk_pin, const LA_TRIGGER *trigger,
+		     uint32_t pre_samples, uint32_t post_samples,
+		     bool (*still_running)( void ), LA_CAPTURE *capture );
+uint32_t la_capture_sample( const LA_CAPTURE *capture, uint32_t sample );
+
+#endif
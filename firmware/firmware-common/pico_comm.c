@@ -0,0 +1,247 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Pico1 asking Pico2 to run a test, and Pico2 answering.
+ *
+ * Pico1 sends a request, which says which test and carries its
+ * parameters, then raises the signal to start it and drops it to stop
+ * it, as it always has. Pico2 then sends a response: a header saying
+ * whether it could do it and how much there is to follow, and the
+ * results, streamed in frames of up to PICO_COMM_CHUNK bytes. The
+ * results don't have to be in one piece at Pico2's end or fit in one
+ * frame.
+ *
+ * Pico2 always answers, with an error if it doesn't have the test, or
+ * the request doesn't make sense. So a Pico2 which is older or newer
+ * than Pico1 says so rather than leaving Pico1 waiting.
+ */
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "link_common.h"
+#include "pico_comm.h"
+
+/*
+ * Pico1. Send a request. Returns false if it didn't get there, in which
+ * case the link is out of step.
+ */
+bool pico_comm_request( PIO pio, int linkout_sm, int linkin_sm,
+			PICO_COMM_TYPE type, const void *params, uint32_t params_length )
+{
+  static uint8_t request[sizeof(PICO_COMM_REQUEST_HEADER) + PICO_COMM_MAX_PARAMS];
+
+  if( params_length > PICO_COMM_MAX_PARAMS )
+    panic("Parameters for Pico2 request %08lX are too long", type);
+
+  PICO_COMM_REQUEST_HEADER header = { PICO_COMM_VERSION, 0, params_length, type };
+  memcpy( request, &header, sizeof(header) );
+  if( params_length )
+    memcpy( request + sizeof(header), params, params_length );
+
+  return link_send_frame( pio, linkout_sm, linkin_sm, request, sizeof(header) + params_length,
+			  LINK_REPLY_TIMEOUT_US ) == LINK_OK;
+}
+
+/*
+ * Pico1. Whether the response has started to arrive. Pico2 answers as
+ * soon as it's finished, which can be well before Pico1 drops the
+ * signal, so a test can look for this to end early. It only looks, the
+ * first byte stays where it is for pico_comm_response().
+ */
+bool pico_comm_response_started( PIO pio, int linkin_sm )
+{
+  return !pio_sm_is_rx_fifo_empty( pio, linkin_sm );
+}
+
+/*
+ * Pico1. Receive the response to a request of the given type. Up to max
+ * bytes of it go in result, anything more is thrown away, and the length
+ * there was goes in *length. If length is NULL the response has to be
+ * exactly max bytes.
+ */
+PICO_COMM_STATUS pico_comm_response( PIO pio, int linkin_sm, int linkout_sm,
+				     PICO_COMM_TYPE type, void *result, uint32_t max, uint32_t *length )
+{
+  static uint8_t chunk[PICO_COMM_CHUNK];
+
+  PICO_COMM_RESPONSE_HEADER header;
+  if( link_receive_frame( pio, linkin_sm, linkout_sm, &header, sizeof(header), LINK_REPLY_TIMEOUT_US ) != LINK_OK )
+    return PICO_COMM_NO_RESPONSE;
+
+  /* Not the answer to this question, so who knows what's coming next */
+  if( (header.version != PICO_COMM_VERSION) && (header.status != PICO_COMM_BAD_VERSION) )
+  {
+    link_lost_step( pio );
+    return PICO_COMM_BAD_VERSION;
+  }
+  if( header.type != type )
+  {
+    link_lost_step( pio );
+    return PICO_COMM_BAD_RESPONSE;
+  }
+
+  if( header.status != PICO_COMM_OK )
+  {
+    if( header.length != 0 )
+      link_lost_step( pio );
+    return header.status;
+  }
+
+  uint32_t received = 0;
+  while( received < header.length )
+  {
+    uint32_t chunk_length;
+    if( link_receive_frame_upto( pio, linkin_sm, linkout_sm, chunk, sizeof(chunk), &chunk_length,
+				 LINK_REPLY_TIMEOUT_US ) != LINK_OK )
+      return PICO_COMM_NO_RESPONSE;
+
+    if( (chunk_length == 0) || (chunk_length > header.length - received) )
+    {
+      link_lost_step( pio );
+      return PICO_COMM_BAD_RESPONSE;
+    }
+
+    if( received < max )
+      memcpy( (uint8_t*)result + received, chunk, (chunk_length < max - received) ? chunk_length : max - received );
+    received += chunk_length;
+  }
+
+  if( length != NULL )
+    *length = header.length;
+  else if( header.length != max )
+    return PICO_COMM_BAD_RESPONSE;
+
+  return PICO_COMM_OK;
+}
+
+/*
+ * Pico1. What went wrong, short enough for a line on the screen. A page
+ * which gets no results shows this instead, so a Pico2 with older or
+ * newer firmware says so rather than leaving the page blank.
+ */
+const char *pico_comm_status_str( PICO_COMM_STATUS status )
+{
+  switch( status )
+  {
+  case PICO_COMM_OK:           return "OK";
+  case PICO_COMM_UNKNOWN_TYPE: return "Pico2 lacks this test";
+  case PICO_COMM_BAD_VERSION:  return "Pico2 firmware mismatch";
+  case PICO_COMM_BAD_PARAMS:   return "Pico2 rejected params";
+  case PICO_COMM_BAD_REQUEST:  return "Pico2 bad request";
+  case PICO_COMM_NO_RESPONSE:  return "Pico2 no answer";
+  case PICO_COMM_BAD_RESPONSE: return "Pico2 bad response";
+  }
+
+  return "Pico2 status unknown";
+}
+
+/*
+ * Pico1. Put the status on the first of a page's result lines and blank
+ * the rest, rather than leave the last results up. The lines are the
+ * page's array of text buffers, each line_size bytes.
+ */
+void pico_comm_show_status( PICO_COMM_STATUS status, uint8_t *lines, uint32_t line_size, uint32_t num_lines )
+{
+  for( uint32_t index = 0; index < num_lines; index++ )
+    lines[index * line_size] = '\0';
+
+  snprintf( (char*)lines, line_size, "%s", pico_comm_status_str( status ) );
+}
+
+/*
+ * Pico2. Wait for a request. The parameters go in params, which has to
+ * have room for PICO_COMM_MAX_PARAMS bytes. Returns false if the link
+ * failed, otherwise *status says whether the request made sense.
+ */
+bool pico_comm_receive_request( PIO pio, int linkin_sm, int linkout_sm,
+				PICO_COMM_REQUEST_HEADER *header, void *params,
+				PICO_COMM_STATUS *status )
+{
+  static uint8_t request[sizeof(PICO_COMM_REQUEST_HEADER) + PICO_COMM_MAX_PARAMS];
+  uint32_t       length;
+
+  if( link_receive_frame_upto( pio, linkin_sm, linkout_sm, request, sizeof(request), &length,
+			       LINK_WAIT_FOREVER ) != LINK_OK )
+    return false;
+
+  memset( header, 0, sizeof(*header) );
+  memcpy( header, request, (length < sizeof(*header)) ? length : sizeof(*header) );
+
+  if( length < sizeof(*header) )
+    *status = PICO_COMM_BAD_REQUEST;
+  else if( header->version != PICO_COMM_VERSION )
+    *status = PICO_COMM_BAD_VERSION;
+  else if( header->params_length != length - sizeof(*header) )
+    *status = PICO_COMM_BAD_REQUEST;
+  else
+    *status = PICO_COMM_OK;
+
+  if( *status == PICO_COMM_OK )
+    memcpy( params, request + sizeof(*header), header->params_length );
+
+  return true;
+}
+
+/*
+ * Pico2. Start the response, length bytes are to follow. Pico1 might
+ * still be waiting out the test, so this waits as long as it takes.
+ * Returns false if the link failed.
+ */
+bool pico_comm_respond_begin( PIO pio, int linkout_sm, int linkin_sm,
+			      uint32_t type, PICO_COMM_STATUS status, uint32_t length )
+{
+  PICO_COMM_RESPONSE_HEADER header = { PICO_COMM_VERSION, status, 0, type, length };
+
+  return link_send_frame( pio, linkout_sm, linkin_sm, &header, sizeof(header), LINK_WAIT_FOREVER ) == LINK_OK;
+}
+
+/*
+ * Pico2. Send some of the results. However many calls it takes, they
+ * have to add up to the length the response started with.
+ */
+bool pico_comm_respond_data( PIO pio, int linkout_sm, int linkin_sm,
+			     const void *data, uint32_t length )
+{
+  const uint8_t *next = data;
+
+  while( length )
+  {
+    uint32_t chunk_length = (length < PICO_COMM_CHUNK) ? length : PICO_COMM_CHUNK;
+
+    if( link_send_frame( pio, linkout_sm, linkin_sm, next, chunk_length, LINK_REPLY_TIMEOUT_US ) != LINK_OK )
+      return false;
+
+    next   += chunk_length;
+    length -= chunk_length;
+  }
+
+  return true;
+}
+
+/* Pico2. The whole response, when the results are all in one place */
+bool pico_comm_respond( PIO pio, int linkout_sm, int linkin_sm,
+			uint32_t type, PICO_COMM_STATUS status, const void *result, uint32_t length )
+{
+  return pico_comm_respond_begin( pio, linkout_sm, linkin_sm, type, status, length ) &&
+         pico_comm_respond_data( pio, linkout_sm, linkin_sm, result, length );
+}
@@ -0,0 +1,91 @@
+#ifndef __PICO_COMM_H
+#define __PICO_COMM_H
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+
+#include "link_common.h"
+
+/*
+ * Requests from Pico1 to Pico2, and Pico2's responses, see pico_comm.c.
+ * Bump the version when the headers, or any test's parameters or results
+ * in test_data.h, change shape.
+ */
+#define PICO_COMM_VERSION 3
+
+/* What Pico1 can ask for. The values are the magic numbers the link has always used */
+typedef enum
+{
+  PICO_COMM_TEST_ABUS    = 0x01020304,
+  PICO_COMM_TEST_ROM     = 0x04030201,
+  PICO_COMM_TEST_REFRESH = 0x02040608,
+  PICO_COMM_TEST_CAPTURE = 0x08060402,
+  PICO_COMM_TEST_STATS   = 0x0C080402,
+  PICO_COMM_LINK_RATE    = 0x10080402,
+  PICO_COMM_TEST_BOOT    = 0x14080402,
+  PICO_COMM_TEST_RESET   = 0x18080402,
+}
+PICO_COMM_TYPE;
+
+typedef enum
+{
+  PICO_COMM_OK,
+  PICO_COMM_UNKNOWN_TYPE,               // Pico2's firmware doesn't have that test
+  PICO_COMM_BAD_VERSION,                // The Picos' firmware speak different versions of this
+  PICO_COMM_BAD_PARAMS,                 // Wrong size of parameters for the test, or out of range
+  PICO_COMM_BAD_REQUEST,                // Didn't add up, the header's length was wrong
+  PICO_COMM_NO_RESPONSE,                // Pico1 only, the link failed
+  PICO_COMM_BAD_RESPONSE,               // Pico1 only, not the response asked for, or not the length
+}
+PICO_COMM_STATUS;
+
+/* A request is one link frame, this then params_length bytes of the test's parameters */
+typedef struct
+{
+  uint8_t  version;
+  uint8_t  reserved;
+  uint16_t params_length;
+  uint32_t type;
+}
+PICO_COMM_REQUEST_HEADER;
+
+#define PICO_COMM_MAX_PARAMS 512
+
+/* A response is a frame with this, then frames of up to PICO_COMM_CHUNK bytes until there's length of them */
+typedef struct
+{
+  uint8_t  version;
+  uint8_t  status;                      // PICO_COMM_STATUS, there's no more to it unless it's OK
+  uint16_t reserved;
+  uint32_t type;                        // What was asked for
+  uint32_t length;                      // Bytes of results to follow
+}
+PICO_COMM_RESPONSE_HEADER;
+
+#define PICO_COMM_CHUNK 256
+
+/* How often Pico1 looks for Pico2 having finished a test early */
+#define PICO_COMM_POLL_US 1000
+
+/* Pico1's side */
+bool             pico_comm_request( PIO pio, int linkout_sm, int linkin_sm,
+				    PICO_COMM_TYPE type, const void *params, uint32_t params_length );
+bool             pico_comm_response_started( PIO pio, int linkin_sm );
+PICO_COMM_STATUS pico_comm_response( PIO pio, int linkin_sm, int linkout_sm,
+				     PICO_COMM_TYPE type, void *result, uint32_t max, uint32_t *length );
+const char      *pico_comm_status_str( PICO_COMM_STATUS status );
+void             pico_comm_show_status( PICO_COMM_STATUS status, uint8_t *lines,
+					uint32_t line_size, uint32_t num_lines );
+
+/* Pico2's side */
+bool             pico_comm_receive_request( PIO pio, int linkin_sm, int linkout_sm,
+					    PICO_COMM_REQUEST_HEADER *header, void *params,
+					    PICO_COMM_STATUS *status );
+bool             pico_comm_respond_begin( PIO pio, int linkout_sm, int linkin_sm,
+					  uint32_t type, PICO_COMM_STATUS status, uint32_t length );
+bool             pico_comm_respond_data( PIO pio, int linkout_sm, int linkin_sm,
+					 const void *data, uint32_t length );
+bool             pico_comm_respond( PIO pio, int linkout_sm, int linkin_sm,
+				    uint32_t type, PICO_COMM_STATUS status, const void *result, uint32_t length );
+
+#endif
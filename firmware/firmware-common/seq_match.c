@@ -0,0 +1,162 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Multiple sequence matcher, Aho-Corasick over 16-bit values.
+ *
+ * The sequences go into a tree, one node per value, with the ones which
+ * start the same way sharing the start. Each node also has a fail link,
+ * to the node for the longest tail of its own sequence which is the
+ * start of some other sequence. So when the next value doesn't lead on
+ * from where the matcher's got to, it drops back to that rather than
+ * starting again, and it never has to look at a value twice. One pass
+ * through the data finds all of the sequences, however many there are.
+ *
+ * The values are addresses, so there are too many possible ones to have
+ * a table of where each leads from each node. The children are a list
+ * instead. There's hardly ever more than one or two of them.
+ */
+
+#include "pico/stdlib.h"
+#include <string.h>
+
+#include "seq_match.h"
+
+static uint32_t find_child( const SEQ_MATCHER *matcher, uint32_t state, uint16_t symbol )
+{
+  for( uint32_t child = matcher->node[state].first_child; child != 0; child = matcher->node[child].next_sibling )
+  {
+    if( matcher->node[child].symbol == symbol )
+      return child;
+  }
+
+  return 0;
+}
+
+/*
+ * Build the matcher for the given sequences, which are one after the
+ * other in symbols. Returns false if there are too many of them or
+ * they're too long between them, or one of them is empty.
+ */
+bool seq_match_build( SEQ_MATCHER *matcher, uint32_t num_patterns,
+		      const uint16_t *pattern_length, const uint16_t *symbols )
+{
+  static uint16_t queue[SEQ_MATCH_MAX_SYMBOLS + 1];
+
+  if( num_patterns > SEQ_MATCH_MAX_PATTERNS )
+    return false;
+
+  memset( &matcher->node[SEQ_MATCH_START], 0, sizeof(matcher->node[0]) );
+  matcher->num_nodes = 1;
+
+  /* The tree, a path from the start for each sequence */
+  const uint16_t *next = symbols;
+  for( uint32_t pattern = 0; pattern < num_patterns; pattern++ )
+  {
+    if( pattern_length[pattern] == 0 )
+      return false;
+
+    uint32_t state = SEQ_MATCH_START;
+    for( uint32_t i = 0; i < pattern_length[pattern]; i++ )
+    {
+      uint32_t child = find_child( matcher, state, next[i] );
+      if( child == 0 )
+      {
+	if( matcher->num_nodes == SEQ_MATCH_MAX_SYMBOLS + 1 )
+	  return false;
+
+	child = matcher->num_nodes++;
+	matcher->node[child].symbol       = next[i];
+	matcher->node[child].first_child  = 0;
+	matcher->node[child].next_sibling = matcher->node[state].first_child;
+	matcher->node[child].fail         = SEQ_MATCH_START;
+	matcher->node[child].found        = 0;
+	matcher->node[state].first_child  = child;
+      }
+      state = child;
+    }
+
+    matcher->node[state].found |= 1u << pattern;
+    next += pattern_length[pattern];
+  }
+
+  /*
+   * The fail links. A node's is found from its parent's, which is
+   * shorter, so they're done a level at a time from the start. The
+   * start's children fail back to the start, which they already do.
+   */
+  uint32_t head = 0, tail = 0;
+  for( uint32_t child = matcher->node[SEQ_MATCH_START].first_child; child != 0; child = matcher->node[child].next_sibling )
+    queue[tail++] = child;
+
+  while( head < tail )
+  {
+    uint32_t state = queue[head++];
+
+    for( uint32_t child = matcher->node[state].first_child; child != 0; child = matcher->node[child].next_sibling )
+    {
+      uint32_t fail = matcher->node[state].fail;
+      uint32_t target;
+      while( ((target = find_child( matcher, fail, matcher->node[child].symbol )) == 0) && (fail != SEQ_MATCH_START) )
+	fail = matcher->node[fail].fail;
+
+      /* A sequence which ends at the fail node ends here too */
+      matcher->node[child].fail   = target;
+      matcher->node[child].found |= matcher->node[target].found;
+
+      queue[tail++] = child;
+    }
+  }
+
+  return true;
+}
+
+/*
+ * Feed the matcher the next value. Returns the state to feed the one
+ * after to, and adds any sequences which have just been seen to *found.
+ */
+uint32_t seq_match_step( const SEQ_MATCHER *matcher, uint32_t state, uint16_t symbol, uint32_t *found )
+{
+  while( 1 )
+  {
+    uint32_t child = find_child( matcher, state, symbol );
+    if( child != 0 )
+    {
+      *found |= matcher->node[child].found;
+      return child;
+    }
+
+    if( state == SEQ_MATCH_START )
+      return SEQ_MATCH_START;
+
+    state = matcher->node[state].fail;
+  }
+}
+
+/* The sequences which are anywhere in the data */
+uint32_t seq_match_scan( const SEQ_MATCHER *matcher, const uint16_t *data, uint32_t length )
+{
+  uint32_t state = SEQ_MATCH_START;
+  uint32_t found = 0;
+
+  for( uint32_t i = 0; i < length; i++ )
+    state = seq_match_step( matcher, state, data[i], &found );
+
+  return found;
+}
@@ -0,0 +1,38 @@
+#ifndef __SEQ_MATCH_H
+#define __SEQ_MATCH_H
+
+#include "pico/stdlib.h"
+
+/*
+ * Looks for several sequences of 16-bit values at once, in one pass,
+ * see seq_match.c. Each sequence found sets its bit in a mask, so there
+ * can be up to 32 of them.
+ */
+#define SEQ_MATCH_MAX_PATTERNS 32
+#define SEQ_MATCH_MAX_SYMBOLS  256
+
+#define SEQ_MATCH_START        0        // The state to feed the first value to
+
+typedef struct
+{
+  uint16_t symbol;                      // The value which leads here from the parent
+  uint16_t first_child;                 // 0 if there are none, the start state is nobody's child
+  uint16_t next_sibling;
+  uint16_t fail;                        // Where to carry on from if the next value doesn't lead on
+  uint32_t found;                       // Sequences which end here, or at any of the fail states
+}
+SEQ_MATCH_NODE;
+
+typedef struct
+{
+  SEQ_MATCH_NODE node[SEQ_MATCH_MAX_SYMBOLS + 1];
+  uint32_t       num_nodes;
+}
+SEQ_MATCHER;
+
+bool     seq_match_build( SEQ_MATCHER *matcher, uint32_t num_patterns,
+			  const uint16_t *pattern_length, const uint16_t *symbols );
+uint32_t seq_match_step( const SEQ_MATCHER *matcher, uint32_t state, uint16_t symbol, uint32_t *found );
+uint32_t seq_match_scan( const SEQ_MATCHER *matcher, const uint16_t *data, uint32_t length );
+
+#endif
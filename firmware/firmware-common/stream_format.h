@@ -0,0 +1,103 @@
+#ifndef __STREAM_FORMAT_H
+#define __STREAM_FORMAT_H
+
+/*
+ * Binary framing used to stream data from the Picos to a host over USB.
+ * This is plain C with no SDK dependencies so host side tools can use it
+ * as-is. Everything is little endian, which both the Pico and any PC
+ * the tools are likely to run on are.
+ *
+ * Each frame is:
+ *
+ *  STREAM_FRAME_HEADER   6 bytes
+ *  payload               header.length bytes, at most STREAM_MAX_PAYLOAD
+ *  checksum              2 bytes, fletcher16 of the header and payload
+ *
+ * A frame is either sent whole or not at all, so a host which loses
+ * sync can find the next frame by looking for the sync bytes and
+ * checking the checksum. The sequence number goes up by one for every
+ * frame the Pico tries to send, so gaps show where frames were dropped.
+ */
+
+#include <stdint.h>
+
+#define STREAM_SYNC0         0x5A
+#define STREAM_SYNC1         0xA5
+
+#define STREAM_MAX_PAYLOAD   1024
+
+typedef enum
+{
+  STREAM_FRAME_CAPTURE_START = 0x01,       // STREAM_CAPTURE_START payload
+  STREAM_FRAME_CAPTURE_DATA  = 0x02,       // Encoded samples, see below
+  STREAM_FRAME_CAPTURE_END   = 0x03,       // STREAM_CAPTURE_END payload
+  STREAM_FRAME_STATS         = 0x04,       // STREAM_STATS payload
+}
+STREAM_FRAME_TYPE;
+
+/* Which Pico sent the data, the GPIOs mean different things on each */
+typedef enum
+{
+  STREAM_SOURCE_PICO1 = 1,
+  STREAM_SOURCE_PICO2 = 2,
+}
+STREAM_SOURCE;
+
+typedef struct __attribute__((packed))
+{
+  uint8_t  sync[2];
+  uint8_t  type;
+  uint8_t  sequence;
+  uint16_t length;
+}
+STREAM_FRAME_HEADER;
+
+#define STREAM_FRAME_OVERHEAD (sizeof(STREAM_FRAME_HEADER) + sizeof(uint16_t))
+
+/*
+ * A logic analyser capture is sent as a START frame, as many DATA frames
+ * as it takes, then an END frame.
+ *
+ * The samples are one per clock edge, so the clock line would change in
+ * every sample. That stops any run length encoding working, so it's taken
+ * out of the samples before they're sent. It can be put back from the
+ * sample number: first_clk_level says what it is in sample 0, and it
+ * alternates from there.
+ *
+ * DATA frames carry 32 bit words. A word with bit 31 clear is a sample.
+ * A word with bit 31 set says the previous sample repeats the number of
+ * times in the bottom 31 bits. The RP2040 has no GPIO 31, so real samples
+ * never have that bit set.
+ */
+#define STREAM_REPEAT_FLAG   0x80000000
+
+typedef struct __attribute__((packed))
+{
+  uint32_t capture_id;                     // Goes up by one per capture
+  uint8_t  source;                         // STREAM_SOURCE
+  uint8_t  trigger_type;                   // LA_TRIGGER_TYPE
+  uint8_t  clk_gpio;                       // GPIO the clock is on, masked out of samples
+  uint8_t  first_clk_level;                // Clock level at sample 0
+  uint32_t trigger_value;                  // What the trigger was looking for
+  uint32_t triggered;                      // Non-zero if the trigger fired
+  uint32_t num_samples;                    // Number of samples which will follow
+  uint32_t trigger_sample;                 // Which of those is the trigger
+}
+STREAM_CAPTURE_START;
+
+typedef struct __attribute__((packed))
+{
+  uint32_t capture_id;
+  uint32_t num_samples;                    // Samples sent, should match the START frame
+}
+STREAM_CAPTURE_END;
+
+typedef struct __attribute__((packed))
+{
+  uint32_t frames_sent;
+  uint32_t frames_dropped;                 // Not connected, or host not reading
+  uint32_t bytes_sent;
+}
+STREAM_STATS;
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * System clock profile.
+ *
+ * Both Picos can be built to run at 250MHz instead of the default
+ * 125MHz, which roughly doubles how often the sampling loops look at the
+ * bus. This has to be the first thing main() does: changing the system
+ * clock moves the peripheral clock with it, so the I2C for the OLED and
+ * anything else which works out a divider from it must be set up after.
+ *
+ * The link PIO programs work out their dividers from the system clock,
+ * so the two Picos don't need to be built with the same setting.
+ */
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/vreg.h"
+
+#include "sys_clock.h"
+
+void sys_clock_init( void )
+{
+#if ZXDIAG_SYS_CLK_KHZ != 125000
+
+  /*
+   * 250MHz is beyond what the RP2040 is rated for, but it's widely used.
+   * A little more core voltage keeps it steady. The flash runs at half
+   * the system clock, 125MHz, which is inside what the Pico's flash chip
+   * can do.
+   */
+#if ZXDIAG_SYS_CLK_KHZ > 133000
+  vreg_set_voltage( VREG_VOLTAGE_1_15 );
+  busy_wait_us_32( 10000 );
+#endif
+
+  if( !set_sys_clock_khz( ZXDIAG_SYS_CLK_KHZ, false ) )
+    panic("System clock can't be set to %dkHz", ZXDIAG_SYS_CLK_KHZ);
+
+#endif
+}
@@ -0,0 +1,21 @@
+#ifndef __SYS_CLOCK_H
+#define __SYS_CLOCK_H
+
+/*
+ * System clock the firmware runs at, in kHz. The build sets this, see
+ * ZXDIAG_SYS_CLK_KHZ in the CMakeLists. Left alone it's the SDK's own
+ * default, so nothing changes.
+ */
+#ifndef ZXDIAG_SYS_CLK_KHZ
+#define ZXDIAG_SYS_CLK_KHZ 125000
+#endif
+
+/*
+ * The PIO programs with delays in them were timed at this speed. They
+ * divide their clocks down to it when the system clock is faster.
+ */
+#define PIO_TIMING_HZ 125000000
+
+void sys_clock_init( void );
+
+#endif
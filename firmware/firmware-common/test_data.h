@@ -1,7 +1,15 @@
 #ifndef __TEST_DATA_H
 #define __TEST_DATA_H
 
-/* Data structures for tests which span the 2 Picos */
+/*
+ * Data structures for tests which span the 2 Picos, the parameters Pico1
+ * sends with a request and the results Pico2 sends back, see pico_comm.h.
+ * Changing any of them means bumping PICO_COMM_VERSION.
+ */
+
+#include <stdint.h>
+
+#include "logic_capture.h"
 
 typedef enum
 {
@@ -19,4 +27,141 @@ typedef struct
 }
 EDGE_STATUS;
 
+/* Number of rows the Z80's refresh counter sweeps, it's R bits 0-6 */
+#define NUM_REFRESH_ROWS 128
+
+/* Refresh test result, sent from Pico2 to Pico1 */
+typedef struct
+{
+  uint8_t  rows_seen[NUM_REFRESH_ROWS/8];  // Bitmap of refresh rows seen
+  uint32_t refresh_count;                  // Number of refresh cycles seen
+  uint32_t elapsed_us;                     // Time it took to see them
+  uint32_t max_gap_us;                     // Longest any row went unrefreshed
+  uint32_t overrun;                        // Non-zero if the capture couldn't keep up
+}
+REFRESH_RESULT;
+
+/* Logic analyser capture summary, sent from Pico2 to Pico1 */
+typedef struct
+{
+  uint32_t triggered;                      // Non-zero if the trigger fired
+  uint32_t num_samples;                    // Number of samples captured
+  uint32_t trigger_sample;                 // Which sample is the trigger
+  uint32_t trigger_state;                  // The GPIOs at the trigger sample
+}
+CAPTURE_SUMMARY;
+
+/*
+ * How fast Pico2's sampling loop ran, sent from Pico2 to Pico1 after the
+ * result of each test which samples the bus in a loop. A line can change
+ * state every T-state, so a loop which takes fewer samples than that can
+ * miss transitions and its result can't be trusted.
+ */
+typedef struct
+{
+  uint32_t samples;                        // Times round the sampling loop
+  uint32_t t_states;                       // Z80 clock cycles while it ran, 0 if there's no clock
+}
+SAMPLE_RATE;
+
+#define SAMPLE_RATE_TRUSTWORTHY(rate) (((rate).t_states != 0) && ((rate).samples >= (rate).t_states))
+
+/* Address bus test */
+typedef struct
+{
+  uint32_t    line_mask;                   // Address lines to watch, bit 0 is A0. The rest stay SEEN_NEITHER
+}
+ABUS_PARAMS;
+
+typedef struct
+{
+  SEEN_EDGE   line_edge[16];               // What each address line did
+  uint32_t    gpio_state;                  // Pico2's GPIOs at the end, to show what's stuck
+  SAMPLE_RATE rate;
+}
+ABUS_RESULT;
+
+/*
+ * ROM test, Pico2 collects the addresses of memory reads and looks for
+ * sequences in them. Pico1 sends a sequence for each ROM it knows, and
+ * Pico2 says which it found, so it tells which ROM is fitted.
+ */
+#define ROM_MAX_CAPTURE  2048
+#define ROM_MAX_PATTERNS 8
+#define ROM_MAX_SYMBOLS  192
+
+typedef struct
+{
+  uint32_t    capture_length;                   // Memory reads to collect, up to ROM_MAX_CAPTURE
+  uint32_t    num_patterns;                     // Sequences to look for, up to ROM_MAX_PATTERNS
+  uint16_t    pattern_length[ROM_MAX_PATTERNS]; // How many addresses are in each
+  uint16_t    symbols[ROM_MAX_SYMBOLS];         // The sequences one after the other, addresses the Z80 should read
+}
+ROM_PARAMS;
+
+typedef struct
+{
+  uint32_t    found;                       // Bit n set if sequence n was found
+  uint32_t    captured;                    // Memory reads collected
+  SAMPLE_RATE rate;
+}
+ROM_RESULT;
+
+/* Logic analyser capture, the trigger's pins are Pico2's */
+typedef struct
+{
+  LA_TRIGGER  trigger;
+  uint32_t    pre_samples;                 // Before and after the trigger, up to LA_MAX_SAMPLES between them
+  uint32_t    post_samples;
+}
+CAPTURE_PARAMS;
+
+/*
+ * Boot timeline. Pico2 notes when the Z80 first reads from each of the
+ * milestone addresses once Pico1 lets it out of reset, and how often it
+ * read from them. A milestone at 0x0000 is timed from the release, the
+ * rest from the Z80's first read of 0x0000, so C27 isn't in them.
+ */
+#define BOOT_MAX_MILESTONES 8
+#define BOOT_NOT_REACHED    0xFFFFFFFF
+
+typedef struct
+{
+  uint32_t    reset_delay_us;                    // From Pico1 raising the signal to letting the Z80 go
+  uint32_t    num_milestones;                    // Up to BOOT_MAX_MILESTONES
+  uint16_t    address[BOOT_MAX_MILESTONES];      // Where the Z80 reads from when it gets to each one
+}
+BOOT_PARAMS;
+
+typedef struct
+{
+  uint32_t    reached[BOOT_MAX_MILESTONES];      // CLK cycles to the first read, or BOOT_NOT_REACHED, see below
+  uint32_t    times[BOOT_MAX_MILESTONES];        // How many reads there were
+  SAMPLE_RATE rate;
+}
+BOOT_RESULT;
+
+/*
+ * Reset jitter. Pico2 counts the times the Z80 starts again from 0x0000
+ * after Pico1 lets it out of reset, which it does if /RESET bounces on
+ * its way up. The times are CLK cycles from reset.
+ */
+typedef struct
+{
+  uint32_t    reset_delay_us;              // From Pico1 raising the signal to letting the Z80 go
+}
+RESET_PARAMS;
+
+typedef struct
+{
+  uint32_t    starts;                      // Runs from 0x0000, 1 if it started cleanly
+  uint32_t    first_start;                 // When the first began, or BOOT_NOT_REACHED
+  uint32_t    last_start;                  // When the last began, the one which kept going
+  uint32_t    shortest_run;                // Shortest and longest time from one start to the next
+  uint32_t    longest_run;
+  uint32_t    window;                      // How long it watched for
+  SAMPLE_RATE rate;
+}
+RESET_RESULT;
+
 #endif
@@ -0,0 +1,30 @@
+#ifndef __TUSB_CONFIG_H
+#define __TUSB_CONFIG_H
+
+/*
+ * TinyUSB configuration for the USB stream. One CDC interface, device
+ * only, full speed.
+ *
+ * The buffers are much bigger than TinyUSB's defaults. The transmit FIFO
+ * holds several whole frames, and the endpoint buffer lets one USB
+ * transfer carry a whole frame, which the RP2040 driver splits into 64
+ * byte packets itself. With the default 64 byte endpoint buffer there'd
+ * only be one packet per tud_task() call, which caps the rate at 64KB/s.
+ */
+
+#define CFG_TUSB_RHPORT0_MODE      (OPT_MODE_DEVICE | OPT_MODE_FULL_SPEED)
+#define CFG_TUSB_OS                OPT_OS_PICO
+
+#define CFG_TUD_ENDPOINT0_SIZE     64
+
+#define CFG_TUD_CDC                1
+#define CFG_TUD_MSC                0
+#define CFG_TUD_HID                0
+#define CFG_TUD_MIDI               0
+#define CFG_TUD_VENDOR             0
+
+#define CFG_TUD_CDC_RX_BUFSIZE     64
+#define CFG_TUD_CDC_TX_BUFSIZE     4096
+#define CFG_TUD_CDC_EP_BUFSIZE     1088
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * USB descriptors for the USB stream, a single CDC serial interface.
+ * These are TinyUSB's callbacks, it asks for them when the host
+ * enumerates the device. The product and serial strings say which
+ * Pico it is, so the host can tell the 2 apart.
+ */
+
+#include "tusb.h"
+
+#include "usb_stream.h"
+
+/* Raspberry Pi's vendor ID, and the product ID the SDK uses for CDC */
+#define USB_VID 0x2E8A
+#define USB_PID 0x000A
+
+enum
+{
+  ITF_NUM_CDC = 0,
+  ITF_NUM_CDC_DATA,
+  ITF_NUM_TOTAL
+};
+
+#define EPNUM_CDC_NOTIF 0x81
+#define EPNUM_CDC_OUT   0x02
+#define EPNUM_CDC_IN    0x82
+
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN)
+
+static const tusb_desc_device_t device_descriptor =
+{
+  .bLength            = sizeof(tusb_desc_device_t),
+  .bDescriptorType    = TUSB_DESC_DEVICE,
+  .bcdUSB             = 0x0200,
+  .bDeviceClass       = TUSB_CLASS_MISC,
+  .bDeviceSubClass    = MISC_SUBCLASS_COMMON,
+  .bDeviceProtocol    = MISC_PROTOCOL_IAD,
+  .bMaxPacketSize0    = CFG_TUD_ENDPOINT0_SIZE,
+  .idVendor           = USB_VID,
+  .idProduct          = USB_PID,
+  .bcdDevice          = 0x0100,
+  .iManufacturer      = 1,
+  .iProduct           = 2,
+  .iSerialNumber      = 3,
+  .bNumConfigurations = 1
+};
+
+static const uint8_t config_descriptor[] =
+{
+  TUD_CONFIG_DESCRIPTOR( 1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 250 ),
+  TUD_CDC_DESCRIPTOR( ITF_NUM_CDC, 4, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN, 64 ),
+};
+
+const uint8_t *tud_descriptor_device_cb( void )
+{
+  return (const uint8_t*)&device_descriptor;
+}
+
+const uint8_t *tud_descriptor_configuration_cb( uint8_t index )
+{
+  return config_descriptor;
+}
+
+/*
+ * String descriptors are UTF-16, built on demand in this buffer.
+ */
+#define MAX_DESC_CHARS 31
+static uint16_t string_descriptor[MAX_DESC_CHARS+1];
+
+const uint16_t *tud_descriptor_string_cb( uint8_t index, uint16_t langid )
+{
+  bool pico1 = (usb_stream_source() == STREAM_SOURCE_PICO1);
+
+  const char *str;
+  switch( index )
+  {
+  case 0:
+    /* Supported language, English */
+    string_descriptor[0] = (TUSB_DESC_STRING << 8) | 4;
+    string_descriptor[1] = 0x0409;
+    return string_descriptor;
+
+  case 1:  str = "ZX Diagnostics";                                         break;
+  case 2:  str = pico1 ? "ZX Diagnostics Pico1" : "ZX Diagnostics Pico2";  break;
+  case 3:  str = pico1 ? "PICO1" : "PICO2";                                break;
+  case 4:  str = "Capture Stream";                                         break;
+  default:
+    return NULL;
+  }
+
+  uint8_t num_chars;
+  for( num_chars = 0; str[num_chars] && (num_chars < MAX_DESC_CHARS); num_chars++ )
+    string_descriptor[1+num_chars] = str[num_chars];
+
+  /* First word is the length in bytes, including itself, and the type */
+  string_descriptor[0] = (TUSB_DESC_STRING << 8) | (2*num_chars + 2);
+
+  return string_descriptor;
+}
@@ -0,0 +1,288 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Stream binary data to a host over the Pico's USB port.
+ *
+ * The Pico appears as a USB CDC serial device. stdio isn't used, this
+ * drives TinyUSB directly so frames go into its transmit FIFO in one
+ * copy with no formatting, and the FIFO and endpoint buffers are sized
+ * (in tusb_config.h) so a single USB transfer can carry a whole frame.
+ * That's what gets the throughput up towards the full speed USB limit.
+ *
+ * TinyUSB needs its tud_task() calling regularly. A repeating timer does
+ * that in the background, and the sending code calls it as well while
+ * it's waiting for room. TinyUSB isn't safe to call from 2 places at
+ * once, and on Pico1 the tests run on the other core, so all the calls
+ * into it are done inside a critical section.
+ *
+ * On Pico2 the bus sampling loops run on the same core as the timer, and
+ * a millisecond tick of tud_task() plus the USB interrupt is more than
+ * long enough for them to miss things. They pause the stream while they
+ * run, and USB catches up once they've finished.
+ *
+ * Backpressure is the caller's choice: a frame can wait for the host to
+ * make room for it, up to a timeout, or be dropped straight away if
+ * there isn't room. Either way a dropped frame is counted and the
+ * sequence number moves on, so the host can see the gap.
+ *
+ * This code is compiled and linked into both the UI and IO Pico applications.
+ */
+
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/critical_section.h"
+#include "hardware/irq.h"
+#include "tusb.h"
+
+#include "link_common.h"
+#include "usb_stream.h"
+
+/* tud_task() is run this often in the background */
+#define USB_TASK_INTERVAL_US 1000
+
+static critical_section_t usb_lock;
+static repeating_timer_t  usb_task_timer;
+
+static STREAM_SOURCE      stream_source;
+static uint8_t            stream_sequence = 0;
+static uint32_t           capture_id = 0;
+static STREAM_STATS       stats;
+
+/* Frames are built here so they go to TinyUSB in one piece */
+static uint8_t frame_buffer[STREAM_MAX_PAYLOAD + STREAM_FRAME_OVERHEAD];
+
+static bool usb_task_callback( repeating_timer_t *timer )
+{
+  critical_section_enter_blocking( &usb_lock );
+  tud_task();
+  critical_section_exit( &usb_lock );
+
+  return true;
+}
+
+/* Used by the USB descriptors, which differ slightly between the Picos */
+STREAM_SOURCE usb_stream_source( void )
+{
+  return stream_source;
+}
+
+void usb_stream_init( STREAM_SOURCE source )
+{
+  stream_source = source;
+
+  critical_section_init( &usb_lock );
+  tusb_init();
+
+  if( !add_repeating_timer_us( -USB_TASK_INTERVAL_US, usb_task_callback, NULL, &usb_task_timer ) )
+    panic("No alarms available for USB");
+}
+
+/*
+ * Stop servicing USB, the timer and the interrupt both, until it's
+ * resumed. The host just sees the Pico not answering for a while.
+ * Nothing can be sent while it's paused.
+ */
+void usb_stream_pause( void )
+{
+  cancel_repeating_timer( &usb_task_timer );
+  irq_set_enabled( USBCTRL_IRQ, false );
+}
+
+void usb_stream_resume( void )
+{
+  irq_set_enabled( USBCTRL_IRQ, true );
+
+  if( !add_repeating_timer_us( -USB_TASK_INTERVAL_US, usb_task_callback, NULL, &usb_task_timer ) )
+    panic("No alarms available for USB");
+}
+
+bool usb_stream_connected( void )
+{
+  critical_section_enter_blocking( &usb_lock );
+  bool connected = tud_cdc_connected();
+  critical_section_exit( &usb_lock );
+
+  return connected;
+}
+
+/*
+ * Send one frame. If there's no room for it, wait up to timeout_us for
+ * the host to read enough to make some. A timeout of 0 doesn't wait at
+ * all, which is what anything running live, where being late is as bad
+ * as not arriving, wants.
+ *
+ * Returns false if the frame was dropped.
+ */
+bool usb_stream_frame( STREAM_FRAME_TYPE type, const void *payload, uint32_t length, uint32_t timeout_us )
+{
+  if( length > STREAM_MAX_PAYLOAD )
+    panic("USB stream frame of %d bytes is too big", length);
+
+  STREAM_FRAME_HEADER *header = (STREAM_FRAME_HEADER*)frame_buffer;
+  header->sync[0]  = STREAM_SYNC0;
+  header->sync[1]  = STREAM_SYNC1;
+  header->type     = type;
+  header->sequence = stream_sequence++;
+  header->length   = length;
+
+  memcpy( frame_buffer + sizeof(STREAM_FRAME_HEADER), payload, length );
+
+  uint32_t checked_length = sizeof(STREAM_FRAME_HEADER) + length;
+  uint16_t checksum       = fletcher16( frame_buffer, checked_length );
+  frame_buffer[checked_length]   = checksum & 0xFF;
+  frame_buffer[checked_length+1] = checksum >> 8;
+
+  uint32_t frame_length = checked_length + sizeof(uint16_t);
+  uint64_t give_up_time = time_us_64() + timeout_us;
+
+  bool sent = false;
+  while( 1 )
+  {
+    critical_section_enter_blocking( &usb_lock );
+
+    if( !tud_cdc_connected() )
+    {
+      /* No-one listening, don't wait for them */
+      critical_section_exit( &usb_lock );
+      break;
+    }
+
+    if( tud_cdc_write_available() >= frame_length )
+    {
+      tud_cdc_write( frame_buffer, frame_length );
+      tud_cdc_write_flush();
+      critical_section_exit( &usb_lock );
+
+      sent = true;
+      break;
+    }
+
+    /* No room, give TinyUSB a chance to move things along */
+    tud_task();
+    critical_section_exit( &usb_lock );
+
+    if( time_us_64() >= give_up_time )
+      break;
+  }
+
+  if( sent )
+  {
+    stats.frames_sent++;
+    stats.bytes_sent += frame_length;
+  }
+  else
+  {
+    stats.frames_dropped++;
+  }
+
+  return sent;
+}
+
+/*
+ * Send a completed logic analyser capture. The samples are run length
+ * encoded as described in stream_format.h, with the clock taken out.
+ * The capture is stopped at the first frame which can't be sent, the
+ * host will see the missing END frame.
+ *
+ * Returns false if the capture didn't all go.
+ */
+bool usb_stream_capture( const LA_TRIGGER *trigger, const LA_CAPTURE *capture, uint clk_pin )
+{
+  if( !usb_stream_connected() )
+  {
+    stats.frames_dropped++;
+    return false;
+  }
+
+  /*
+   * la_capture's ring starts with a sample on the clock's rising edge,
+   * so the even ring indices are all clock high.
+   */
+  STREAM_CAPTURE_START start;
+  start.capture_id      = ++capture_id;
+  start.source          = stream_source;
+  start.trigger_type    = trigger->type;
+  start.clk_gpio        = clk_pin;
+  start.first_clk_level = (capture->start & 1) ? 0 : 1;
+  start.trigger_value   = trigger->value;
+  start.triggered       = capture->triggered;
+  start.num_samples     = capture->num_samples;
+  start.trigger_sample  = capture->trigger_sample;
+
+  if( !usb_stream_frame( STREAM_FRAME_CAPTURE_START, &start, sizeof(start), USB_STREAM_CAPTURE_TIMEOUT_US ) )
+    return false;
+
+  static uint32_t data_words[STREAM_MAX_PAYLOAD / sizeof(uint32_t)];
+  uint32_t        num_words = 0;
+
+  const uint32_t clk_mask  = ~(1u << clk_pin);
+  uint32_t       sample_index = 0;
+
+  while( sample_index < capture->num_samples )
+  {
+    uint32_t sample = la_capture_sample( capture, sample_index++ ) & clk_mask;
+
+    /* Count how many times it repeats */
+    uint32_t repeats = 0;
+    while( (sample_index < capture->num_samples) &&
+	   ((la_capture_sample( capture, sample_index ) & clk_mask) == sample) )
+    {
+      repeats++;
+      sample_index++;
+    }
+
+    /* Send the frame if there's not room for the sample and its repeat count */
+    if( num_words + 2 > count_of(data_words) )
+    {
+      if( !usb_stream_frame( STREAM_FRAME_CAPTURE_DATA, data_words, num_words*sizeof(uint32_t), USB_STREAM_CAPTURE_TIMEOUT_US ) )
+	return false;
+      num_words = 0;
+    }
+
+    data_words[num_words++] = sample;
+    if( repeats )
+      data_words[num_words++] = STREAM_REPEAT_FLAG | repeats;
+  }
+
+  if( num_words )
+  {
+    if( !usb_stream_frame( STREAM_FRAME_CAPTURE_DATA, data_words, num_words*sizeof(uint32_t), USB_STREAM_CAPTURE_TIMEOUT_US ) )
+      return false;
+  }
+
+  STREAM_CAPTURE_END end;
+  end.capture_id  = capture_id;
+  end.num_samples = capture->num_samples;
+
+  if( !usb_stream_frame( STREAM_FRAME_CAPTURE_END, &end, sizeof(end), USB_STREAM_CAPTURE_TIMEOUT_US ) )
+    return false;
+
+  /* Let the host know how things are going */
+  STREAM_STATS current_stats = stats;
+  usb_stream_frame( STREAM_FRAME_STATS, &current_stats, sizeof(current_stats), 0 );
+
+  return true;
+}
+
+void usb_stream_stats( STREAM_STATS *current_stats )
+{
+  *current_stats = stats;
+}
@@ -0,0 +1,22 @@
+#ifndef __USB_STREAM_H
+#define __USB_STREAM_H
+
+#include "pico/stdlib.h"
+
+#include "stream_format.h"
+#include "logic_capture.h"
+
+/* How long a capture waits for the host to make room before giving up */
+#define USB_STREAM_CAPTURE_TIMEOUT_US 100000
+
+void     usb_stream_init( STREAM_SOURCE source );
+void     usb_stream_pause( void );
+void     usb_stream_resume( void );
+bool     usb_stream_connected( void );
+bool     usb_stream_frame( STREAM_FRAME_TYPE type, const void *payload, uint32_t length, uint32_t timeout_us );
+bool     usb_stream_capture( const LA_TRIGGER *trigger, const LA_CAPTURE *capture, uint clk_pin );
+void     usb_stream_stats( STREAM_STATS *stats );
+
+STREAM_SOURCE usb_stream_source( void );
+
+#endif
@@ -0,0 +1,183 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Host side link soak test.
+ *
+ * Runs the firmware's link code, and the same soak test the Picos run,
+ * with a thread for each Pico and the link between them in memory, see
+ * linksim/link_sim.h. The timings are the host's, not the Picos', but
+ * it shows the protocol's overheads, and how it copes with a link which
+ * flips bits or loses words.
+ *
+ *  linkbench [-s seconds] [-f flip_one_in] [-d drop_one_in] [-r max_bit_rate]
+ *
+ * The link's rate is negotiated first, as the Picos do. -r makes the
+ * link unreliable above the given bit rate, to see it settle below it.
+ *
+ * Exits non-zero if any frame was lost or came back wrong, so it can be
+ * used as a check. With faults on, expect some, what matters then is
+ * that the link keeps resyncing and the frames keep coming.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "link_sim.h"
+#include "link_common.h"
+#include "link_bench.h"
+
+/* The same mix as pico1_linkbench */
+static const uint32_t frame_size[] = { 4, 4, 8, 16, 64, 256 };
+#define NUM_FRAME_SIZES (sizeof(frame_size) / sizeof(frame_size[0]))
+
+#define REPORT_INTERVAL_US 1000000
+
+static PIO              pico1_end;
+static PIO              pico2_end;
+static atomic_bool      running = true;
+
+static LINK_BENCH_STATS pico1_stats;
+static LINK_BENCH_STATS pico2_stats;
+
+/* Gets Pico2's end out of its wait once Pico1's has finished */
+static bool stopping( void )
+{
+  return !atomic_load( &running );
+}
+
+/* Pico2's end, until Pico1's has finished */
+static void *echo_thread( void *unused )
+{
+  (void)unused;
+
+  while( atomic_load( &running ) )
+    link_bench_echo( pico2_end, 0, 1, &pico2_stats );
+
+  return NULL;
+}
+
+static void usage( const char *name )
+{
+  fprintf( stderr, "Usage: %s [-s seconds] [-f flip_one_in] [-d drop_one_in] [-r max_bit_rate]\n", name );
+  fprintf( stderr, "  -f and -d make the link flip a bit in, or lose, one word in that many.\n" );
+  fprintf( stderr, "  -r makes it flip bits often above that many bits a second.\n" );
+  exit( 1 );
+}
+
+int main( int argc, char *argv[] )
+{
+  uint32_t        seconds = 5;
+  LINK_SIM_FAULTS faults  = { 0, 0, 0 };
+
+  int option;
+  while( (option = getopt( argc, argv, "s:f:d:r:" )) != -1 )
+  {
+    switch( option )
+    {
+    case 's':
+      seconds = strtoul( optarg, NULL, 0 );
+      if( seconds == 0 )
+	usage( argv[0] );
+      break;
+    case 'f':
+      faults.flip_one_in = strtoul( optarg, NULL, 0 );
+      break;
+    case 'd':
+      faults.drop_one_in = strtoul( optarg, NULL, 0 );
+      break;
+    case 'r':
+      faults.max_bit_rate = strtoul( optarg, NULL, 0 );
+      break;
+    default:
+      usage( argv[0] );
+    }
+  }
+
+  if( optind != argc )
+    usage( argv[0] );
+
+  link_sim_connect( &pico1_end, &pico2_end, &faults );
+  link_bench_start( stopping );
+
+  link_bench_reset( &pico2_stats );
+
+  pthread_t echo;
+  if( pthread_create( &echo, NULL, echo_thread, NULL ) != 0 )
+  {
+    fprintf( stderr, "Can't start Pico2's thread\n" );
+    return 1;
+  }
+
+  /* Negotiation counts towards the first second's numbers */
+  link_bench_reset( &pico1_stats );
+  printf( "Link negotiated %u bit/s\n", link_bench_negotiate( pico1_end, 1, 0, &pico1_stats ) );
+
+  uint32_t total_transfers = 0, total_timeouts = 0, total_failures = 0, total_resyncs = 0;
+  uint32_t size_index = 0;
+
+  for( uint32_t second = 0; second < seconds; second++ )
+  {
+    if( second )
+      link_bench_reset( &pico1_stats );
+
+    uint32_t start_us = time_us_32();
+    uint32_t elapsed_us;
+    do
+    {
+      link_bench_transfer( pico1_end, 1, 0, frame_size[size_index], &pico1_stats );
+      size_index = (size_index + 1) % NUM_FRAME_SIZES;
+
+      elapsed_us = time_us_32() - start_us;
+    }
+    while( elapsed_us < REPORT_INTERVAL_US );
+
+    LINK_BENCH_REPORT report;
+    link_bench_report( &pico1_stats, elapsed_us, &report );
+
+    printf( "%u B/s  %u frames  p50 %uus p90 %uus p99 %uus max %uus  %u timeouts  %u bad  %u resyncs\n",
+	    report.bytes_per_sec, report.transfers,
+	    report.p50_us, report.p90_us, report.p99_us, report.max_us,
+	    report.timeouts, report.checksum_failures, report.resyncs );
+
+    total_transfers += report.transfers;
+    total_timeouts  += report.timeouts;
+    total_failures  += report.checksum_failures;
+    total_resyncs   += report.resyncs;
+  }
+
+  atomic_store( &running, false );
+  pthread_join( echo, NULL );
+
+  LINK_SIM_FAULT_COUNTS to_pico2, to_pico1;
+  link_sim_fault_counts( pico1_end, &to_pico2 );
+  link_sim_fault_counts( pico2_end, &to_pico1 );
+
+  printf( "Total %u frames, %u timeouts, %u bad, %u resyncs. Pico2 saw %u timeouts, %u bad\n",
+	  total_transfers, total_timeouts, total_failures, total_resyncs,
+	  pico2_stats.timeouts, pico2_stats.checksum_failures );
+  printf( "Link flipped %u bits, lost %u words and garbled %u at the wrong rate\n",
+	  to_pico2.flipped + to_pico1.flipped, to_pico2.dropped + to_pico1.dropped,
+	  to_pico2.garbled + to_pico1.garbled );
+
+  return (total_timeouts || total_failures) ? 2 : 0;
+}
@@ -0,0 +1,15 @@
+#ifndef __LINK_SIM_HARDWARE_STRUCTS_SYSTICK_H
+#define __LINK_SIM_HARDWARE_STRUCTS_SYSTICK_H
+
+/* Host build of the link code, see link_sim.h. instrument.h reads the SysTick counter */
+#include "link_sim.h"
+
+typedef struct
+{
+  volatile uint32_t cvr;
+}
+systick_hw_t;
+
+extern systick_hw_t *const systick_hw;
+
+#endif
@@ -0,0 +1,230 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * In-memory link, see link_sim.h.
+ *
+ * Each direction is a queue of words with one thread putting and the
+ * other getting, so it's lock free. It holds 8, which is the linkout
+ * PIO's TX FIFO and the linkin PIO's RX FIFO, so a sender blocks in the
+ * same places it would on the Pico.
+ *
+ * Each word carries the clock divider it was sent with. It's compared
+ * with the receiver's when it's taken off the wire rather than when it's
+ * put on, as the firmware only changes rate once the words it was
+ * waiting for have arrived. On the Picos the settling time in
+ * link_common.c covers that.
+ */
+
+#include <stdatomic.h>
+#include <time.h>
+#include <sched.h>
+
+#include "link_sim.h"
+#include "link_common.h"
+#include "instrument.h"
+
+#define WIRE_WORDS 8
+
+typedef struct
+{
+  uint32_t         word[WIRE_WORDS];
+  float            div[WIRE_WORDS];     // The sender's clock divider for each word
+  atomic_uint_fast32_t head;            // Next to put, only the sender moves it
+  atomic_uint_fast32_t tail;            // Next to get, only the receiver moves it
+}
+LINK_SIM_WIRE;
+
+struct LINK_SIM_END
+{
+  LINK_SIM_WIRE        *out;
+  LINK_SIM_WIRE        *in;
+  LINK_SIM_FAULTS       faults;
+  LINK_SIM_FAULT_COUNTS counts;
+  uint32_t              random;         // Only this end's sending thread uses it
+  float                 div;            // Both state machines' clock divider
+};
+
+static LINK_SIM_WIRE       wire[2];
+static struct LINK_SIM_END end[2];
+
+static systick_hw_t        systick;
+systick_hw_t *const        systick_hw = &systick;
+
+void link_sim_connect( PIO *first, PIO *second, const LINK_SIM_FAULTS *faults )
+{
+  for( uint32_t index = 0; index < 2; index++ )
+  {
+    atomic_init( &wire[index].head, 0 );
+    atomic_init( &wire[index].tail, 0 );
+
+    end[index].out    = &wire[index];
+    end[index].in     = &wire[1 - index];
+    end[index].faults = *faults;
+    end[index].random = 0x9E3779B9 + index;
+    end[index].div    = (float)LINK_SIM_SYS_HZ / 80000000;
+    end[index].counts.flipped = 0;
+    end[index].counts.dropped = 0;
+    end[index].counts.garbled = 0;
+  }
+
+  *first  = &end[0];
+  *second = &end[1];
+}
+
+void link_sim_fault_counts( PIO pio, LINK_SIM_FAULT_COUNTS *counts )
+{
+  *counts = pio->counts;
+}
+
+uint32_t time_us_32( void )
+{
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+
+  return (uint32_t)((uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+
+void busy_wait_us( uint64_t delay_us )
+{
+  uint32_t start_us = time_us_32();
+  while( (time_us_32() - start_us) < delay_us )
+    sched_yield();
+}
+
+uint32_t clock_get_hz( enum clock_index clk_index )
+{
+  (void)clk_index;
+  return LINK_SIM_SYS_HZ;
+}
+
+/* Nothing waits in the TX FIFO here, it's on the wire as soon as it's put */
+bool pio_sm_is_tx_fifo_empty( PIO pio, uint sm )
+{
+  (void)pio; (void)sm;
+  return true;
+}
+
+/* The link changes both state machines' rate together, so one for the end will do */
+void pio_sm_set_clkdiv( PIO pio, uint sm, float div )
+{
+  (void)sm;
+  pio->div = div;
+}
+
+static uint32_t next_random( PIO pio )
+{
+  pio->random ^= pio->random << 13;
+  pio->random ^= pio->random >> 17;
+  pio->random ^= pio->random << 5;
+
+  return pio->random;
+}
+
+static bool one_in( PIO pio, uint32_t chance )
+{
+  return chance && ((next_random( pio ) % chance) == 0);
+}
+
+/* Which end, the link keeps its state for each */
+uint pio_get_index( PIO pio )
+{
+  return pio - end;
+}
+
+/*
+ * The linkout PIO sends the bottom 10 bits of the word. Anything else
+ * in it is ignored.
+ */
+void pio_sm_put_blocking( PIO pio, uint sm, uint32_t data )
+{
+  (void)sm;
+  LINK_SIM_WIRE *out = pio->out;
+
+  data &= 0x3FF;
+
+  if( one_in( pio, pio->faults.drop_one_in ) )
+  {
+    pio->counts.dropped++;
+    return;
+  }
+
+  uint32_t bit_rate = (uint32_t)(LINK_SIM_SYS_HZ / pio->div) / 8;
+  bool      too_fast = pio->faults.max_bit_rate && (bit_rate > pio->faults.max_bit_rate);
+
+  if( one_in( pio, pio->faults.flip_one_in ) || (too_fast && one_in( pio, 4 )) )
+  {
+    data ^= 1u << (next_random( pio ) % 10);
+    pio->counts.flipped++;
+  }
+
+  uint32_t head = atomic_load_explicit( &out->head, memory_order_relaxed );
+  while( head - atomic_load_explicit( &out->tail, memory_order_acquire ) == WIRE_WORDS )
+    sched_yield();
+
+  out->word[head % WIRE_WORDS] = data;
+  out->div[head % WIRE_WORDS]  = pio->div;
+  atomic_store_explicit( &out->head, head + 1, memory_order_release );
+}
+
+/*
+ * The linkin PIO shifts the 10 bits in from the top of its shift
+ * register, so they arrive in the top 10 bits of the word. The link code
+ * spins on this while it waits, so when there's nothing the other end
+ * gets the CPU, otherwise a host with one core only runs each end once
+ * a timeslice.
+ */
+bool picoputerlinkin_get( PIO pio, uint sm, uint32_t *value )
+{
+  (void)sm;
+  LINK_SIM_WIRE *in = pio->in;
+
+  uint32_t tail = atomic_load_explicit( &in->tail, memory_order_relaxed );
+  if( tail == atomic_load_explicit( &in->head, memory_order_acquire ) )
+  {
+    sched_yield();
+    return false;
+  }
+
+  uint32_t data = in->word[tail % WIRE_WORDS];
+  float    div  = in->div[tail % WIRE_WORDS];
+  atomic_store_explicit( &in->tail, tail + 1, memory_order_release );
+
+  /* Sampled at the wrong rate, the bits land in the wrong places */
+  if( div != pio->div )
+  {
+    data ^= 1 + (time_us_32() % 0x3FF);
+    pio->counts.garbled++;
+  }
+
+  *value = data << 22;
+
+  return true;
+}
+
+/* The link counts things for the self page, there's nothing to show them on here */
+void inst_count( INST_COUNTER counter )
+{
+  (void)counter;
+}
+
+void inst_hist_since( INST_HISTOGRAM hist, uint32_t start_us )
+{
+  (void)hist; (void)start_us;
+}
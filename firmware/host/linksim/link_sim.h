@@ -0,0 +1,66 @@
+#ifndef __LINK_SIM_H
+#define __LINK_SIM_H
+
+/*
+ * Enough of the Pico SDK to build link_common.c and link_bench.c on the
+ * host, with each end of the link a thread and the wire between them a
+ * queue in memory. The headers alongside this one stand in for the
+ * SDK's and just include it.
+ *
+ * Words go onto the wire as the firmware hands them to the linkout PIO,
+ * and come off as the linkin PIO would deliver them, so everything
+ * above that level is the real code. The wire can flip bits and drop
+ * words, to see what the protocol makes of it. Each end has a bit rate,
+ * a word sent at one the other end isn't at arrives garbled, and the
+ * wire can be made unreliable above a given rate, so the link's rate
+ * negotiation has something to find.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+
+/* One end of the link. The firmware passes a PIO around, here it's one of these */
+typedef struct LINK_SIM_END *PIO;
+
+/* How often the wire should go wrong, 0 for never, otherwise one word in this many */
+typedef struct
+{
+  uint32_t flip_one_in;
+  uint32_t drop_one_in;
+  uint32_t max_bit_rate;                // Faster than this flips a bit in one word in 4, 0 for no limit
+}
+LINK_SIM_FAULTS;
+
+typedef struct
+{
+  uint32_t flipped;
+  uint32_t dropped;
+  uint32_t garbled;                     // Arrived at a different rate to the one they were sent at
+}
+LINK_SIM_FAULT_COUNTS;
+
+void     link_sim_connect( PIO *first, PIO *second, const LINK_SIM_FAULTS *faults );
+void     link_sim_fault_counts( PIO end, LINK_SIM_FAULT_COUNTS *counts );
+
+/* What link_common.c uses from the SDK */
+#define __time_critical_func(f) f
+
+#define NUM_PIOS 2
+
+/* The Picos' fastest, so every rate the link has is there to try */
+#define LINK_SIM_SYS_HZ 250000000
+
+enum clock_index { clk_sys };
+
+uint32_t time_us_32( void );
+void     busy_wait_us( uint64_t delay_us );
+uint32_t clock_get_hz( enum clock_index clk_index );
+void     pio_sm_put_blocking( PIO pio, uint sm, uint32_t data );
+bool     pio_sm_is_tx_fifo_empty( PIO pio, uint sm );
+void     pio_sm_set_clkdiv( PIO pio, uint sm, float div );
+uint     pio_get_index( PIO pio );
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef __LINK_SIM_PICO_STDLIB_H
+#define __LINK_SIM_PICO_STDLIB_H
+
+/* Host build of the link code, see link_sim.h */
+#include "link_sim.h"
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef __SCHED_SIM_HARDWARE_SYNC_H
+#define __SCHED_SIM_HARDWARE_SYNC_H
+
+/* Host build of the scheduler, see sched_sim.h */
+#include "sched_sim.h"
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Host build of the Pico1's scheduler, see sched_sim.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "sched_sim.h"
+
+uint64_t sched_sim_now_us = 0;
+
+uint64_t time_us_64( void )
+{
+  return sched_sim_now_us;
+}
+
+absolute_time_t from_us_since_boot( uint64_t us )
+{
+  return us;
+}
+
+/* Nothing's going to make an event, so the timeout's what ends the wait */
+bool best_effort_wfe_or_timeout( absolute_time_t timeout )
+{
+  if( timeout > sched_sim_now_us )
+    sched_sim_now_us = timeout;
+
+  return true;
+}
+
+/* A wait with nothing due would be forever, which means the test's wrong */
+void __wfe( void )
+{
+  panic("__wfe() with nothing to wake it");
+}
+
+void __sev( void )
+{
+}
+
+void panic( const char *fmt, ... )
+{
+  va_list args;
+
+  va_start( args, fmt );
+  fprintf( stderr, "panic: " );
+  vfprintf( stderr, fmt, args );
+  fprintf( stderr, "\n" );
+  va_end( args );
+
+  exit( 2 );
+}
@@ -0,0 +1,31 @@
+#ifndef __SCHED_SIM_H
+#define __SCHED_SIM_H
+
+/*
+ * Enough of the Pico SDK to build the Pico1's scheduler on the host.
+ * Time is a counter the test moves along itself, and sleeping just
+ * moves it to when the sleep would have ended, so nothing here waits.
+ * The headers alongside this one stand in for the SDK's and just
+ * include it.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+typedef uint64_t     absolute_time_t;
+
+#define __time_critical_func(f) f
+
+/* The time the scheduler sees, in microseconds since "boot" */
+extern uint64_t sched_sim_now_us;
+
+uint64_t        time_us_64( void );
+absolute_time_t from_us_since_boot( uint64_t us );
+bool            best_effort_wfe_or_timeout( absolute_time_t timeout );
+void            __wfe( void );
+void            __sev( void );
+void            panic( const char *fmt, ... );
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Host side check of the Pico1's scheduler.
+ *
+ * The scheduler's built as it is for the Pico, over the stand-ins in
+ * schedsim/. The pages which build something up over several runs, like
+ * the baseline, depend on sched_continuing() saying when a test is the
+ * same one as last time, so that's what this mostly looks at.
+ *
+ *  schedtest
+ *
+ * Exits non-zero if anything's not as it should be.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scheduler.h"
+#include "sched_sim.h"
+
+static const SCHED_TEST test_a = { "A", SCHED_RES_NONE, 100 };
+static const SCHED_TEST test_b = { "B", SCHED_RES_NONE, 100 };
+
+static uint32_t failures = 0;
+
+static bool cancel_now = false;
+
+static bool cancel_check( void )
+{
+  return cancel_now;
+}
+
+static void check( bool ok, const char *what )
+{
+  printf( "%-50s %s\n", what, ok ? "ok" : "FAILED" );
+  if( !ok )
+    failures++;
+}
+
+/* One run of a test, as core1_main() does it, with a sleep to stand for the test */
+static bool run_test( const SCHED_TEST *test )
+{
+  sched_begin_test( test );
+
+  bool continuing = sched_continuing();
+
+  sched_sleep_ms( 10 );
+  sched_end_test();
+
+  return continuing;
+}
+
+int main( void )
+{
+  sched_init();
+  sched_set_cancel_check( cancel_check );
+
+  check( !run_test( &test_a ), "First run isn't continuing" );
+  check(  run_test( &test_a ), "Same test again is continuing" );
+  check(  run_test( &test_a ), "And again" );
+  check( !run_test( &test_b ), "Different test isn't continuing" );
+  check( !run_test( &test_a ), "Back to the first isn't either" );
+
+  /* A cancelled run means the user went somewhere else in between */
+  sched_begin_test( &test_a );
+  cancel_now = true;
+  check( !sched_sleep_ms( 10 ), "Sleep says when it's been cancelled" );
+  sched_end_test();
+  cancel_now = false;
+  check( !run_test( &test_a ), "Run after a cancelled one isn't continuing" );
+  check(  run_test( &test_a ), "But the one after that is" );
+
+  /* A test which takes far too long is counted */
+  uint32_t overruns = sched_overrun_count();
+  sched_begin_test( &test_b );
+  sched_sleep_ms( 3 * test_b.duration_ms );
+  sched_end_test();
+  check( sched_overrun_count() == overruns + 1, "Overrunning test is counted" );
+
+  sched_init();
+  check( !run_test( &test_b ), "Nothing's continuing after sched_init()" );
+
+  printf( "%s\n", failures ? "FAILED" : "All OK" );
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+#ifndef __SIGNALS_H
+#define __SIGNALS_H
+
+/*
+ * Names for the GPIOs in a capture. The tables are built from each
+ * Pico's gpios.h, so the names are the ones the firmware uses.
+ */
+
+#include <stdint.h>
+
+typedef struct
+{
+  uint32_t    gpio;
+  const char *name;
+}
+SIGNAL_DEF;
+
+#define SIGNAL(gpio) { gpio, #gpio }
+
+extern const SIGNAL_DEF pico1_signals[];
+extern const uint32_t   num_pico1_signals;
+
+extern const SIGNAL_DEF pico2_signals[];
+extern const uint32_t   num_pico2_signals;
+
+#endif
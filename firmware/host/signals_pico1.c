@@ -0,0 +1,29 @@
+/*
+ * Pico1's signals. This is a file of its own because the 2 Picos'
+ * gpios.h define the same names with different values.
+ */
+
+#include "../pico1/gpios.h"
+#include "signals.h"
+
+const SIGNAL_DEF pico1_signals[] =
+{
+  SIGNAL(GPIO_DBUS_D0),
+  SIGNAL(GPIO_DBUS_D1),
+  SIGNAL(GPIO_DBUS_D2),
+  SIGNAL(GPIO_DBUS_D3),
+  SIGNAL(GPIO_DBUS_D4),
+  SIGNAL(GPIO_DBUS_D5),
+  SIGNAL(GPIO_DBUS_D6),
+  SIGNAL(GPIO_DBUS_D7),
+  SIGNAL(GPIO_Z80_MREQ),
+  SIGNAL(GPIO_Z80_IORQ),
+  SIGNAL(GPIO_Z80_RD),
+  SIGNAL(GPIO_Z80_WR),
+  SIGNAL(GPIO_Z80_M1),
+  SIGNAL(GPIO_Z80_CLK),
+  SIGNAL(GPIO_Z80_INT),
+  SIGNAL(GPIO_Z80_RESET),
+  SIGNAL(GPIO_P1_BLIPPER),
+};
+const uint32_t num_pico1_signals = sizeof(pico1_signals) / sizeof(SIGNAL_DEF);
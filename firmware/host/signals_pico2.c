@@ -0,0 +1,32 @@
+/*
+ * Pico2's signals. This is a file of its own because the 2 Picos'
+ * gpios.h define the same names with different values.
+ */
+
+#include "../pico2/gpios.h"
+#include "signals.h"
+
+const SIGNAL_DEF pico2_signals[] =
+{
+  SIGNAL(GPIO_ABUS_A0),
+  SIGNAL(GPIO_ABUS_A1),
+  SIGNAL(GPIO_ABUS_A2),
+  SIGNAL(GPIO_ABUS_A3),
+  SIGNAL(GPIO_ABUS_A4),
+  SIGNAL(GPIO_ABUS_A5),
+  SIGNAL(GPIO_ABUS_A6),
+  SIGNAL(GPIO_ABUS_A7),
+  SIGNAL(GPIO_ABUS_A8),
+  SIGNAL(GPIO_ABUS_A9),
+  SIGNAL(GPIO_ABUS_A10),
+  SIGNAL(GPIO_ABUS_A11),
+  SIGNAL(GPIO_ABUS_A12),
+  SIGNAL(GPIO_ABUS_A13),
+  SIGNAL(GPIO_ABUS_A14),
+  SIGNAL(GPIO_ABUS_A15),
+  SIGNAL(GPIO_Z80_MREQ),
+  SIGNAL(GPIO_Z80_RD),
+  SIGNAL(GPIO_Z80_CLK),
+  SIGNAL(GPIO_P2_BLIPPER),
+};
+const uint32_t num_pico2_signals = sizeof(pico2_signals) / sizeof(SIGNAL_DEF);
@@ -0,0 +1,280 @@
+/*
+ * sigrok session file writer, for PulseView and sigrok-cli.
+ *
+ * A session file is a zip archive holding a "version" file, a "metadata"
+ * file describing the channels, and the raw logic samples. The samples
+ * are stored uncompressed, 4 bytes per sample with one bit per channel,
+ * in a single "logic-1-1" member.
+ *
+ * The zip is written as it goes. The samples' size and CRC aren't known
+ * until the end, so their header is written with zeroes and patched
+ * afterwards, which means the output has to be a real file and not a
+ * pipe. Nothing but a small write buffer is held in memory.
+ *
+ * Like the VCD writer, there's an extra TRIGGER channel which is high
+ * for the trigger sample.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "writer.h"
+
+#define SR_UNIT_SIZE      4
+#define SR_BUFFER_SIZE    65536
+
+/* The bits of the zip format which are needed, stored members only */
+#define ZIP_LOCAL_SIG     0x04034b50
+#define ZIP_CENTRAL_SIG   0x02014b50
+#define ZIP_END_SIG       0x06054b50
+#define ZIP_VERSION       20
+#define ZIP_LOCAL_SIZE    30
+
+/* 1 Jan 2024, zips need a date and there isn't a meaningful one */
+#define ZIP_DOS_TIME      0x0000
+#define ZIP_DOS_DATE      ((44 << 9) | (1 << 5) | 1)
+
+typedef struct
+{
+  const char *name;
+  uint32_t    offset;
+  uint32_t    crc;
+  uint32_t    size;
+}
+ZIP_MEMBER;
+
+enum { MEMBER_VERSION, MEMBER_METADATA, MEMBER_LOGIC, NUM_MEMBERS };
+
+typedef struct
+{
+  FILE               *file;
+  const CAPTURE_INFO *info;
+  ZIP_MEMBER          member[NUM_MEMBERS];
+  uint32_t            buffered;
+  uint8_t             buffer[SR_BUFFER_SIZE];
+}
+SR_CONTEXT;
+
+static uint32_t crc_table[256];
+
+static void crc_init( void )
+{
+  for( uint32_t index = 0; index < 256; index++ )
+  {
+    uint32_t crc = index;
+    for( int bit = 0; bit < 8; bit++ )
+      crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : (crc >> 1);
+    crc_table[index] = crc;
+  }
+}
+
+/* Running CRC32, start with 0 */
+static uint32_t crc_update( uint32_t crc, const uint8_t *data, uint32_t count )
+{
+  crc = ~crc;
+  while( count-- )
+    crc = crc_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+static void put16( FILE *file, uint16_t value )
+{
+  fputc( value & 0xFF, file );
+  fputc( value >> 8,   file );
+}
+
+static void put32( FILE *file, uint32_t value )
+{
+  put16( file, value & 0xFFFF );
+  put16( file, value >> 16 );
+}
+
+static void write_local_header( FILE *file, const ZIP_MEMBER *member )
+{
+  put32( file, ZIP_LOCAL_SIG );
+  put16( file, ZIP_VERSION );
+  put16( file, 0 );                         // flags
+  put16( file, 0 );                         // stored
+  put16( file, ZIP_DOS_TIME );
+  put16( file, ZIP_DOS_DATE );
+  put32( file, member->crc );
+  put32( file, member->size );              // compressed
+  put32( file, member->size );              // uncompressed
+  put16( file, strlen( member->name ) );
+  put16( file, 0 );                         // extra
+  fputs( member->name, file );
+}
+
+static void write_central_header( FILE *file, const ZIP_MEMBER *member )
+{
+  put32( file, ZIP_CENTRAL_SIG );
+  put16( file, ZIP_VERSION );               // made by
+  put16( file, ZIP_VERSION );               // needed
+  put16( file, 0 );                         // flags
+  put16( file, 0 );                         // stored
+  put16( file, ZIP_DOS_TIME );
+  put16( file, ZIP_DOS_DATE );
+  put32( file, member->crc );
+  put32( file, member->size );
+  put32( file, member->size );
+  put16( file, strlen( member->name ) );
+  put16( file, 0 );                         // extra
+  put16( file, 0 );                         // comment
+  put16( file, 0 );                         // disk
+  put16( file, 0 );                         // internal attributes
+  put32( file, 0 );                         // external attributes
+  put32( file, member->offset );
+  fputs( member->name, file );
+}
+
+/* Write a member whose content is all known up front */
+static void write_member( SR_CONTEXT *sr, ZIP_MEMBER *member, const char *content )
+{
+  member->offset = ftell( sr->file );
+  member->size   = strlen( content );
+  member->crc    = crc_update( 0, (const uint8_t*)content, member->size );
+
+  write_local_header( sr->file, member );
+  fputs( content, sr->file );
+}
+
+static void *sr_open( const char *filename, const CAPTURE_INFO *info )
+{
+  if( info->num_signals + 1 > SR_UNIT_SIZE*8 )
+    return NULL;
+
+  SR_CONTEXT *sr = calloc( 1, sizeof(SR_CONTEXT) );
+  if( sr == NULL )
+    return NULL;
+
+  sr->file = fopen( filename, "wb" );
+  if( sr->file == NULL )
+  {
+    free( sr );
+    return NULL;
+  }
+  sr->info = info;
+
+  crc_init();
+
+  sr->member[MEMBER_VERSION].name  = "version";
+  sr->member[MEMBER_METADATA].name = "metadata";
+  sr->member[MEMBER_LOGIC].name    = "logic-1-1";
+
+  write_member( sr, &sr->member[MEMBER_VERSION], "2" );
+
+  /* Channel names, in bit order. 17 or so of these fit easily */
+  char metadata[4096];
+  int  length = snprintf( metadata, sizeof(metadata),
+			  "[global]\n"
+			  "sigrok version=0.5.2\n"
+			  "\n"
+			  "[device 1]\n"
+			  "capturefile=logic-1\n"
+			  "total probes=%" PRIu32 "\n"
+			  "samplerate=%" PRIu64 "\n"
+			  "total analog=0\n",
+			  info->num_signals + 1, info->sample_rate );
+
+  for( uint32_t index = 0; index < info->num_signals; index++ )
+    length += snprintf( metadata + length, sizeof(metadata) - length,
+			"probe%" PRIu32 "=%s\n", index + 1, info->signals[index].name );
+
+  snprintf( metadata + length, sizeof(metadata) - length,
+	    "probe%" PRIu32 "=TRIGGER\n"
+	    "unitsize=%d\n",
+	    info->num_signals + 1, SR_UNIT_SIZE );
+
+  write_member( sr, &sr->member[MEMBER_METADATA], metadata );
+
+  /* The samples, header to be patched up at the end */
+  sr->member[MEMBER_LOGIC].offset = ftell( sr->file );
+  write_local_header( sr->file, &sr->member[MEMBER_LOGIC] );
+
+  return sr;
+}
+
+static int sr_flush( SR_CONTEXT *sr )
+{
+  ZIP_MEMBER *logic = &sr->member[MEMBER_LOGIC];
+
+  /* Zip without the 64 bit extensions stops at 4GB, that's a billion samples */
+  if( (uint64_t)logic->size + sr->buffered > 0xFFFFFFFF )
+    return 1;
+
+  fwrite( sr->buffer, 1, sr->buffered, sr->file );
+  logic->crc   = crc_update( logic->crc, sr->buffer, sr->buffered );
+  logic->size += sr->buffered;
+
+  sr->buffered = 0;
+  return ferror( sr->file );
+}
+
+static int sr_sample( void *context, uint64_t sample_number, uint32_t sample )
+{
+  SR_CONTEXT         *sr   = context;
+  const CAPTURE_INFO *info = sr->info;
+
+  /* Move the GPIOs into channel order */
+  uint32_t unit = 0;
+  for( uint32_t index = 0; index < info->num_signals; index++ )
+  {
+    if( sample & (1u << info->signals[index].gpio) )
+      unit |= 1u << index;
+  }
+
+  if( info->triggered && (sample_number == info->trigger_sample) )
+    unit |= 1u << info->num_signals;
+
+  for( int byte = 0; byte < SR_UNIT_SIZE; byte++ )
+    sr->buffer[sr->buffered++] = (unit >> (byte*8)) & 0xFF;
+
+  if( sr->buffered == SR_BUFFER_SIZE )
+    return sr_flush( sr );
+
+  return 0;
+}
+
+static int sr_close( void *context )
+{
+  SR_CONTEXT *sr = context;
+
+  int error = sr_flush( sr );
+
+  /* Central directory */
+  uint32_t central_offset = ftell( sr->file );
+  for( int index = 0; index < NUM_MEMBERS; index++ )
+    write_central_header( sr->file, &sr->member[index] );
+  uint32_t central_size = ftell( sr->file ) - central_offset;
+
+  put32( sr->file, ZIP_END_SIG );
+  put16( sr->file, 0 );                     // this disk
+  put16( sr->file, 0 );                     // central directory disk
+  put16( sr->file, NUM_MEMBERS );
+  put16( sr->file, NUM_MEMBERS );
+  put32( sr->file, central_size );
+  put32( sr->file, central_offset );
+  put16( sr->file, 0 );                     // comment
+
+  /* Now the size and CRC of the samples are known */
+  fseek( sr->file, sr->member[MEMBER_LOGIC].offset, SEEK_SET );
+  write_local_header( sr->file, &sr->member[MEMBER_LOGIC] );
+
+  if( ferror( sr->file ) )
+    error = 1;
+  if( fclose( sr->file ) != 0 )
+    error = 1;
+
+  free( sr );
+  return error;
+}
+
+const CAPTURE_WRITER sr_writer =
+{
+  "sr",
+  sr_open,
+  sr_sample,
+  sr_close
+};
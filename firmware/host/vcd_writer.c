@@ -0,0 +1,137 @@
+/*
+ * VCD (value change dump) writer. Only the signals which change are
+ * written at each sample, so the file is as small as VCD allows and
+ * nothing but the previous sample needs keeping.
+ *
+ * Time is in picoseconds so the sample period, which for a 3.5MHz
+ * Spectrum is 142.857ns, comes out close enough.
+ *
+ * There's an extra signal, TRIGGER, which goes high for the trigger
+ * sample so it's easy to find in a viewer.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "writer.h"
+
+typedef struct
+{
+  FILE               *file;
+  const CAPTURE_INFO *info;
+  uint32_t            previous;
+  int                 previous_trigger;
+}
+VCD_CONTEXT;
+
+/*
+ * Time of a sample, in picoseconds. Done in 2 steps because at a few MHz
+ * the sample number times 10^12 overflows 64 bits after a few million
+ * samples, which a long capture soon gets past.
+ */
+static uint64_t sample_time_ps( uint64_t sample_number, uint64_t sample_rate )
+{
+  uint64_t whole_seconds = sample_number / sample_rate;
+  uint64_t remainder     = sample_number % sample_rate;
+
+  uint64_t remainder_us  = remainder * 1000000 / sample_rate;
+  uint64_t leftover      = remainder * 1000000 % sample_rate;
+
+  return whole_seconds * 1000000000000ULL + remainder_us * 1000000 + leftover * 1000000 / sample_rate;
+}
+
+/* VCD identifiers are printable characters, one each is plenty */
+static char vcd_id( uint32_t index )
+{
+  return '!' + index;
+}
+
+static void *vcd_open( const char *filename, const CAPTURE_INFO *info )
+{
+  VCD_CONTEXT *vcd = calloc( 1, sizeof(VCD_CONTEXT) );
+  if( vcd == NULL )
+    return NULL;
+
+  vcd->file = fopen( filename, "w" );
+  if( vcd->file == NULL )
+  {
+    free( vcd );
+    return NULL;
+  }
+  vcd->info = info;
+
+  fprintf( vcd->file, "$comment ZX Diagnostics %s capture %" PRIu32 " $end\n", info->source_name, info->capture_id );
+  if( info->triggered )
+    fprintf( vcd->file, "$comment Trigger at sample %" PRIu32 " $end\n", info->trigger_sample );
+  else
+    fprintf( vcd->file, "$comment Not triggered $end\n" );
+  fprintf( vcd->file, "$timescale 1 ps $end\n" );
+  fprintf( vcd->file, "$scope module zx $end\n" );
+
+  for( uint32_t index = 0; index < info->num_signals; index++ )
+    fprintf( vcd->file, "$var wire 1 %c %s $end\n", vcd_id( index ), info->signals[index].name );
+  fprintf( vcd->file, "$var wire 1 %c TRIGGER $end\n", vcd_id( info->num_signals ) );
+
+  fprintf( vcd->file, "$upscope $end\n" );
+  fprintf( vcd->file, "$enddefinitions $end\n" );
+
+  return vcd;
+}
+
+static int vcd_sample( void *context, uint64_t sample_number, uint32_t sample )
+{
+  VCD_CONTEXT        *vcd  = context;
+  const CAPTURE_INFO *info = vcd->info;
+
+  int trigger = info->triggered && (sample_number == info->trigger_sample);
+
+  uint32_t changed = sample ^ vcd->previous;
+  if( sample_number == 0 )
+    changed = 0xFFFFFFFF;
+
+  /* Check the signals first, so an unchanged sample writes nothing at all */
+  uint32_t signals_changed = 0;
+  for( uint32_t index = 0; index < info->num_signals; index++ )
+    signals_changed |= changed & (1u << info->signals[index].gpio);
+
+  if( !signals_changed && (trigger == vcd->previous_trigger) && (sample_number != 0) )
+    return 0;
+
+  fprintf( vcd->file, "#%" PRIu64 "\n", sample_time_ps( sample_number, info->sample_rate ) );
+
+  for( uint32_t index = 0; index < info->num_signals; index++ )
+  {
+    uint32_t mask = 1u << info->signals[index].gpio;
+    if( changed & mask )
+      fprintf( vcd->file, "%c%c\n", (sample & mask) ? '1' : '0', vcd_id( index ) );
+  }
+
+  if( (trigger != vcd->previous_trigger) || (sample_number == 0) )
+    fprintf( vcd->file, "%c%c\n", trigger ? '1' : '0', vcd_id( info->num_signals ) );
+
+  vcd->previous         = sample;
+  vcd->previous_trigger = trigger;
+
+  return ferror( vcd->file );
+}
+
+static int vcd_close( void *context )
+{
+  VCD_CONTEXT *vcd = context;
+
+  int error = ferror( vcd->file );
+  if( fclose( vcd->file ) != 0 )
+    error = 1;
+
+  free( vcd );
+  return error;
+}
+
+const CAPTURE_WRITER vcd_writer =
+{
+  "vcd",
+  vcd_open,
+  vcd_sample,
+  vcd_close
+};
@@ -0,0 +1,45 @@
+#ifndef __WRITER_H
+#define __WRITER_H
+
+/*
+ * Output file writers. A writer is handed the samples one at a time, as
+ * they're decoded, and mustn't hold on to them, so the memory used
+ * doesn't depend on the size of the capture.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "signals.h"
+
+typedef struct
+{
+  uint32_t          capture_id;
+  const char       *source_name;          // "Pico1" or "Pico2"
+  const SIGNAL_DEF *signals;
+  uint32_t          num_signals;
+  uint64_t          sample_rate;          // Samples per second
+  uint32_t          triggered;
+  uint32_t          trigger_sample;
+}
+CAPTURE_INFO;
+
+typedef struct
+{
+  const char *extension;
+
+  /* Returns a context for the other calls, or NULL if the file can't be opened */
+  void *(*open)( const char *filename, const CAPTURE_INFO *info );
+
+  /* Samples are whole GPIO states, in order, starting at sample 0 */
+  int   (*sample)( void *context, uint64_t sample_number, uint32_t sample );
+
+  /* Returns non-zero if the file couldn't be finished */
+  int   (*close)( void *context );
+}
+CAPTURE_WRITER;
+
+extern const CAPTURE_WRITER vcd_writer;
+extern const CAPTURE_WRITER sr_writer;
+
+#endif
@@ -0,0 +1,424 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Host side converter for the Picos' USB capture stream.
+ *
+ * Reads the binary frames described in stream_format.h, either live from
+ * a Pico's USB serial device or from a file the stream was saved into,
+ * and writes each capture out as a VCD or sigrok session file.
+ *
+ * Everything is done a frame at a time. Samples are decoded and handed
+ * to the output writer as they arrive, so the memory used is the same
+ * whatever the size of the capture.
+ *
+ *  zxcapture [-f vcd|sr] [-o prefix] [-r sample_rate] [-v] [input]
+ *
+ * The input defaults to stdin. Captures go to prefix-<id>.vcd or .sr.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include "stream_format.h"
+#include "signals.h"
+#include "writer.h"
+
+/* Samples are on both clock edges, so twice the 3.5MHz Z80 clock */
+#define DEFAULT_SAMPLE_RATE 7000000
+
+#define MAX_FRAME_SIZE (STREAM_MAX_PAYLOAD + STREAM_FRAME_OVERHEAD)
+
+typedef struct
+{
+  int      fd;
+  uint8_t  buffer[MAX_FRAME_SIZE];
+  uint32_t filled;
+  uint32_t consumed;                       // Length of the frame last returned
+  uint32_t bytes_skipped;                  // Bytes thrown away looking for a frame
+  uint32_t bad_checksums;
+}
+FRAME_READER;
+
+/* The capture being decoded */
+typedef struct
+{
+  int                   open;
+  void                 *context;
+  char                  filename[1024];
+  CAPTURE_INFO          info;
+  uint32_t              clk_mask;
+  uint32_t              first_clk_level;
+  uint32_t              expected_samples;
+  uint64_t              sample_number;
+  uint32_t              previous_sample;
+}
+CAPTURE_STATE;
+
+static const CAPTURE_WRITER *writer      = &vcd_writer;
+static const char           *prefix      = "capture";
+static uint64_t              sample_rate = DEFAULT_SAMPLE_RATE;
+static int                   verbose     = 0;
+
+/* The same 16 bit checksum as the firmware's link_common.c */
+static uint16_t fletcher16( const uint8_t *data, int count )
+{
+  uint32_t c0, c1;
+
+  for (c0 = c1 = 0; count > 0; )
+  {
+    size_t blocklen = count;
+    if (blocklen > 5802) {
+      blocklen = 5802;
+    }
+    count -= blocklen;
+    do {
+      c0 = c0 + *data++;
+      c1 = c1 + c0;
+    } while (--blocklen);
+    c0 = c0 % 255;
+    c1 = c1 % 255;
+  }
+  return (c1 << 8 | c0);
+}
+
+/*
+ * If the input is the Pico's serial device, put it in raw mode so the
+ * binary data comes through untouched.
+ */
+static void set_raw_if_tty( int fd )
+{
+  struct termios tio;
+
+  if( !isatty( fd ) || (tcgetattr( fd, &tio ) != 0) )
+    return;
+
+  cfmakeraw( &tio );
+  tio.c_cc[VMIN]  = 1;
+  tio.c_cc[VTIME] = 0;
+  tcsetattr( fd, TCSANOW, &tio );
+}
+
+/* Read until there are at least count bytes in the buffer. Returns 0 at end of input */
+static int fill_to( FRAME_READER *reader, uint32_t count )
+{
+  while( reader->filled < count )
+  {
+    ssize_t got = read( reader->fd, reader->buffer + reader->filled, sizeof(reader->buffer) - reader->filled );
+    if( got < 0 && errno == EINTR )
+      continue;
+    if( got <= 0 )
+      return 0;
+
+    reader->filled += got;
+  }
+
+  return 1;
+}
+
+static void discard( FRAME_READER *reader, uint32_t count )
+{
+  memmove( reader->buffer, reader->buffer + count, reader->filled - count );
+  reader->filled -= count;
+}
+
+/*
+ * Return the next good frame, or NULL at the end of the input. Anything
+ * which isn't a frame with a good checksum is skipped a byte at a time,
+ * so a frame starting in the middle of rubbish is still found.
+ */
+static const STREAM_FRAME_HEADER *read_frame( FRAME_READER *reader )
+{
+  discard( reader, reader->consumed );
+  reader->consumed = 0;
+
+  while( fill_to( reader, sizeof(STREAM_FRAME_HEADER) ) )
+  {
+    const STREAM_FRAME_HEADER *header = (const STREAM_FRAME_HEADER*)reader->buffer;
+
+    if( (header->sync[0] != STREAM_SYNC0) || (header->sync[1] != STREAM_SYNC1) ||
+	(header->length > STREAM_MAX_PAYLOAD) )
+    {
+      discard( reader, 1 );
+      reader->bytes_skipped++;
+      continue;
+    }
+
+    uint32_t checked_length = sizeof(STREAM_FRAME_HEADER) + header->length;
+    if( !fill_to( reader, checked_length + sizeof(uint16_t) ) )
+      break;
+
+    uint16_t checksum = reader->buffer[checked_length] | (reader->buffer[checked_length+1] << 8);
+    if( fletcher16( reader->buffer, checked_length ) != checksum )
+    {
+      discard( reader, 1 );
+      reader->bytes_skipped++;
+      reader->bad_checksums++;
+      continue;
+    }
+
+    reader->consumed = checked_length + sizeof(uint16_t);
+    return header;
+  }
+
+  return NULL;
+}
+
+static void close_capture( CAPTURE_STATE *capture, const char *reason )
+{
+  if( !capture->open )
+    return;
+
+  int error = writer->close( capture->context );
+
+  if( error )
+    fprintf( stderr, "Capture %" PRIu32 ": error writing %s\n", capture->info.capture_id, capture->filename );
+  else if( reason )
+    fprintf( stderr, "Capture %" PRIu32 ": %s, %s is incomplete (%" PRIu64 " of %" PRIu32 " samples)\n",
+	     capture->info.capture_id, reason, capture->filename, capture->sample_number, capture->expected_samples );
+  else
+    printf( "Capture %" PRIu32 ": %" PRIu64 " samples from %s, %s -> %s\n",
+	    capture->info.capture_id, capture->sample_number, capture->info.source_name,
+	    capture->info.triggered ? "triggered" : "not triggered", capture->filename );
+
+  capture->open = 0;
+}
+
+static void start_capture( CAPTURE_STATE *capture, const STREAM_CAPTURE_START *start )
+{
+  close_capture( capture, "next capture started" );
+
+  memset( capture, 0, sizeof(CAPTURE_STATE) );
+
+  CAPTURE_INFO *info = &capture->info;
+  info->capture_id     = start->capture_id;
+  info->sample_rate    = sample_rate;
+  info->triggered      = start->triggered;
+  info->trigger_sample = start->trigger_sample;
+
+  switch( start->source )
+  {
+  case STREAM_SOURCE_PICO1:
+    info->source_name = "Pico1";
+    info->signals     = pico1_signals;
+    info->num_signals = num_pico1_signals;
+    break;
+  case STREAM_SOURCE_PICO2:
+    info->source_name = "Pico2";
+    info->signals     = pico2_signals;
+    info->num_signals = num_pico2_signals;
+    break;
+  default:
+    fprintf( stderr, "Capture %" PRIu32 ": unknown source %d, skipped\n", start->capture_id, start->source );
+    return;
+  }
+
+  capture->clk_mask         = 1u << start->clk_gpio;
+  capture->first_clk_level  = start->first_clk_level;
+  capture->expected_samples = start->num_samples;
+
+  snprintf( capture->filename, sizeof(capture->filename), "%s-%" PRIu32 ".%s",
+	    prefix, start->capture_id, writer->extension );
+
+  capture->context = writer->open( capture->filename, info );
+  if( capture->context == NULL )
+  {
+    fprintf( stderr, "Capture %" PRIu32 ": can't write %s\n", start->capture_id, capture->filename );
+    return;
+  }
+
+  capture->open = 1;
+}
+
+/* Put the clock back in, it alternates from first_clk_level, then hand the sample on */
+static int emit_sample( CAPTURE_STATE *capture, uint32_t sample )
+{
+  uint32_t clk_level = capture->first_clk_level ^ (capture->sample_number & 1);
+
+  sample &= ~capture->clk_mask;
+  if( clk_level )
+    sample |= capture->clk_mask;
+
+  return writer->sample( capture->context, capture->sample_number++, sample );
+}
+
+static void capture_data( CAPTURE_STATE *capture, const uint8_t *payload, uint32_t length )
+{
+  for( uint32_t offset = 0; capture->open && (offset + sizeof(uint32_t) <= length); offset += sizeof(uint32_t) )
+  {
+    uint32_t word;
+    memcpy( &word, payload + offset, sizeof(word) );
+
+    int error = 0;
+    if( word & STREAM_REPEAT_FLAG )
+    {
+      for( uint32_t repeat = word & ~STREAM_REPEAT_FLAG; repeat && !error; repeat-- )
+	error = emit_sample( capture, capture->previous_sample );
+    }
+    else
+    {
+      capture->previous_sample = word;
+      error = emit_sample( capture, word );
+    }
+
+    if( error )
+      close_capture( capture, "write failed" );
+  }
+}
+
+static void capture_end( CAPTURE_STATE *capture, const STREAM_CAPTURE_END *end )
+{
+  if( !capture->open || (end->capture_id != capture->info.capture_id) )
+    return;
+
+  if( capture->sample_number != end->num_samples )
+    close_capture( capture, "sample count wrong" );
+  else
+    close_capture( capture, NULL );
+}
+
+static void usage( const char *name )
+{
+  fprintf( stderr, "Usage: %s [-f vcd|sr] [-o prefix] [-r sample_rate] [-v] [input]\n", name );
+  fprintf( stderr, "  input is the Pico's USB serial device, or a saved stream. Default stdin.\n" );
+  exit( 1 );
+}
+
+int main( int argc, char *argv[] )
+{
+  int option;
+  while( (option = getopt( argc, argv, "f:o:r:v" )) != -1 )
+  {
+    switch( option )
+    {
+    case 'f':
+      if( strcmp( optarg, "vcd" ) == 0 )
+	writer = &vcd_writer;
+      else if( strcmp( optarg, "sr" ) == 0 )
+	writer = &sr_writer;
+      else
+	usage( argv[0] );
+      break;
+    case 'o':
+      prefix = optarg;
+      break;
+    case 'r':
+      sample_rate = strtoull( optarg, NULL, 0 );
+      if( sample_rate == 0 )
+	usage( argv[0] );
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    default:
+      usage( argv[0] );
+    }
+  }
+
+  if( optind < argc - 1 )
+    usage( argv[0] );
+
+  static FRAME_READER reader;
+  reader.fd = STDIN_FILENO;
+  if( optind == argc - 1 )
+  {
+    reader.fd = open( argv[optind], O_RDONLY | O_NOCTTY );
+    if( reader.fd < 0 )
+    {
+      perror( argv[optind] );
+      return 1;
+    }
+  }
+  set_raw_if_tty( reader.fd );
+
+  static CAPTURE_STATE capture;
+  uint8_t expected_sequence = 0;
+  int     first_frame       = 1;
+
+  const STREAM_FRAME_HEADER *header;
+  while( (header = read_frame( &reader )) != NULL )
+  {
+    const uint8_t *payload = (const uint8_t*)(header + 1);
+
+    /* A gap in the sequence means frames were lost, a capture in progress is ruined */
+    if( !first_frame && (header->sequence != expected_sequence) )
+    {
+      if( verbose )
+	fprintf( stderr, "Sequence gap, expected %d got %d\n", expected_sequence, header->sequence );
+      close_capture( &capture, "frames lost" );
+    }
+    expected_sequence = header->sequence + 1;
+    first_frame       = 0;
+
+    switch( header->type )
+    {
+    case STREAM_FRAME_CAPTURE_START:
+      if( header->length >= sizeof(STREAM_CAPTURE_START) )
+      {
+	STREAM_CAPTURE_START start;
+	memcpy( &start, payload, sizeof(start) );
+	start_capture( &capture, &start );
+      }
+      break;
+
+    case STREAM_FRAME_CAPTURE_DATA:
+      capture_data( &capture, payload, header->length );
+      break;
+
+    case STREAM_FRAME_CAPTURE_END:
+      if( header->length >= sizeof(STREAM_CAPTURE_END) )
+      {
+	STREAM_CAPTURE_END end;
+	memcpy( &end, payload, sizeof(end) );
+	capture_end( &capture, &end );
+      }
+      break;
+
+    case STREAM_FRAME_STATS:
+      if( header->length >= sizeof(STREAM_STATS) )
+      {
+	STREAM_STATS stats;
+	memcpy( &stats, payload, sizeof(stats) );
+	if( verbose || stats.frames_dropped )
+	  fprintf( stderr, "Pico stats: %" PRIu32 " frames sent, %" PRIu32 " dropped, %" PRIu32 " bytes\n",
+		   stats.frames_sent, stats.frames_dropped, stats.bytes_sent );
+      }
+      break;
+
+    default:
+      if( verbose )
+	fprintf( stderr, "Unknown frame type 0x%02X skipped\n", header->type );
+      break;
+    }
+  }
+
+  close_capture( &capture, "end of input" );
+
+  if( verbose || reader.bad_checksums )
+    fprintf( stderr, "%" PRIu32 " bytes skipped, %" PRIu32 " bad checksums\n",
+	     reader.bytes_skipped, reader.bad_checksums );
+
+  return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Machine baseline.
+ *
+ * A known good Spectrum is measured and the numbers saved in flash.
+ * After that, whatever the tests measure is compared with them as it
+ * comes in, so a machine which is drifting, or one which isn't quite the
+ * same as the good one, shows up without me having to remember what
+ * the numbers should be.
+ *
+ * Each metric has its own tolerance, an absolute amount or a percentage
+ * of the baseline value, whichever is bigger. The percentages are for
+ * the things which scale, like the clocks and bus cycle counts, the
+ * absolute ones are for the rails, where a few tens of millivolts is
+ * the same problem whatever the rail.
+ *
+ * The current measurements and the comparison belong to core1, where the
+ * tests run. Saving is the same arrangement as the result log: core1
+ * sends the vector to core0, which writes it to flash while core1 is
+ * parked.
+ */
+
+#include "pico/stdlib.h"
+#include <string.h>
+#include <stddef.h>
+
+#include "ipc.h"
+#include "flash_store.h"
+#include "link_common.h"
+#include "baseline.h"
+
+typedef struct
+{
+  const char *name;
+  int32_t     absolute;                 // In the metric's own units
+  int32_t     percent;                  // Of the baseline value
+}
+BASELINE_TOLERANCE;
+
+static const BASELINE_TOLERANCE tolerance[NUM_BASELINE_METRICS] =
+{
+  [BASELINE_INT_CENTIHZ]      = { "INT",  0,   1 },
+  [BASELINE_CLK_HZ]           = { "CLK",  0,   1 },
+  [BASELINE_C_CLK_HZ]         = { "cCLK", 0,   3 },  // Contention depends on what the ROM's doing
+  [BASELINE_PLUS5_MV]         = { "+5V",  150, 0 },
+  [BASELINE_PLUS12_MV]        = { "+12V", 600, 0 },  // It's never very steady
+  [BASELINE_MINUS5_MV]        = { "-5V",  400, 0 },
+  [BASELINE_PLUS5_RIPPLE_MV]  = { "+5r",  100, 0 },
+  [BASELINE_PLUS12_RIPPLE_MV] = { "+12r", 400, 0 },
+  [BASELINE_MINUS5_RIPPLE_MV] = { "-5r",  300, 0 },
+  [BASELINE_FETCHES]          = { "M1",   2,   5 },  // The small counts need a little slack
+  [BASELINE_REFRESHES]        = { "RF",   2,   5 },
+  [BASELINE_MEM_READS]        = { "MR",   2,   5 },
+  [BASELINE_MEM_WRITES]       = { "MW",   2,   5 },
+  [BASELINE_IO_READS]         = { "IR",   2,   5 },
+  [BASELINE_IO_WRITES]        = { "IW",   2,   5 },
+  [BASELINE_INT_ACKS]         = { "IA",   1,   0 },
+  [BASELINE_ROM_OK]           = { "ROM",  0,   0 },
+};
+
+/* The saved baseline. Core0 loads it before core1 starts, after that it's core1's */
+static BASELINE_VECTOR stored;
+static bool            stored_valid = false;
+
+/* Core1's, what's been measured this time and which of it is out */
+static BASELINE_VECTOR current;
+static uint32_t        out_mask = 0;
+
+/* Core0's, a new baseline from core1 waiting to be written */
+static BASELINE_VECTOR pending;
+static bool            pending_valid = false;
+
+static uint16_t vector_checksum( const BASELINE_VECTOR *vector )
+{
+  return fletcher16( (uint8_t*)vector, offsetof( BASELINE_VECTOR, checksum ) );
+}
+
+/* Core0, at boot, before core1 starts */
+void baseline_init( void )
+{
+  const BASELINE_VECTOR *saved = (const BASELINE_VECTOR*)flash_store_read( FLASH_STORE_BASELINE_OFFSET );
+
+  if( (saved->magic == BASELINE_MAGIC) && (saved->checksum == vector_checksum( saved )) )
+  {
+    memcpy( &stored, saved, sizeof(stored) );
+    stored_valid = true;
+  }
+}
+
+/* Core0, from core1's message */
+void baseline_queue_save( const BASELINE_VECTOR *vector )
+{
+  memcpy( &pending, vector, sizeof(pending) );
+  pending_valid = true;
+}
+
+bool baseline_due( void )
+{
+  return pending_valid;
+}
+
+/* Core0, with core1 parked */
+void baseline_write( void )
+{
+  static uint8_t page_image[FLASH_PAGE_SIZE];
+
+  if( !pending_valid )
+    return;
+
+  memset( page_image, 0xFF, sizeof(page_image) );
+  memcpy( page_image, &pending, sizeof(pending) );
+
+  flash_store_erase( FLASH_STORE_BASELINE_OFFSET );
+  flash_store_program( FLASH_STORE_BASELINE_OFFSET, page_image );
+
+  pending_valid = false;
+}
+
+static bool out_of_tolerance( BASELINE_METRIC metric, int32_t value )
+{
+  int32_t base    = stored.value[metric];
+  int32_t allowed = tolerance[metric].absolute;
+
+  int32_t scaled  = (int32_t)(((int64_t)(base < 0 ? -base : base) * tolerance[metric].percent) / 100);
+  if( scaled > allowed )
+    allowed = scaled;
+
+  int32_t difference = value - base;
+  return (difference > allowed) || (difference < -allowed);
+}
+
+/*
+ * Core1, from the tests, whenever they have a new value. It's checked
+ * against the baseline there and then, so the verdict's always up to
+ * date with whatever's been measured.
+ */
+void baseline_report( BASELINE_METRIC metric, int32_t value )
+{
+  if( metric >= NUM_BASELINE_METRICS )
+    panic("Bad baseline metric %d", metric);
+
+  uint32_t bit = 1u << metric;
+
+  current.value[metric] = value;
+  current.have |= bit;
+
+  if( stored_valid && (stored.have & bit) && out_of_tolerance( metric, value ) )
+    out_mask |= bit;
+  else
+    out_mask &= ~bit;
+}
+
+/* Core1, start measuring afresh */
+void baseline_clear_current( void )
+{
+  memset( &current, 0, sizeof(current) );
+  out_mask = 0;
+}
+
+/*
+ * Core1. Once everything's been measured, make it the baseline. Returns
+ * false if there's something missing, or the message to core0 couldn't
+ * be sent, in which case it can be tried again.
+ */
+bool baseline_save( void )
+{
+  if( current.have != BASELINE_ALL_MASK )
+    return false;
+
+  BASELINE_VECTOR vector;
+  memcpy( &vector, &current, sizeof(vector) );
+  vector.magic    = BASELINE_MAGIC;
+  vector.checksum = vector_checksum( &vector );
+
+  if( !ipc_send( IPC_MSG_BASELINE, 0, &vector, sizeof(vector) ) )
+    return false;
+
+  memcpy( &stored, &vector, sizeof(stored) );
+  stored_valid = true;
+  out_mask     = 0;
+
+  return true;
+}
+
+const BASELINE_VECTOR *baseline_stored( void )
+{
+  return stored_valid ? &stored : NULL;
+}
+
+const BASELINE_VECTOR *baseline_current( void )
+{
+  return &current;
+}
+
+uint32_t baseline_out_mask( void )
+{
+  return out_mask;
+}
+
+const char *baseline_name( BASELINE_METRIC metric )
+{
+  return (metric < NUM_BASELINE_METRICS) ? tolerance[metric].name : "?";
+}
@@ -0,0 +1,62 @@
+#ifndef __BASELINE_H
+#define __BASELINE_H
+
+#include "pico/stdlib.h"
+
+/*
+ * A healthy machine's fingerprint. The tests report these as they
+ * measure them, and each is compared with the saved baseline straight
+ * away, so a verdict builds up as the tests run rather than at the end.
+ */
+typedef enum
+{
+  BASELINE_INT_CENTIHZ,                 // INT frequency, hundredths of a Hz
+  BASELINE_CLK_HZ,                      // CLK with the Z80 held in reset
+  BASELINE_C_CLK_HZ,                    // CLK with the Z80 running
+  BASELINE_PLUS5_MV,                    // Rail averages
+  BASELINE_PLUS12_MV,
+  BASELINE_MINUS5_MV,
+  BASELINE_PLUS5_RIPPLE_MV,             // Rail ripple, highest less lowest of the recent readings
+  BASELINE_PLUS12_RIPPLE_MV,
+  BASELINE_MINUS5_RIPPLE_MV,
+  BASELINE_FETCHES,                     // Bus cycles per frame, by type
+  BASELINE_REFRESHES,
+  BASELINE_MEM_READS,
+  BASELINE_MEM_WRITES,
+  BASELINE_IO_READS,
+  BASELINE_IO_WRITES,
+  BASELINE_INT_ACKS,
+  BASELINE_ROM_OK,                      // 1 if the ROM's start up sequence was read correctly
+
+  NUM_BASELINE_METRICS
+}
+BASELINE_METRIC;
+
+typedef struct
+{
+  uint32_t magic;                       // BASELINE_MAGIC when it's been saved
+  uint32_t have;                        // Bit per metric which has been measured
+  int32_t  value[NUM_BASELINE_METRICS];
+  uint16_t checksum;                    // Fletcher16 of everything before it
+}
+BASELINE_VECTOR;
+
+#define BASELINE_MAGIC    0x4C425A58    // "ZXBL"
+#define BASELINE_ALL_MASK ((1u << NUM_BASELINE_METRICS) - 1)
+
+/* Core0 */
+void                   baseline_init( void );
+void                   baseline_queue_save( const BASELINE_VECTOR *vector );
+bool                   baseline_due( void );
+void                   baseline_write( void );
+
+/* Core1 */
+void                   baseline_report( BASELINE_METRIC metric, int32_t value );
+void                   baseline_clear_current( void );
+bool                   baseline_save( void );
+const BASELINE_VECTOR *baseline_stored( void );
+const BASELINE_VECTOR *baseline_current( void );
+uint32_t               baseline_out_mask( void );
+const char            *baseline_name( BASELINE_METRIC metric );
+
+#endif
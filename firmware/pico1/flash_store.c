@@ -0,0 +1,76 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Flash storage, for things which need to be kept across power cycles.
+ *
+ * The flash is read through the XIP window like any other memory. Writing
+ * is the awkward bit: nothing can run from flash while a sector's being
+ * erased or a page programmed, which takes up to a few tens of
+ * milliseconds. The SDK's erase and program functions run from RAM, and
+ * this core's interrupts are off while they do, but the other core has
+ * to be kept out of the way too. That's the caller's job.
+ */
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+#include "flash_store.h"
+
+/* From the linker script, where the program ends */
+extern char __flash_binary_end;
+
+void flash_store_init( void )
+{
+  uint32_t binary_end = (uint32_t)&__flash_binary_end - XIP_BASE;
+
+  if( binary_end > FLASH_STORE_LOWEST )
+    panic("Program has grown into the flash store");
+}
+
+void flash_store_erase( uint32_t offset )
+{
+  if( (offset < FLASH_STORE_LOWEST) || (offset % FLASH_SECTOR_SIZE) )
+    panic("Bad flash store erase at 0x%08lX", offset);
+
+  uint32_t interrupts = save_and_disable_interrupts();
+  flash_range_erase( offset, FLASH_SECTOR_SIZE );
+  restore_interrupts( interrupts );
+}
+
+/*
+ * Program one page. Bits only go from 1 to 0, so a page which was only
+ * partly used can be programmed again with more in it, as long as what
+ * was there before is written back unchanged.
+ */
+void flash_store_program( uint32_t offset, const uint8_t *page )
+{
+  if( (offset < FLASH_STORE_LOWEST) || (offset % FLASH_PAGE_SIZE) )
+    panic("Bad flash store program at 0x%08lX", offset);
+
+  uint32_t interrupts = save_and_disable_interrupts();
+  flash_range_program( offset, page, FLASH_PAGE_SIZE );
+  restore_interrupts( interrupts );
+}
+
+const uint8_t *flash_store_read( uint32_t offset )
+{
+  return (const uint8_t*)(XIP_BASE + offset);
+}
@@ -0,0 +1,27 @@
+#ifndef __FLASH_STORE_H
+#define __FLASH_STORE_H
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+
+/*
+ * The top of the flash is kept for things which have to survive the
+ * Spectrum, and so the Picos, being switched off. The program's nowhere
+ * near big enough to reach up there, flash_store_init() checks.
+ *
+ * Only core0 writes, and only while core1 is parked, see ipc.h.
+ */
+#define FLASH_STORE_LOG_SECTORS 16
+#define FLASH_STORE_LOG_OFFSET  (PICO_FLASH_SIZE_BYTES - FLASH_STORE_LOG_SECTORS*FLASH_SECTOR_SIZE)
+
+/* The saved baseline, see baseline.h, gets the sector below the log */
+#define FLASH_STORE_BASELINE_OFFSET (FLASH_STORE_LOG_OFFSET - FLASH_SECTOR_SIZE)
+
+#define FLASH_STORE_LOWEST      FLASH_STORE_BASELINE_OFFSET
+
+void           flash_store_init( void );
+void           flash_store_erase( uint32_t offset );
+void           flash_store_program( uint32_t offset, const uint8_t *page );
+const uint8_t *flash_store_read( uint32_t offset );
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * GPIO interrupt dispatch, a handler per pin.
+ *
+ * The SDK's GPIO callback gives one function for every pin, which then
+ * has to work out who wants the event. That used to be the main loop,
+ * passing everything to whichever page was showing, which then did its
+ * own switch on the GPIO number. All that ran from flash, with the
+ * SDK's own loop over every pin in front of it, and on the Z80 bus lines
+ * those interrupts come thick and fast.
+ *
+ * So I take the IO_IRQ_BANK0 interrupt over completely. The handler here
+ * lives in RAM, reads the interrupt status registers directly, and calls
+ * straight into whatever's registered for each pin which fired. Pins are
+ * registered individually, so the button and any number of tests can
+ * have interrupts on different pins at the same time.
+ *
+ * Everything here works on the interrupt registers of the core which
+ * called gpio_irq_init(), which is the test core. Registering from the
+ * other core won't work.
+ */
+
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/structs/iobank0.h"
+
+#include "gpio_irq.h"
+#include "instrument.h"
+
+#define NUM_IRQ_GPIOS     30
+#define GPIOS_PER_IRQ_REG 8
+#define EVENTS_MASK       0xFu
+#define ALL_EVENTS        (GPIO_IRQ_LEVEL_LOW|GPIO_IRQ_LEVEL_HIGH|GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE)
+
+typedef struct
+{
+  GPIO_IRQ_HANDLER  handler;
+  void             *context;
+}
+GPIO_IRQ_SLOT;
+
+static volatile GPIO_IRQ_SLOT irq_slot[NUM_IRQ_GPIOS];
+
+/* The interrupt enable and status registers for the core which handles the interrupts */
+static io_irq_ctrl_hw_t *irq_ctrl = NULL;
+
+/*
+ * Stop a pin interrupting. This is quicker than gpio_set_irq_enabled()
+ * and doesn't go to flash, so handlers can call it once they've seen
+ * what they wanted to see.
+ */
+void __time_critical_func(gpio_irq_mute)( uint32_t gpio )
+{
+  hw_clear_bits( &irq_ctrl->inte[gpio / GPIOS_PER_IRQ_REG],
+		 EVENTS_MASK << (4 * (gpio % GPIOS_PER_IRQ_REG)) );
+}
+
+/*
+ * The raw IO_IRQ_BANK0 handler. Each status register has 4 bits for
+ * each of 8 GPIOs. Edge events are latched and need acknowledging, which
+ * is done before the handlers are called so an edge arriving while a
+ * handler's running isn't lost. Level events can't be acknowledged,
+ * writing those bits does nothing.
+ */
+static void __time_critical_func(gpio_irq_dispatch)( void )
+{
+  for( uint32_t reg = 0; reg < count_of(irq_ctrl->ints); reg++ )
+  {
+    uint32_t status = irq_ctrl->ints[reg];
+    if( status == 0 )
+      continue;
+
+    iobank0_hw->intr[reg] = status;
+
+    while( status )
+    {
+      uint32_t shift  = __builtin_ctz( status ) & ~3u;
+      uint32_t gpio   = reg * GPIOS_PER_IRQ_REG + shift / 4;
+      uint32_t events = (status >> shift) & EVENTS_MASK;
+
+      status &= ~(EVENTS_MASK << shift);
+
+      GPIO_IRQ_HANDLER handler = irq_slot[gpio].handler;
+      if( handler != NULL )
+      {
+	uint32_t start_us = inst_now();
+
+	handler( gpio, events, irq_slot[gpio].context );
+
+	inst_hist_since( INST_HIST_GPIO_IRQ, start_us );
+	inst_count( INST_GPIO_IRQ );
+
+	/* The pin went both ways before this got to it, so an edge or more went by unseen */
+	if( (events & (GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE)) == (GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE) )
+	  inst_count( INST_GPIO_IRQ_MERGED );
+      }
+      else
+	gpio_irq_mute( gpio );   /* Nobody wants it, don't let it fire again */
+    }
+  }
+}
+
+/*
+ * Take over the GPIO interrupt on the calling core. Nothing else can
+ * use gpio_set_irq_enabled_with_callback() after this.
+ */
+void gpio_irq_init( void )
+{
+  for( uint32_t gpio = 0; gpio < NUM_IRQ_GPIOS; gpio++ )
+  {
+    irq_slot[gpio].handler = NULL;
+    irq_slot[gpio].context = NULL;
+  }
+
+  irq_ctrl = (get_core_num() == 0) ? &iobank0_hw->proc0_irq_ctrl : &iobank0_hw->proc1_irq_ctrl;
+
+  irq_set_exclusive_handler( IO_IRQ_BANK0, gpio_irq_dispatch );
+  irq_set_enabled( IO_IRQ_BANK0, true );
+}
+
+/*
+ * Call handler when the GPIO sees any of the events. The handler goes in
+ * before the interrupt's enabled so it can't fire without one. A pin
+ * can only have one handler, two tests wanting the same pin at the same
+ * time is a bug.
+ */
+void gpio_irq_register( uint32_t gpio, uint32_t events, GPIO_IRQ_HANDLER handler, void *context )
+{
+  if( irq_ctrl == NULL )
+    panic("GPIO IRQ handler registered before gpio_irq_init()");
+
+  if( gpio >= NUM_IRQ_GPIOS )
+    panic("GPIO IRQ handler registered for invalid GPIO %lu", gpio);
+
+  if( irq_slot[gpio].handler != NULL )
+    panic("GPIO %lu already has an IRQ handler", gpio);
+
+  irq_slot[gpio].context = context;
+  irq_slot[gpio].handler = handler;
+
+  gpio_set_irq_enabled( gpio, events, true );
+}
+
+/* Stop the GPIO interrupting and forget its handler */
+void gpio_irq_unregister( uint32_t gpio )
+{
+  if( gpio >= NUM_IRQ_GPIOS )
+    panic("GPIO IRQ handler unregistered for invalid GPIO %lu", gpio);
+
+  gpio_set_irq_enabled( gpio, ALL_EVENTS, false );
+
+  irq_slot[gpio].handler = NULL;
+  irq_slot[gpio].context = NULL;
+}
@@ -0,0 +1,20 @@
+#ifndef __GPIO_IRQ_H
+#define __GPIO_IRQ_H
+
+#include "pico/stdlib.h"
+
+/*
+ * Called from the GPIO interrupt when the pin it's registered for
+ * fires. events is the GPIO_IRQ_* bits which caused it, context is
+ * whatever was handed in when it was registered. It runs in interrupt
+ * context so it must be quick, and it should be __time_critical_func
+ * so it doesn't have to wait for flash.
+ */
+typedef void (*GPIO_IRQ_HANDLER)( uint32_t gpio, uint32_t events, void *context );
+
+void gpio_irq_init( void );
+void gpio_irq_register( uint32_t gpio, uint32_t events, GPIO_IRQ_HANDLER handler, void *context );
+void gpio_irq_unregister( uint32_t gpio );
+void gpio_irq_mute( uint32_t gpio );
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Inter-core messages.
+ *
+ * The RP2040 has a FIFO in each direction between the cores, 8 words
+ * deep. A message is a single word in the FIFO: type, argument and
+ * payload length. That's enough for most things. Anything bigger goes
+ * in a ring buffer, one for each direction, which the sender fills
+ * before it pushes the word. The receiver pops the word then takes
+ * that many bytes off its end of the ring.
+ *
+ * Each ring has one writer and one reader, so it doesn't need a lock.
+ * The sender keeps its write position to itself, it's only the read
+ * position which is shared. Nothing's published until the word's in the
+ * FIFO, so if the FIFO's full the sender just doesn't move its write
+ * position and the bytes it wrote get overwritten next time.
+ *
+ * Each ring's write position belongs to the sending core's thread code.
+ * An interrupt handler can send messages too, as long as they don't
+ * have a payload, because that only touches the FIFO.
+ *
+ * The SDK's multicore_launch_core1() uses the FIFOs for its handshake,
+ * so nothing can be sent until core1's running.
+ *
+ * Core0 can ask core1 to park, so it can write to the flash, which
+ * nothing can run from while it's being written. The SDK's lockout does
+ * that with the FIFO, which is this code's, and it stops core1 wherever
+ * it is. This waits for core1 to finish its test. The request is a
+ * flag rather than a message, because a message cancels the test.
+ */
+
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/sync.h"
+
+#include "ipc.h"
+
+/* Size of each ring, a power of 2 */
+#define IPC_RING_SIZE 1024
+#define IPC_RING_MASK (IPC_RING_SIZE-1)
+
+/* FIFO word is type in the top byte, argument in the next, length in the bottom 16 bits */
+#define IPC_WORD(type,arg,length) (((uint32_t)(type) << 24) | (((arg) & 0xFF) << 16) | ((length) & 0xFFFF))
+#define IPC_WORD_TYPE(word)       ((word) >> 24)
+#define IPC_WORD_ARG(word)        (((word) >> 16) & 0xFF)
+#define IPC_WORD_LENGTH(word)     ((word) & 0xFFFF)
+
+/* How long a sender waits for room in the FIFO */
+#define IPC_SEND_TIMEOUT_US 1000
+
+typedef struct
+{
+  uint8_t           data[IPC_RING_SIZE];
+  uint32_t          head;               // Only the sender uses this
+  volatile uint32_t tail;               // The receiver moves this on, the sender reads it
+}
+IPC_RING;
+
+/* Indexed by the sending core */
+static IPC_RING ring[2];
+
+/* Core0 wants core1 parked, and core1 is */
+static volatile bool park_requested = false;
+static volatile bool parked         = false;
+
+void ipc_init( void )
+{
+  for( uint32_t core = 0; core < 2; core++ )
+  {
+    ring[core].head = 0;
+    ring[core].tail = 0;
+  }
+}
+
+/*
+ * Send a message to the other core. Returns false if there's no room for
+ * it, in the ring or in the FIFO, in which case it's not been sent.
+ */
+bool ipc_send( IPC_TYPE type, uint32_t arg, const void *payload, uint32_t length )
+{
+  IPC_RING *tx = &ring[get_core_num()];
+
+  if( length > IPC_MAX_PAYLOAD )
+    panic("IPC payload of %lu bytes is too big", length);
+
+  if( (IPC_RING_SIZE - (tx->head - tx->tail)) < length )
+    return false;
+
+  const uint8_t *bytes = (const uint8_t*)payload;
+  for( uint32_t i = 0; i < length; i++ )
+    tx->data[(tx->head + i) & IPC_RING_MASK] = bytes[i];
+
+  /* The payload has to be in memory before the other core can see the word */
+  __dmb();
+
+  if( !multicore_fifo_push_timeout_us( IPC_WORD(type, arg, length), IPC_SEND_TIMEOUT_US ) )
+    return false;
+
+  tx->head += length;
+  return true;
+}
+
+/*
+ * Wait up to timeout_us for a message from the other core. Returns false
+ * if nothing came. A timeout of 0 just looks.
+ */
+bool ipc_receive( IPC_MESSAGE *msg, uint32_t timeout_us )
+{
+  IPC_RING *rx = &ring[get_core_num() ^ 1];
+  uint32_t  word;
+
+  if( (timeout_us == 0) && !multicore_fifo_rvalid() )
+    return false;
+
+  if( !multicore_fifo_pop_timeout_us( timeout_us, &word ) )
+    return false;
+
+  msg->type   = (IPC_TYPE)IPC_WORD_TYPE(word);
+  msg->arg    = IPC_WORD_ARG(word);
+  msg->length = IPC_WORD_LENGTH(word);
+
+  uint32_t tail = rx->tail;
+  for( uint32_t i = 0; i < msg->length; i++ )
+    msg->payload[i] = rx->data[(tail + i) & IPC_RING_MASK];
+
+  /* Copied out before the sender's allowed to reuse the space */
+  __dmb();
+  rx->tail = tail + msg->length;
+
+  return true;
+}
+
+/* True if there's a message waiting from the other core. It's the scheduler's cancel check, so it's in RAM */
+bool __time_critical_func(ipc_pending)( void )
+{
+  return multicore_fifo_rvalid();
+}
+
+/* Core0: ask core1 to park when it's next between tests */
+void ipc_park_request( void )
+{
+  park_requested = true;
+}
+
+/* Core0: let core1 go again */
+void ipc_park_release( void )
+{
+  park_requested = false;
+  __sev();
+}
+
+/* Core0: true once core1 is parked, with its interrupts off and nothing running from flash */
+bool ipc_parked( void )
+{
+  return parked;
+}
+
+static void __time_critical_func(park)( void )
+{
+  uint32_t interrupts = save_and_disable_interrupts();
+
+  parked = true;
+  while( park_requested )
+    __wfe();
+  parked = false;
+
+  restore_interrupts( interrupts );
+}
+
+/*
+ * Core1: called between tests. If core0 wants it parked, say so and wait
+ * in RAM until it's done. If the message doesn't fit core0 sees the flag
+ * next time round its loop anyway.
+ */
+void ipc_park_point( void )
+{
+  if( !park_requested )
+    return;
+
+  ipc_send( IPC_MSG_PARKED, 0, NULL, 0 );
+  park();
+}
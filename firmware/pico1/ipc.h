@@ -0,0 +1,54 @@
+#ifndef __IPC_H
+#define __IPC_H
+
+#include "pico/stdlib.h"
+
+#include "rail_monitor.h"
+
+/*
+ * Messages between the cores. Core0 runs the user interface and sends
+ * commands, core1 runs the tests and sends back results.
+ */
+typedef enum
+{
+  IPC_CMD_RUN_PAGE    = 0x01,           // Core0->core1: run this page's tests from now on, arg is the page
+  IPC_MSG_RESULT      = 0x81,           // Core1->core0: page's results are ready, arg is the page, payload is IPC_RESULT
+  IPC_MSG_BUTTON      = 0x82,           // Core1->core0: the user button's been pressed, from the GPIO interrupt
+  IPC_MSG_LONG_PRESS  = 0x83,           // Core1->core0: the user button's been held down then let go
+  IPC_MSG_LOG         = 0x84,           // Core1->core0: save a result, payload is RESULT_LOG_RECORD
+  IPC_MSG_PARKED      = 0x85,           // Core1->core0: parked as asked, see ipc_park_request()
+  IPC_MSG_BASELINE    = 0x86,           // Core1->core0: save a new baseline, payload is BASELINE_VECTOR
+}
+IPC_TYPE;
+
+/* Payload of IPC_MSG_RESULT */
+typedef struct
+{
+  uint32_t    elapsed_ms;               // How long the tests took
+  RAIL_WINDOW rails;                    // What the supply rails did while they ran
+}
+IPC_RESULT;
+
+/* Largest payload a message can carry */
+#define IPC_MAX_PAYLOAD 256
+
+typedef struct
+{
+  IPC_TYPE type;
+  uint32_t arg;
+  uint32_t length;                      // Bytes in payload
+  uint8_t  payload[IPC_MAX_PAYLOAD];
+}
+IPC_MESSAGE;
+
+void ipc_init( void );
+bool ipc_send( IPC_TYPE type, uint32_t arg, const void *payload, uint32_t length );
+bool ipc_receive( IPC_MESSAGE *msg, uint32_t timeout_us );
+bool ipc_pending( void );
+
+void ipc_park_request( void );
+void ipc_park_release( void );
+bool ipc_parked( void );
+void ipc_park_point( void );
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Link soak test, Pico1's end, see link_bench.c. This is a program of its
+ * own, pico1_linkbench, flashed instead of the diagnostics, with
+ * pico2_linkbench on the other Pico. It sends frames as fast as the link
+ * will take them and prints what it found over USB serial every second.
+ * The Spectrum doesn't need to be switched on, only the Picos.
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "pico/binary_info.h"
+#include "hardware/pio.h"
+
+#include "gpios.h"
+#include "sys_clock.h"
+#include "link_common.h"
+#include "link_bench.h"
+#include "picoputer.pio.h"
+
+/* The sizes the tests actually send are mostly small, so are most of these */
+static const uint32_t frame_size[] = { 4, 4, 8, 16, 64, 256 };
+#define NUM_FRAME_SIZES (sizeof(frame_size) / sizeof(frame_size[0]))
+
+#define REPORT_INTERVAL_US 1000000
+
+static LINK_BENCH_STATS stats;
+
+void main( void )
+{
+  bi_decl(bi_program_description("ZX Spectrum Diagnostics Pico1 link soak test."));
+
+  sys_clock_init();
+  stdio_init_all();
+
+  const PIO pio = pio1;
+
+  /* The same GPIOs and PIO as the diagnostics use. The GPIOs are labelled from Pico2's view */
+  gpio_set_function( GPIO_P2_LINKOUT, GPIO_FUNC_PIO1 );
+  int  linkin_sm  = pio_claim_unused_sm( pio, true );
+  uint offset     = pio_add_program( pio, &picoputerlinkin_program );
+  picoputerlinkin_program_init( pio, linkin_sm, offset, GPIO_P2_LINKOUT );
+
+  gpio_set_function( GPIO_P2_LINKIN, GPIO_FUNC_PIO1 );
+  int  linkout_sm = pio_claim_unused_sm( pio, true );
+       offset     = pio_add_program( pio, &picoputerlinkout_program );
+  picoputerlinkout_program_init( pio, linkout_sm, offset, GPIO_P2_LINKIN );
+
+  /* Pico2 isn't signalled, it doesn't look at the line in its soak test */
+  gpio_init( GPIO_P1_SIGNAL ); gpio_set_dir( GPIO_P1_SIGNAL, GPIO_OUT ); gpio_put( GPIO_P1_SIGNAL, 0 );
+
+  link_bench_start( NULL );
+
+  /* Give Pico2, and whoever's opening the serial port, a chance */
+  sleep_ms( 2000 );
+
+  link_bench_reset( &stats );
+  printf("Link negotiated %lu bit/s\n", link_bench_negotiate( pio, linkin_sm, linkout_sm, &stats ));
+
+  uint32_t size_index = 0;
+  uint32_t report_start_us = time_us_32();
+
+  while( 1 )
+  {
+    link_bench_transfer( pio, linkin_sm, linkout_sm, frame_size[size_index], &stats );
+    size_index = (size_index + 1) % NUM_FRAME_SIZES;
+
+    uint32_t elapsed_us = time_us_32() - report_start_us;
+    if( elapsed_us >= REPORT_INTERVAL_US )
+    {
+      LINK_BENCH_REPORT report;
+      link_bench_report( &stats, elapsed_us, &report );
+
+      printf("%lu B/s  %lu frames  p50 %luus p90 %luus p99 %luus max %luus  %lu timeouts  %lu bad  %lu resyncs\n",
+	     report.bytes_per_sec, report.transfers,
+	     report.p50_us, report.p90_us, report.p99_us, report.max_us,
+	     report.timeouts, report.checksum_failures, report.resyncs);
+
+      link_bench_reset( &stats );
+      report_start_us = time_us_32();
+    }
+  }
+}
@@ -1,4 +1,40 @@
 #ifndef __PAGE_H
 #define __PAGE_H
 
+#include "hardware/pio.h"
+
+#include "scheduler.h"
+
+/* The link to Pico2, which the tests that need the address bus use */
+typedef struct
+{
+  PIO linkin_pio;
+  PIO linkout_pio;
+  int linkin_sm;
+  int linkout_sm;
+}
+PICO_LINK;
+
+/*
+ * Everything the main loop needs to know about a page. Each page_*.c
+ * defines one of these, named after the page, and page_list.h lists
+ * them in the order the button steps through them. Any of the hooks
+ * except run_func and display_func can be NULL. Tests which want GPIO
+ * interrupts register handlers for their pins in entry_func, and take
+ * them away again in exit_func, see gpio_irq.h.
+ */
+typedef struct
+{
+  uint8_t          *gui_title;
+  void            (*init_func)( void );                      // Initialise, once at boot
+  void            (*entry_func)( void );                     // Before each run of the tests
+  void            (*run_func)( const PICO_LINK *link );      // Run the tests
+  void            (*exit_func)( void );                      // After each run of the tests
+  void            (*display_func)( void );                   // Display your output now
+  SCHED_TEST        test;                                    // What the tests need, for the scheduler
+  const SCHED_TASK *background_task;                         // Runs whichever page is showing
+  bool              hidden;                                  // Only reached with a long press of the button
+}
+PAGE_DESCRIPTOR;
+
 #endif
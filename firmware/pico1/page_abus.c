@@ -10,8 +10,13 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "scheduler.h"
+
 #include "test_data.h"
+#include "result_log.h"
 #include "link_common.h"
+#include "pico_comm.h"
+#include "z80_reset.h"
 
 /* Long enough to let the Spectrum boot and run a decent part of the ROM */
 #define TEST_TIME_SECS   2
@@ -21,8 +26,6 @@
 #define WIDTH_OLED_CHARS 32
 static uint8_t result_line_txt[NUM_ABUS_TEST_RESULT_LINES][WIDTH_OLED_CHARS+1];
 
-#define PICO_COMM_TEST_ABUS 0x01020304
-
 static uint32_t num_bytes_received = 0;
 
 static bool abus_test_running = false;
@@ -39,21 +42,45 @@ void abus_page_exit( void )
 {
 }
 
-void abus_page_gpios( uint32_t gpio, uint32_t events )
-{
-}
-
 static int64_t __time_critical_func(abus_alarm_callback)(alarm_id_t id, void *user_data)
 {
   abus_test_running = false;
+  sched_wake();
   return 0;
 }
 
+/*
+ * The other Pico stops as soon as it's seen every line go both ways, on a
+ * healthy Spectrum that's very early on. Its answer starting to arrive
+ * ends the test, the alarm's only for when a line never moves.
+ */
+static int64_t __time_critical_func(abus_reply_callback)(alarm_id_t id, void *user_data)
+{
+  const PICO_LINK *link = (const PICO_LINK*)user_data;
+
+  if( !abus_test_running )
+    return 0;
+
+  if( pico_comm_response_started( link->linkin_pio, link->linkin_sm ) )
+  {
+    abus_test_running = false;
+    sched_wake();
+    return 0;
+  }
+
+  return PICO_COMM_POLL_US;
+}
+
 #define ADDR_BUF_SIZE 2048
 static uint8_t address_buffer[ADDR_BUF_SIZE*2];
 
-void abus_page_run_tests( PIO linkin_pio, PIO linkout_pio, int linkin_sm, int linkout_sm )
+void abus_page_run_tests( const PICO_LINK *link )
 {
+  PIO linkin_pio  = link->linkin_pio;
+  PIO linkout_pio = link->linkout_pio;
+  int linkin_sm   = link->linkin_sm;
+  int linkout_sm  = link->linkout_sm;
+
 #if 0
   /* LED can be useful for this one */
   const uint LED_PIN = PICO_DEFAULT_LED_PIN;
@@ -64,26 +91,42 @@ void abus_page_run_tests( PIO linkin_pio, PIO linkout_pio, int linkin_sm, int li
   abus_test_running = false;
 
   /*
-   * Reboot the Spectrum.
+   * Reboot the Spectrum. It's held in reset until the other Pico's
+   * watching, then the test's time starts when the Z80 does.
    */
-  gpio_put( GPIO_Z80_RESET, 1 ); sleep_ms( 5 );
-  gpio_put( GPIO_Z80_RESET, 0 );
+  z80_reset_hold();
 
-  /* Tell the other Pico which test to run */
-  uint32_t test_type = PICO_COMM_TEST_ABUS;
-  ui_link_send_buffer( linkout_pio, linkout_sm, linkin_sm, (uint8_t*)&test_type, sizeof(test_type) );
+  /* Tell the other Pico which test to run, all 16 lines */
+  ABUS_PARAMS params = { 0x0000FFFF };
+  if( !pico_comm_request( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_TEST_ABUS, &params, sizeof(params) ) )
+  {
+    gpio_put( GPIO_Z80_RESET, 0 );
+    pico_comm_show_status( PICO_COMM_NO_RESPONSE, result_line_txt[0], sizeof(result_line_txt[0]), NUM_ABUS_TEST_RESULT_LINES );
+    return;
+  }
 
-  /* Flag the other Pico, which monitors the address bus */
+  /* Flag the other Pico, which monitors the address bus, then let the Z80 go */
   gpio_put( GPIO_P1_SIGNAL, 1 );
   // gpio_put(LED_PIN, 1);
+  busy_wait_us_32( Z80_WATCH_DELAY_US );
+  z80_reset_release( Z80_START_TIMEOUT_MS );
 
-  /* Start the alarm which defines the duration of the test */
+  /* Start the alarm which defines the longest the test can take, it usually ends sooner */
   abus_test_running = true;
   alarm_id_t abus_alarm_id = add_alarm_in_ms( TEST_TIME_SECS*1000, abus_alarm_callback, NULL, false );
   if( abus_alarm_id < 0 )
     panic("No alarms available in ABUS test");
 
-  while( abus_test_running );
+  alarm_id_t abus_reply_id = add_alarm_in_us( PICO_COMM_POLL_US, abus_reply_callback, (void*)link, false );
+  if( abus_reply_id < 0 )
+    panic("No alarms available in ABUS test");
+
+  /*
+   * The wait ends early if the user moves to another page. Dropping the
+   * flag stops the other Pico either way, and it always sends its
+   * results back, so they still have to be collected.
+   */
+  sched_wait( &abus_test_running );
 
   /* Remove flag to stop the other Pico collecting address data */
   gpio_put( GPIO_P1_SIGNAL, 0 );
@@ -94,14 +137,24 @@ void abus_page_run_tests( PIO linkin_pio, PIO linkout_pio, int linkin_sm, int li
    * timing system something else might need to go here
    */
   cancel_alarm( abus_alarm_id );
+  cancel_alarm( abus_reply_id );
 
-  /* Wait for 16 byte results array from the other Pico */
-  SEEN_EDGE line_edge[16];
-  ui_link_receive_buffer( linkin_pio, linkin_sm, linkout_sm, (uint8_t*)line_edge, sizeof(line_edge[0])*16 );
+  /*
+   * Wait for the results from the other Pico. What each line did, the raw state of
+   * the Pico2 GPIOs, so I can report what's stuck, if anything, and how many times it
+   * looked at the bus for each T-state. If that's less than one it could have missed things.
+   */
+  ABUS_RESULT result;
+  PICO_COMM_STATUS status = pico_comm_response( linkin_pio, linkin_sm, linkout_sm, PICO_COMM_TEST_ABUS, &result, sizeof(result), NULL );
+  if( status != PICO_COMM_OK )
+  {
+    pico_comm_show_status( status, result_line_txt[0], sizeof(result_line_txt[0]), NUM_ABUS_TEST_RESULT_LINES );
+    return;
+  }
 
-  /* Now receive the raw state of the Pico2 GPIOs, so I can report what's stuck, if anything */
-  uint32_t gpio_state;
-  ui_link_receive_buffer( linkin_pio, linkin_sm, linkout_sm, (uint8_t*)&gpio_state, sizeof(gpio_state) );
+  SEEN_EDGE   *line_edge  = result.line_edge;
+  uint32_t     gpio_state = result.gpio_state;
+  SAMPLE_RATE  rate       = result.rate;
 
   /* Show the result line */
   snprintf( result_line_txt[0], WIDTH_OLED_CHARS, "111111          " );
@@ -165,13 +218,48 @@ void abus_page_run_tests( PIO linkin_pio, PIO linkout_pio, int linkin_sm, int li
       );
     result_line_txt[4][0] = '\0';
     snprintf( result_line_txt[5], WIDTH_OLED_CHARS, "Stuck lines");
+
+    /*
+     * An edge which was seen definitely happened, but one which wasn't
+     * might have been missed if the other Pico couldn't keep up
+     */
+    if( !SAMPLE_RATE_TRUSTWORTHY( rate ) )
+      snprintf( result_line_txt[5], WIDTH_OLED_CHARS, "Unreliable, too slow");
+  }
+
+  /* Only complete runs go in the log, a cancelled one didn't watch for long enough */
+  if( !sched_cancelled() )
+  {
+    RESULT_LOG_BUS_DATA saved = { 0, 0 };
+    for( uint32_t line = 0; line < 16; line++ )
+    {
+      if( line_edge[line] != SEEN_BOTH )
+      {
+	saved.stuck |= (1 << line);
+	if( gpio_state & (1 << line) )
+	  saved.level |= (1 << line);
+      }
+    }
+    result_log_add( RESULT_LOG_ABUS, &saved, sizeof(saved) );
+  }
+
+  /* The sampling rate goes on the spare line */
+  if( rate.t_states == 0 )
+  {
+    snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "No CLK, rate unknown" );
+  }
+  else
+  {
+    uint32_t per_t_state = (uint32_t)(((uint64_t)rate.samples * 100) / rate.t_states);
+    snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "Samples/T %lu.%02lu%s",
+	      per_t_state / 100, per_t_state % 100, SAMPLE_RATE_TRUSTWORTHY( rate ) ? "" : " LOW" );
   }
 
   /*
    * Repeat test a regular intervals, but don't do it too fast in case the comms
    * goes a bit funny. No reason it should, but let's not tempt it
    */
-  sleep_ms(1000);
+  sched_sleep_ms(1000);
 }
 
 
@@ -186,3 +274,24 @@ void abus_output(void)
     line++;
   }  
 }
+
+
+/***
+ *        _       _     _                     ___           
+ *       /_\   __| | __| | _ _  ___  ___ ___ | _ ) _  _  ___
+ *      / _ \ / _` |/ _` || '_|/ -_)(_-<(_-< | _ \| || |(_-<
+ *     /_/ \_\\__,_|\__,_||_|  \___|/__//__/ |___/ \_,_|/__/
+ *                                                          
+ */
+const PAGE_DESCRIPTOR abus_page =
+{
+  "ADDRESS BUS",
+  abus_page_init,
+  abus_page_entry,
+  abus_page_run_tests,
+  abus_page_exit,
+  abus_output,
+  { "ABUS", SCHED_RES_LINK | SCHED_RES_Z80_RESET, 3100 },
+  NULL,
+  false
+};
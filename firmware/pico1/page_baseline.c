@@ -0,0 +1,223 @@
+/*
+ * Baseline pages
+ *
+ * Two hidden pages, reached with a long press. BASELINE compares the
+ * machine with the saved baseline, SET BASELINE measures it and saves
+ * it as the new one, so do that on a Spectrum which is known to be good.
+ *
+ * Neither page needs the others to have been visited. Each run does one
+ * of the other pages' tests, taking them in turn, and those report what
+ * they measured to the baseline code. The verdict builds up as they do,
+ * with all of it there after one pass, around 10 seconds.
+ *
+ * That's not one boot of the Spectrum. The ULA, cycles and ROM tests
+ * each reset it and watch it start, as they do on their own pages, so a
+ * pass covers three boots. I'd rather that than have the tests measure
+ * something different here to what they measure on their pages.
+ *
+ * SET BASELINE starts measuring from scratch when it's arrived at, and
+ * saves once everything's been measured. Leave the page before then
+ * and nothing's saved.
+ */
+
+#include "oled.h"
+#include "page.h"
+
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "scheduler.h"
+#include "baseline.h"
+#include "page_baseline.h"
+
+#define NUM_BASELINE_RESULT_LINES 6
+#define WIDTH_OLED_CHARS 32
+static uint8_t result_line_txt[NUM_BASELINE_RESULT_LINES][WIDTH_OLED_CHARS+1];
+
+/* The pages whose tests measure what the baseline needs */
+extern const PAGE_DESCRIPTOR voltage_page;
+extern const PAGE_DESCRIPTOR ula_page;
+extern const PAGE_DESCRIPTOR cycles_page;
+extern const PAGE_DESCRIPTOR rom_page;
+
+static const PAGE_DESCRIPTOR *const source[] =
+{
+  &voltage_page,
+  &ula_page,
+  &cycles_page,
+  &rom_page,
+};
+#define NUM_SOURCES (sizeof(source) / sizeof(source[0]))
+
+static uint32_t next_source = 0;
+
+/* Set when SET BASELINE has saved what it measured this visit */
+static bool saved = false;
+
+/*
+ * Run the next page's tests, as if it were showing. The voltages are
+ * normally a background task, but that can't run alongside the other
+ * tests here, so they get their turn like everything else.
+ */
+static void measure_next( const PICO_LINK *link )
+{
+  const PAGE_DESCRIPTOR *measuring = source[next_source];
+
+  if( measuring->entry_func != NULL )
+    (measuring->entry_func)();
+
+  (measuring->run_func)( link );
+
+  if( measuring->exit_func != NULL )
+    (measuring->exit_func)();
+
+  next_source = (next_source + 1) % NUM_SOURCES;
+}
+
+static uint32_t count_bits( uint32_t mask )
+{
+  uint32_t count = 0;
+  for( ; mask; mask &= mask - 1 )
+    count++;
+
+  return count;
+}
+
+/* One metric's difference from the baseline, as a percentage where that makes sense */
+static void format_difference( uint8_t *txt, BASELINE_METRIC metric,
+			       const BASELINE_VECTOR *base, const BASELINE_VECTOR *now )
+{
+  int32_t base_value = base->value[metric];
+  int32_t now_value  = now->value[metric];
+
+  if( metric == BASELINE_ROM_OK )
+    snprintf( txt, WIDTH_OLED_CHARS, " %-4s %s", baseline_name( metric ), now_value ? "read" : "not read" );
+  else if( base_value == 0 )
+    snprintf( txt, WIDTH_OLED_CHARS, " %-4s %ld, was 0", baseline_name( metric ), now_value );
+  else
+    snprintf( txt, WIDTH_OLED_CHARS, " %-4s %+0.1f%%", baseline_name( metric ),
+	      (float)(now_value - base_value) * 100.0 / (float)base_value );
+}
+
+void baseline_page_run_tests( const PICO_LINK *link )
+{
+  measure_next( link );
+
+  for( uint32_t index = 0; index < NUM_BASELINE_RESULT_LINES; index++ )
+    result_line_txt[index][0] = '\0';
+
+  const BASELINE_VECTOR *base = baseline_stored();
+  if( base == NULL )
+  {
+    snprintf( result_line_txt[0], WIDTH_OLED_CHARS, "No baseline saved" );
+    snprintf( result_line_txt[1], WIDTH_OLED_CHARS, "Use SET BASELINE" );
+    return;
+  }
+
+  const BASELINE_VECTOR *now = baseline_current();
+  uint32_t out      = baseline_out_mask();
+  uint32_t compared = count_bits( now->have & base->have );
+  uint32_t wanted   = count_bits( base->have );
+
+  if( out )
+    snprintf( result_line_txt[0], WIDTH_OLED_CHARS, "DIFFERS %lu/%lu", count_bits( out ), compared );
+  else if( compared < wanted )
+    snprintf( result_line_txt[0], WIDTH_OLED_CHARS, "OK so far %lu/%lu", compared, wanted );
+  else
+    snprintf( result_line_txt[0], WIDTH_OLED_CHARS, "MATCHES %lu/%lu", compared, wanted );
+
+  /* The ones which are out, as many as there's room for */
+  uint32_t line = 1;
+  for( uint32_t metric = 0; (metric < NUM_BASELINE_METRICS) && (line < NUM_BASELINE_RESULT_LINES); metric++ )
+  {
+    if( out & (1u << metric) )
+      format_difference( result_line_txt[line++], metric, base, now );
+  }
+}
+
+void baseline_set_page_run_tests( const PICO_LINK *link )
+{
+  /* Just arrived, so start again, nothing from before counts */
+  if( !sched_continuing() )
+  {
+    baseline_clear_current();
+    next_source = 0;
+    saved       = false;
+  }
+
+  if( saved )
+  {
+    sched_sleep_ms( 1000 );
+    return;
+  }
+
+  measure_next( link );
+
+  /* Tries again next time round if core0 couldn't take it */
+  if( !sched_cancelled() )
+    saved = baseline_save();
+
+  uint32_t measured = count_bits( baseline_current()->have );
+
+  for( uint32_t index = 0; index < NUM_BASELINE_RESULT_LINES; index++ )
+    result_line_txt[index][0] = '\0';
+
+  if( saved )
+  {
+    snprintf( result_line_txt[0], WIDTH_OLED_CHARS, "Saved as the baseline" );
+    snprintf( result_line_txt[1], WIDTH_OLED_CHARS, "%lu values", measured );
+  }
+  else
+  {
+    snprintf( result_line_txt[0], WIDTH_OLED_CHARS, "Measured %lu of %u", measured, NUM_BASELINE_METRICS );
+    snprintf( result_line_txt[1], WIDTH_OLED_CHARS, "Leave page to cancel" );
+  }
+}
+
+
+void baseline_output(void)
+{
+  uint8_t line=2;
+  for( uint32_t test_index=0; test_index<NUM_BASELINE_RESULT_LINES; test_index++ )
+  {
+    draw_str(0, line*8, "                         " );
+    draw_str(0, line*8, result_line_txt[test_index] );
+
+    line++;
+  }
+}
+
+
+/***
+ *      ___                 _  _
+ *     | _ ) __ _  ___ ___ | |(_) _ _   ___
+ *     | _ \/ _` |(_-</ -_)| || || ' \ / -_)
+ *     |___/\__,_|/__/\___||_||_||_||_|\___|
+ *
+ */
+const PAGE_DESCRIPTOR baseline_page =
+{
+  "BASELINE",
+  NULL,
+  NULL,
+  baseline_page_run_tests,
+  NULL,
+  baseline_output,
+  { "BASELINE", SCHED_RES_PIO0 | SCHED_RES_GPIO_IRQ | SCHED_RES_LINK | SCHED_RES_Z80_RESET | SCHED_RES_CORE, 4700 },
+  NULL,
+  true
+};
+
+const PAGE_DESCRIPTOR baseline_set_page =
+{
+  "SET BASELINE",
+  NULL,
+  NULL,
+  baseline_set_page_run_tests,
+  NULL,
+  baseline_output,
+  { "SETBASE", SCHED_RES_PIO0 | SCHED_RES_GPIO_IRQ | SCHED_RES_LINK | SCHED_RES_Z80_RESET | SCHED_RES_CORE, 4700 },
+  NULL,
+  true
+};
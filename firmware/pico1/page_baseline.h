@@ -0,0 +1,10 @@
+#ifndef __PAGE_BASELINE_H
+#define __PAGE_BASELINE_H
+
+#include "page.h"
+
+void baseline_page_run_tests( const PICO_LINK *link );
+void baseline_set_page_run_tests( const PICO_LINK *link );
+void baseline_output(void);
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * Boot timeline, how long the ROM takes to get through its start up
+ */
+
+#include "oled.h"
+#include "page.h"
+#include "gpios.h"
+
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "scheduler.h"
+
+#include "test_data.h"
+#include "link_common.h"
+#include "pico_comm.h"
+#include "z80_reset.h"
+
+/*
+ * The places the 48K ROM gets to as it starts up, in the order it gets to
+ * them. The other Pico notes when the Z80 first reads from each one.
+ */
+typedef struct
+{
+  uint8_t  *name;
+  uint16_t  address;
+}
+BOOT_MILESTONE;
+
+static const BOOT_MILESTONE boot_milestone[] =
+{
+  { "Reset",    0x0000 },               // First instruction
+  { "START",    0x11CB },               // START/NEW, where the jump at 0x0005 goes
+  { "RAM done", 0x11EF },               // RAM-DONE, the RAM test's finished
+  { "1st INT",  0x0038 },               // MASK-INT, interrupts are on
+  { "Main",     0x12A2 },               // MAIN-EXEC, BASIC's ready for the user
+};
+#define NUM_BOOT_MILESTONES (sizeof(boot_milestone) / sizeof(BOOT_MILESTONE))
+
+#define NUM_BOOT_TEST_RESULT_LINES (NUM_BOOT_MILESTONES+1)
+#define WIDTH_OLED_CHARS 32
+static uint8_t result_line_txt[NUM_BOOT_TEST_RESULT_LINES][WIDTH_OLED_CHARS+1];
+
+/* Long enough for a 48K to get all the way to BASIC */
+#define TEST_TIME_SECS   4
+#define TEST_TIME_SECS_F ((float)(TEST_TIME_SECS))
+
+static bool boot_test_running = false;
+
+static int64_t __time_critical_func(boot_alarm_callback)(alarm_id_t id, void *user_data)
+{
+  boot_test_running = false;
+  sched_wake();
+  return 0;
+}
+
+void boot_page_init( void )
+{
+  if( NUM_BOOT_MILESTONES > BOOT_MAX_MILESTONES )
+    panic("Too many boot milestones");
+}
+
+void boot_page_entry( void )
+{
+}
+
+void boot_page_exit( void )
+{
+}
+
+void boot_page_run_tests( const PICO_LINK *link )
+{
+  PIO linkin_pio  = link->linkin_pio;
+  PIO linkout_pio = link->linkout_pio;
+  int linkin_sm   = link->linkin_sm;
+  int linkout_sm  = link->linkout_sm;
+
+  boot_test_running = false;
+
+  /*
+   * Hold the Spectrum in reset. It's let go once the other Pico's
+   * watching, so it sees the start, and knows when that was.
+   */
+  z80_reset_hold();
+
+  /* Tell the other Pico which test to run, and where to look */
+  BOOT_PARAMS params;
+  memset( &params, 0, sizeof(params) );
+  params.reset_delay_us = Z80_WATCH_DELAY_US;
+  params.num_milestones = NUM_BOOT_MILESTONES;
+  for( uint32_t milestone = 0; milestone < NUM_BOOT_MILESTONES; milestone++ )
+    params.address[milestone] = boot_milestone[milestone].address;
+
+  if( !pico_comm_request( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_TEST_BOOT, &params, sizeof(params) ) )
+  {
+    gpio_put( GPIO_Z80_RESET, 0 );
+    pico_comm_show_status( PICO_COMM_NO_RESPONSE, result_line_txt[0], sizeof(result_line_txt[0]), NUM_BOOT_TEST_RESULT_LINES );
+    return;
+  }
+
+  /* Flag the other Pico, which monitors the address bus, then let the Z80 go */
+  gpio_put( GPIO_P1_SIGNAL, 1 );
+  busy_wait_us_32( Z80_WATCH_DELAY_US );
+  gpio_put( GPIO_Z80_RESET, 0 );
+
+  /* Start the alarm which defines the duration of the test */
+  boot_test_running = true;
+  alarm_id_t boot_alarm_id = add_alarm_in_ms( TEST_TIME_SECS*1000, boot_alarm_callback, NULL, false );
+  if( boot_alarm_id < 0 )
+    panic("No alarms available in boot test");
+
+  /* Cancelling the test cuts this short, the other Pico still replies */
+  sched_wait( &boot_test_running );
+
+  /* Remove flag to stop the other Pico watching */
+  gpio_put( GPIO_P1_SIGNAL, 0 );
+
+  /*
+   * Alarm is done with, this reset isn't necessary but if I change the
+   * timing system something else might need to go here
+   */
+  cancel_alarm( boot_alarm_id );
+
+  /* Other Pico sends when the Z80 got to each milestone, and how often */
+  BOOT_RESULT result;
+  PICO_COMM_STATUS status = pico_comm_response( linkin_pio, linkin_sm, linkout_sm, PICO_COMM_TEST_BOOT, &result, sizeof(result), NULL );
+  if( status != PICO_COMM_OK )
+  {
+    pico_comm_show_status( status, result_line_txt[0], sizeof(result_line_txt[0]), NUM_BOOT_TEST_RESULT_LINES );
+    return;
+  }
+
+  /*
+   * Show the result lines, a line per milestone with the CLK cycles it took to get
+   * there in thousands. Anything passed more than once has how many times. Reset's
+   * is how long C27 held the Z80 after it was let go, the rest are from then.
+   */
+  for( uint32_t milestone = 0; milestone < NUM_BOOT_MILESTONES; milestone++ )
+  {
+    if( result.reached[milestone] == BOOT_NOT_REACHED )
+    {
+      snprintf( result_line_txt[milestone], WIDTH_OLED_CHARS, "%-8s    never", boot_milestone[milestone].name );
+    }
+    else if( result.times[milestone] == 1 )
+    {
+      snprintf( result_line_txt[milestone], WIDTH_OLED_CHARS, "%-8s %6luk",
+		boot_milestone[milestone].name, result.reached[milestone] / 1000 );
+    }
+    else
+    {
+      snprintf( result_line_txt[milestone], WIDTH_OLED_CHARS, "%-8s %6luk x%lu",
+		boot_milestone[milestone].name, result.reached[milestone] / 1000, result.times[milestone] );
+    }
+  }
+
+  if( result.rate.t_states == 0 )
+  {
+    snprintf( result_line_txt[NUM_BOOT_MILESTONES], WIDTH_OLED_CHARS, "No CLK, times unknown" );
+  }
+  else
+  {
+    uint32_t per_t_state = (uint32_t)(((uint64_t)result.rate.samples * 100) / result.rate.t_states);
+    snprintf( result_line_txt[NUM_BOOT_MILESTONES], WIDTH_OLED_CHARS, "Samples/T %lu.%02lu%s",
+	      per_t_state / 100, per_t_state % 100, SAMPLE_RATE_TRUSTWORTHY( result.rate ) ? "" : " LOW" );
+  }
+
+  /*
+   * Repeat test a regular intervals, but don't do it too fast in case the comms
+   * goes a bit funny. No reason it should, but let's not tempt it
+   */
+  sched_sleep_ms(1000);
+}
+
+
+void boot_output(void)
+{
+  uint8_t line=2;
+  for( uint32_t test_index=0; test_index<NUM_BOOT_TEST_RESULT_LINES; test_index++ )
+  {
+    draw_str(0, line*8, "                         " );
+    draw_str(0, line*8, result_line_txt[test_index] );
+
+    line++;
+  }
+}
+
+
+/***
+ *      ___            _   
+ *     | _ ) ___  ___ | |_ 
+ *     | _ \/ _ \/ _ \|  _|
+ *     |___/\___/\___/ \__|
+ *                         
+ */
+const PAGE_DESCRIPTOR boot_page =
+{
+  "BOOT",
+  boot_page_init,
+  boot_page_entry,
+  boot_page_run_tests,
+  boot_page_exit,
+  boot_output,
+  { "BOOT", SCHED_RES_LINK | SCHED_RES_Z80_RESET, 5100 },
+  NULL,
+  false
+};
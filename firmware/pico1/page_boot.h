@@ -0,0 +1,13 @@
+#ifndef __PAGE_BOOT_H
+#define __PAGE_BOOT_H
+
+#include "page.h"
+#include "hardware/pio.h"
+
+void boot_page_init( void );
+void boot_page_entry( void );
+void boot_page_run_tests( const PICO_LINK *link );
+void boot_output(void);
+void boot_page_exit( void );
+
+#endif
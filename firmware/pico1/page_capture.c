@@ -0,0 +1,325 @@
+/*
+ * Logic analyser capture
+ *
+ * Each run of this page captures the Spectrum's bus around a trigger
+ * event, the trigger changing each time round. The samples either side
+ * of the trigger are kept in the Pico's memory; the screen just shows
+ * what happened at the trigger point.
+ */
+
+#include "oled.h"
+#include "page.h"
+#include "gpios.h"
+
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "scheduler.h"
+
+#include "test_data.h"
+#include "link_common.h"
+#include "pico_comm.h"
+#include "z80_reset.h"
+#include "logic_capture.h"
+#include "usb_stream.h"
+
+#define NUM_CAPTURE_TEST_RESULT_LINES 4
+#define WIDTH_OLED_CHARS 32
+static uint8_t result_line_txt[NUM_CAPTURE_TEST_RESULT_LINES][WIDTH_OLED_CHARS+1];
+
+/* Longest to wait for the trigger */
+#define TEST_TIME_SECS   2
+#define TEST_TIME_SECS_F ((float)(TEST_TIME_SECS))
+
+/* Split the ring evenly either side of the trigger */
+#define PRE_TRIGGER_SAMPLES  (LA_MAX_SAMPLES/2)
+#define POST_TRIGGER_SAMPLES (LA_MAX_SAMPLES/2)
+
+/*
+ * How long the pre-trigger samples take to come in, before the trigger's
+ * armed. There's a sample on each edge of the 3.5MHz CLK, so 7 a
+ * microsecond. This allows for a slower clock, with a millisecond spare.
+ */
+#define PRE_TRIGGER_FILL_US  ((PRE_TRIGGER_SAMPLES / 3) + 1000)
+
+/* The triggers this page cycles through. Pico2 has the address bus, so it runs the address one */
+typedef struct
+{
+  uint8_t    *name;
+  bool        on_pico2;
+  LA_TRIGGER  trigger;
+}
+CAPTURE_TRIGGER;
+
+static const CAPTURE_TRIGGER capture_trigger[] =
+{
+  { "INT edge",     false, { LA_TRIGGER_FALLING_EDGE, GPIO_Z80_INT,  0,             0      } },
+  { "IO write",     false, { LA_TRIGGER_BOTH_LOW,     GPIO_Z80_IORQ, GPIO_Z80_WR,   0      } },
+  { "D0-D7=F3",     false, { LA_TRIGGER_DATA8,        GPIO_DBUS_D0,  0,             0xF3   } },
+  { "Addr 0038",    true,  { LA_TRIGGER_ADDRESS16,    0,             16,            0x0038 } },
+};
+#define NUM_CAPTURE_TRIGGERS (sizeof(capture_trigger) / sizeof(CAPTURE_TRIGGER))
+
+static uint32_t trigger_index = 0;
+
+/* The most recent Pico1 capture, left in the ring for anything which wants it */
+static LA_CAPTURE last_capture;
+
+static bool capture_test_running = false;
+
+/* A Pico1 capture lets the Z80 go once its trigger's armed, at this time */
+static bool     release_pending = false;
+static uint64_t release_at_us;
+
+static int64_t __time_critical_func(capture_alarm_callback)(alarm_id_t id, void *user_data)
+{
+  capture_test_running = false;
+  sched_wake();
+  return 0;
+}
+
+/*
+ * The other Pico stops as soon as it has the samples after the trigger.
+ * Its answer starting to arrive ends the test, the alarm's only for a
+ * trigger which never comes.
+ */
+static int64_t __time_critical_func(capture_reply_callback)(alarm_id_t id, void *user_data)
+{
+  const PICO_LINK *link = (const PICO_LINK*)user_data;
+
+  if( !capture_test_running )
+    return 0;
+
+  if( pico_comm_response_started( link->linkin_pio, link->linkin_sm ) )
+  {
+    capture_test_running = false;
+    sched_wake();
+    return 0;
+  }
+
+  return PICO_COMM_POLL_US;
+}
+
+/*
+ * Polled by the capture, which gives up if the time's up or the user's
+ * moved on. The Z80's held in reset until the capture's ready for it,
+ * otherwise the start of the ROM would be over before the trigger's armed.
+ */
+static bool capture_still_running( void )
+{
+  if( release_pending && (time_us_64() >= release_at_us) )
+  {
+    gpio_put( GPIO_Z80_RESET, 0 );
+    release_pending = false;
+  }
+
+  return capture_test_running && !sched_cancelled();
+}
+
+void capture_page_init( void )
+{
+}
+
+void capture_page_entry( void )
+{
+}
+
+void capture_page_exit( void )
+{
+  /* Move on to the next trigger for the next run */
+  if( ++trigger_index == NUM_CAPTURE_TRIGGERS )
+    trigger_index = 0;
+}
+
+void capture_page_run_tests( const PICO_LINK *link )
+{
+  PIO linkin_pio  = link->linkin_pio;
+  PIO linkout_pio = link->linkout_pio;
+  int linkin_sm   = link->linkin_sm;
+  int linkout_sm  = link->linkout_sm;
+
+  const CAPTURE_TRIGGER *trigger = &capture_trigger[trigger_index];
+
+  capture_test_running = false;
+
+  /*
+   * Reboot the Spectrum, so what's captured is the start of the ROM
+   * running, which is consistent from one run to the next.
+   */
+  z80_reset_hold();
+
+  if( trigger->on_pico2 )
+  {
+    /* Tell the other Pico which test to run, and what to trigger on */
+    CAPTURE_PARAMS params = { trigger->trigger, PRE_TRIGGER_SAMPLES, POST_TRIGGER_SAMPLES };
+    if( !pico_comm_request( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_TEST_CAPTURE, &params, sizeof(params) ) )
+    {
+      gpio_put( GPIO_Z80_RESET, 0 );
+      pico_comm_show_status( PICO_COMM_NO_RESPONSE, result_line_txt[0], sizeof(result_line_txt[0]), NUM_CAPTURE_TEST_RESULT_LINES );
+      return;
+    }
+
+    /* Flag the other Pico, which monitors the address bus, before the Z80's let go */
+    gpio_put( GPIO_P1_SIGNAL, 1 );
+    busy_wait_us_32( Z80_WATCH_DELAY_US );
+
+    /* The longest to wait for the trigger starts when the Z80 does */
+    z80_reset_release( Z80_START_TIMEOUT_MS );
+  }
+
+  /* Start the alarm which defines the longest the capture can take */
+  capture_test_running = true;
+  alarm_id_t capture_alarm_id = add_alarm_in_ms( TEST_TIME_SECS*1000, capture_alarm_callback, NULL, false );
+  if( capture_alarm_id < 0 )
+    panic("No alarms available in capture test");
+
+  CAPTURE_SUMMARY summary;
+  if( trigger->on_pico2 )
+  {
+    alarm_id_t capture_reply_id = add_alarm_in_us( PICO_COMM_POLL_US, capture_reply_callback, (void*)link, false );
+    if( capture_reply_id < 0 )
+      panic("No alarms available in capture test");
+
+    sched_wait( &capture_test_running );
+    cancel_alarm( capture_reply_id );
+
+    /* Remove flag to stop the other Pico capturing, if it hasn't already triggered */
+    gpio_put( GPIO_P1_SIGNAL, 0 );
+
+    PICO_COMM_STATUS status = pico_comm_response( linkin_pio, linkin_sm, linkout_sm, PICO_COMM_TEST_CAPTURE, &summary, sizeof(summary), NULL );
+    if( status != PICO_COMM_OK )
+    {
+      pico_comm_show_status( status, result_line_txt[0], sizeof(result_line_txt[0]), NUM_CAPTURE_TEST_RESULT_LINES );
+      cancel_alarm( capture_alarm_id );
+      return;
+    }
+  }
+  else
+  {
+    /* Hardcoded pio0 for this test, the same as the ULA test */
+    release_pending = true;
+    release_at_us   = time_us_64() + PRE_TRIGGER_FILL_US;
+    la_capture( pio0, GPIO_Z80_CLK, &trigger->trigger,
+		PRE_TRIGGER_SAMPLES, POST_TRIGGER_SAMPLES, capture_still_running, &last_capture );
+
+    /* Cancelled before it got that far */
+    if( release_pending )
+    {
+      gpio_put( GPIO_Z80_RESET, 0 );
+      release_pending = false;
+    }
+
+    summary.triggered      = last_capture.triggered;
+    summary.num_samples    = last_capture.num_samples;
+    summary.trigger_sample = last_capture.trigger_sample;
+    summary.trigger_state  = last_capture.triggered ? la_capture_sample( &last_capture, last_capture.trigger_sample ) : 0;
+  }
+
+  /*
+   * Alarm is done with. If the trigger fired the alarm will still be
+   * pending, so this cancel is needed.
+   */
+  cancel_alarm( capture_alarm_id );
+
+  /* Nobody wants a cancelled capture, don't hold things up sending it to the host */
+  if( sched_cancelled() )
+    return;
+
+  /*
+   * Send the whole capture to the host, if there's one listening. Pico2
+   * sends its own captures out of its own USB port.
+   */
+  if( trigger->on_pico2 )
+  {
+    snprintf( result_line_txt[3], WIDTH_OLED_CHARS, "USB: from Pico2" );
+  }
+  else if( !usb_stream_connected() )
+  {
+    snprintf( result_line_txt[3], WIDTH_OLED_CHARS, "USB: no host" );
+  }
+  else
+  {
+    bool sent = usb_stream_capture( &trigger->trigger, &last_capture, GPIO_Z80_CLK );
+
+    STREAM_STATS stats;
+    usb_stream_stats( &stats );
+    snprintf( result_line_txt[3], WIDTH_OLED_CHARS, "USB: %s, %lu drop",
+	      sent ? "sent" : "failed", stats.frames_dropped );
+  }
+
+  /* Show the result lines */
+  snprintf( result_line_txt[0], WIDTH_OLED_CHARS, "Trig: %s", trigger->name );
+
+  if( summary.triggered )
+  {
+    uint32_t state = summary.trigger_state;
+
+    snprintf( result_line_txt[1], WIDTH_OLED_CHARS, "Pre %lu Post %lu",
+	      summary.trigger_sample, summary.num_samples - summary.trigger_sample - 1 );
+
+    /* The control lines are active low, show the ones which are asserted */
+    if( trigger->on_pico2 )
+    {
+      snprintf( result_line_txt[2], WIDTH_OLED_CHARS, "A=%04lX%s%s",
+		state & 0xFFFF,
+		(state & (1 << 16)) ? "" : " MREQ",
+		(state & (1 << 17)) ? "" : " RD" );
+    }
+    else
+    {
+      snprintf( result_line_txt[2], WIDTH_OLED_CHARS, "D=%02lX%s%s%s%s%s",
+		(state >> GPIO_DBUS_D0) & 0xFF,
+		(state & (1 << GPIO_Z80_M1))   ? "" : " M1",
+		(state & (1 << GPIO_Z80_MREQ)) ? "" : " MREQ",
+		(state & (1 << GPIO_Z80_IORQ)) ? "" : " IORQ",
+		(state & (1 << GPIO_Z80_RD))   ? "" : " RD",
+		(state & (1 << GPIO_Z80_WR))   ? "" : " WR" );
+    }
+  }
+  else
+  {
+    snprintf( result_line_txt[1], WIDTH_OLED_CHARS, "No trigger in %ds", TEST_TIME_SECS );
+    result_line_txt[2][0] = '\0';
+  }
+
+  /*
+   * Repeat test a regular intervals, but don't do it too fast in case the comms
+   * goes a bit funny. No reason it should, but let's not tempt it
+   */
+  sched_sleep_ms(1000);
+}
+
+
+void capture_output(void)
+{
+  uint8_t line=2;
+  for( uint32_t test_index=0; test_index<NUM_CAPTURE_TEST_RESULT_LINES; test_index++ )
+  {
+    draw_str(0, line*8, "                         " );
+    draw_str(0, line*8, result_line_txt[test_index] );
+
+    line++;
+  }
+}
+
+
+/***
+ *       ___            _                  
+ *      / __| __ _  _ __| |_  _  _  _ _  ___ 
+ *     | (__ / _` || '_ \  _|| || || '_|/ -_)
+ *      \___|\__,_|| .__/\__| \_,_||_|  \___|
+ *                 |_|                       
+ */
+const PAGE_DESCRIPTOR capture_page =
+{
+  "CAPTURE",
+  capture_page_init,
+  capture_page_entry,
+  capture_page_run_tests,
+  capture_page_exit,
+  capture_output,
+  { "CAPTURE", SCHED_RES_PIO0 | SCHED_RES_LINK | SCHED_RES_Z80_RESET | SCHED_RES_CORE, 3100 },
+  NULL,
+  false
+};
@@ -0,0 +1,13 @@
+#ifndef __PAGE_CAPTURE_H
+#define __PAGE_CAPTURE_H
+
+#include "page.h"
+#include "hardware/pio.h"
+
+void capture_page_init( void );
+void capture_page_entry( void );
+void capture_page_run_tests( const PICO_LINK *link );
+void capture_output(void);
+void capture_page_exit( void );
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ * Z80 bus cycle tests
+ *
+ * A PIO program watches the control bus and reports the state of the
+ * control lines for each bus cycle the Z80 runs. This code classifies
+ * each one as an opcode fetch, memory read or write, IO read or write,
+ * interrupt acknowledge or refresh, and counts them. The counts are
+ * reported per frame (i.e. per 50Hz interrupt) which gives a sort of
+ * fingerprint of what the machine's doing. A healthy Spectrum running
+ * its ROM has a very consistent pattern.
+ */
+
+#include "oled.h"
+#include "page.h"
+#include "gpios.h"
+
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "scheduler.h"
+#include "z80_reset.h"
+
+#include "hardware/pio.h"
+#include "bus_cycle.pio.h"
+
+#include "baseline.h"
+#include "page_cycles.h"
+
+/* Long enough to let the Spectrum boot and run a decent part of the ROM */
+#define TEST_TIME_SECS   2
+#define TEST_TIME_SECS_F ((float)(TEST_TIME_SECS))
+
+#define NUM_CYCLES_TEST_RESULT_LINES 5
+#define WIDTH_OLED_CHARS 32
+static uint8_t result_line_txt[NUM_CYCLES_TEST_RESULT_LINES][WIDTH_OLED_CHARS+1];
+
+static uint32_t cycle_counter[NUM_BUS_CYCLE_TYPES];
+static uint32_t frame_counter = 0;
+static bool     cycles_overrun = false;
+
+/*
+ * The PIO sends back two 11 bit samples of the pins starting at MREQ,
+ * the first in bits 21-11, the second in bits 10-0. These pull the
+ * interesting lines out of one sample into a 5 bit value.
+ */
+#define SAMPLE_MREQ  0x01
+#define SAMPLE_RD    0x02
+#define SAMPLE_WR    0x04
+#define SAMPLE_M1    0x08
+#define SAMPLE_IORQ  0x10
+
+#define PACK_SAMPLE(s) (((s) & 0x0F) | (((s) >> 6) & SAMPLE_IORQ))
+
+/* Two packed samples index this, giving the cycle type */
+static uint8_t cycle_type_table[1 << 10];
+
+static bool cycles_test_running = false;
+
+static int64_t __time_critical_func(cycles_alarm_callback)(alarm_id_t id, void *user_data)
+{
+  cycles_test_running = false;
+  sched_wake();
+  return 0;
+}
+
+/*
+ * Work out what sort of cycle the two samples describe. All the
+ * signals are active low. This is only used to fill in the lookup
+ * table, the per-cycle work is just the table index.
+ */
+static BUS_CYCLE_TYPE classify_cycle( uint32_t first, uint32_t second )
+{
+  if( !(first & SAMPLE_IORQ) || !(second & SAMPLE_IORQ) )
+  {
+    /* M1 with IORQ is the Z80 acknowledging an interrupt */
+    if( !(first & SAMPLE_M1) )
+      return CYCLE_INT_ACK;
+
+    /* IORQ, RD and WR all go low together, so use the later sample */
+    if( !(second & SAMPLE_WR) )
+      return CYCLE_IO_WRITE;
+
+    return CYCLE_IO_READ;
+  }
+
+  if( !(first & SAMPLE_M1) )
+    return CYCLE_FETCH;
+
+  if( !(first & SAMPLE_RD) || !(second & SAMPLE_RD) )
+    return CYCLE_MEM_READ;
+
+  /* WR comes a clock after MREQ, so only the second sample will have it */
+  if( !(second & SAMPLE_WR) )
+    return CYCLE_MEM_WRITE;
+
+  /* MREQ on its own is the refresh cycle at the end of an opcode fetch */
+  return CYCLE_REFRESH;
+}
+
+/*
+ * Rather than spin doing nothing, this core drains the PIO's results
+ * while the test runs. The PIO's done the hard work, all that's left
+ * here is a table lookup and an increment. The INT line is polled as
+ * well, the frame count is the number of times it's seen going low.
+ * If the user moves on, the test stops early.
+ *
+ * It runs from RAM, so a miss in the flash cache can't hold it up long
+ * enough for the PIO's FIFO to fill.
+ */
+static void __time_critical_func(cycles_drain)( PIO pio, uint sm )
+{
+  bool int_previous = gpio_get( GPIO_Z80_INT );
+  while( cycles_test_running && !sched_cancelled() )
+  {
+    while( !pio_sm_is_rx_fifo_empty( pio, sm ) )
+    {
+      uint32_t samples = pio_sm_get( pio, sm );
+
+      uint32_t index = (PACK_SAMPLE( samples >> 11 ) << 5) | PACK_SAMPLE( samples );
+      cycle_counter[ cycle_type_table[index] ]++;
+    }
+
+    bool int_current = gpio_get( GPIO_Z80_INT );
+    if( int_previous && !int_current )
+      frame_counter++;
+    int_previous = int_current;
+  }
+}
+
+void cycles_page_init( void )
+{
+  for( uint32_t index = 0; index < (1 << 10); index++ )
+  {
+    cycle_type_table[index] = classify_cycle( index >> 5, index & 0x1F );
+  }
+}
+
+void cycles_page_entry( void )
+{
+  for( uint32_t type = 0; type < NUM_BUS_CYCLE_TYPES; type++ )
+    cycle_counter[type] = 0;
+
+  frame_counter  = 0;
+  cycles_overrun = false;
+}
+
+void cycles_page_exit( void )
+{
+  /* Avoid the divide by zero if the INT line is dead, the totals are still useful */
+  uint32_t frames = frame_counter ? frame_counter : 1;
+
+  snprintf( result_line_txt[0], WIDTH_OLED_CHARS, "Per frame (%lu)%s",
+	    frame_counter, cycles_overrun ? "!" : "" );
+  snprintf( result_line_txt[1], WIDTH_OLED_CHARS, "M1 %5lu  RF %5lu",
+	    cycle_counter[CYCLE_FETCH]     / frames, cycle_counter[CYCLE_REFRESH]  / frames );
+  snprintf( result_line_txt[2], WIDTH_OLED_CHARS, "MR %5lu  MW %5lu",
+	    cycle_counter[CYCLE_MEM_READ]  / frames, cycle_counter[CYCLE_MEM_WRITE] / frames );
+  snprintf( result_line_txt[3], WIDTH_OLED_CHARS, "IR %5lu  IW %5lu",
+	    cycle_counter[CYCLE_IO_READ]   / frames, cycle_counter[CYCLE_IO_WRITE]  / frames );
+  snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "IA %5lu",
+	    cycle_counter[CYCLE_INT_ACK]   / frames );
+
+  /* Only a complete run, with a frame count and nothing dropped, is any use to compare */
+  if( !sched_cancelled() && frame_counter && !cycles_overrun )
+  {
+    baseline_report( BASELINE_FETCHES,    cycle_counter[CYCLE_FETCH]     / frames );
+    baseline_report( BASELINE_REFRESHES,  cycle_counter[CYCLE_REFRESH]   / frames );
+    baseline_report( BASELINE_MEM_READS,  cycle_counter[CYCLE_MEM_READ]  / frames );
+    baseline_report( BASELINE_MEM_WRITES, cycle_counter[CYCLE_MEM_WRITE] / frames );
+    baseline_report( BASELINE_IO_READS,   cycle_counter[CYCLE_IO_READ]   / frames );
+    baseline_report( BASELINE_IO_WRITES,  cycle_counter[CYCLE_IO_WRITE]  / frames );
+    baseline_report( BASELINE_INT_ACKS,   cycle_counter[CYCLE_INT_ACK]   / frames );
+  }
+}
+
+void cycles_page_run_tests( const PICO_LINK *link )
+{
+  /* Hardcoded pio0 for this test, the same as the ULA test */
+  const PIO pio = pio0;
+
+  uint32_t offset = pio_add_program( pio, &bus_cycle_program );
+  uint32_t sm     = pio_claim_unused_sm( pio, true );
+
+  bus_cycle_program_init( pio, sm, offset, GPIO_Z80_MREQ, GPIO_Z80_IORQ );
+
+  /*
+   * Restart the Z80. This test runs as the computer boots up and runs the
+   * ROM code. The wait is for the capacitor C27 in the Spectrum to charge
+   * up and release the RESET line, the test's time starts when the Z80 does
+   */
+  z80_restart( Z80_START_TIMEOUT_MS );
+
+  /* Clear the PIO's sticky "dropped a result" flag so I can tell if it happens */
+  pio->fdebug = (1u << (PIO_FDEBUG_RXSTALL_LSB + sm));
+
+  pio_sm_set_enabled( pio, sm, true );
+
+  cycles_test_running = true;
+  alarm_id_t cycles_alarm_id = add_alarm_in_ms( TEST_TIME_SECS*1000, cycles_alarm_callback, NULL, false );
+  if( cycles_alarm_id < 0 )
+    panic("No alarms available in bus cycles test");
+
+  cycles_drain( pio, sm );
+
+  pio_sm_set_enabled( pio, sm, false );
+
+  /* If the PIO ever found its FIFO full, some cycles weren't counted */
+  cycles_overrun = (pio->fdebug & (1u << (PIO_FDEBUG_RXSTALL_LSB + sm))) != 0;
+
+  pio_sm_clear_fifos( pio, sm );
+  pio_sm_unclaim( pio, sm );
+  pio_remove_program( pio, &bus_cycle_program, offset );
+
+  /*
+   * Alarm is done with, this reset isn't necessary but if I change the
+   * timing system something else might need to go here
+   */
+  cancel_alarm( cycles_alarm_id );
+}
+
+
+void cycles_output(void)
+{
+  uint8_t line=2;
+  for( uint32_t test_index=0; test_index<NUM_CYCLES_TEST_RESULT_LINES; test_index++ )
+  {
+    draw_str(0, line*8, "                         " );
+    draw_str(0, line*8, result_line_txt[test_index] );
+
+    line++;
+  }
+}
+
+
+/***
+ *       ___           _           
+ *      / __|_  _  __ | | ___  ___ 
+ *     | (__| || |/ _|| |/ -_)(_-< 
+ *      \___|\_, |\__||_|\___|/__/ 
+ *           |__/                  
+ */
+const PAGE_DESCRIPTOR cycles_page =
+{
+  "BUS CYCLES",
+  cycles_page_init,
+  cycles_page_entry,
+  cycles_page_run_tests,
+  cycles_page_exit,
+  cycles_output,
+  { "CYCLES", SCHED_RES_PIO0 | SCHED_RES_Z80_RESET | SCHED_RES_CORE, 2700 },
+  NULL,
+  false
+};
@@ -0,0 +1,28 @@
+#ifndef __PAGE_CYCLES_H
+#define __PAGE_CYCLES_H
+
+#include <stdint.h>
+#include "page.h"
+
+/* The types of bus cycle the Z80 runs */
+typedef enum
+{
+  CYCLE_FETCH = 0,
+  CYCLE_MEM_READ,
+  CYCLE_MEM_WRITE,
+  CYCLE_IO_READ,
+  CYCLE_IO_WRITE,
+  CYCLE_INT_ACK,
+  CYCLE_REFRESH,
+
+  NUM_BUS_CYCLE_TYPES
+}
+BUS_CYCLE_TYPE;
+
+void cycles_page_init( void );
+void cycles_page_entry( void );
+void cycles_page_run_tests( const PICO_LINK *link );
+void cycles_output(void);
+void cycles_page_exit( void );
+
+#endif
@@ -11,6 +11,11 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "scheduler.h"
+#include "gpio_irq.h"
+#include "z80_reset.h"
+#include "result_log.h"
+
 /* Long enough to let the Spectrum boot and run a decent part of the ROM */
 #define TEST_TIME_SECS   2
 #define TEST_TIME_SECS_F ((float)(TEST_TIME_SECS))
@@ -21,7 +26,7 @@ static uint8_t result_line_txt[NUM_DBUS_TEST_RESULT_LINES][WIDTH_OLED_CHARS+1];
 
 #define NUM_DBUS_LINES 8
 
-static EDGE_STATUS bus_status[NUM_DBUS_LINES ] =
+static volatile EDGE_STATUS bus_status[NUM_DBUS_LINES ] =
 {
   {SEEN_NEITHER, GPIO_DBUS_D0},
   {SEEN_NEITHER, GPIO_DBUS_D1},
@@ -38,6 +43,7 @@ static bool dbus_test_running = false;
 static int64_t __time_critical_func(dbus_alarm_callback)(alarm_id_t id, void *user_data)
 {
   dbus_test_running = false;
+  sched_wake();
   return 0;
 }
 
@@ -52,14 +58,57 @@ void dbus_page_init( void )
   }
 }
 
+/*
+ * One of the data bus GPIOs has changed state. The context is its entry
+ * in bus_status. Note whether it was rising or falling. If it's been seen
+ * doing both, its behaviour is confirmed as correct and the interrupt is
+ * switched off. When that's the last of them the test's done, there's no
+ * need to wait for the alarm.
+ */
+static void __time_critical_func(dbus_edge_handler)( uint32_t gpio, uint32_t events, void *context )
+{
+  volatile EDGE_STATUS *status = (volatile EDGE_STATUS*)context;
+
+  if( dbus_test_running )
+  {
+    if( events & GPIO_IRQ_EDGE_FALL )
+    {
+      status->flag |= SEEN_FALLING;
+    }
+    if( events & GPIO_IRQ_EDGE_RISE )
+    {
+      status->flag |= SEEN_RISING;
+    }
+
+    if( status->flag == SEEN_BOTH )
+    {
+      gpio_irq_mute( gpio );
+
+      uint32_t bus_index;
+      for( bus_index=0; bus_index<NUM_DBUS_LINES; bus_index++ )
+      {
+	if( bus_status[bus_index].flag != SEEN_BOTH )
+	  break;
+      }
+
+      if( bus_index == NUM_DBUS_LINES )
+      {
+	dbus_test_running = false;
+	sched_wake();
+      }
+    }
+  }
+}
+
 void dbus_page_entry( void )
 {
   /* Need to hold the Z80 offline while I set these up or they fire too early */
-  gpio_put( GPIO_Z80_RESET, 1 ); sleep_ms( 650 );
+  z80_reset_hold();
 
   for( uint32_t bus_index=0; bus_index<NUM_DBUS_LINES; bus_index++ )
   {
-    gpio_set_irq_enabled( bus_status[bus_index].gpio, GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, true );
+    gpio_irq_register( bus_status[bus_index].gpio, GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE,
+		       dbus_edge_handler, (void*)&bus_status[bus_index] );
   }
 }
 
@@ -67,7 +116,7 @@ void dbus_page_exit( void )
 {
   for( uint32_t bus_index=0; bus_index<NUM_DBUS_LINES; bus_index++ )
   {
-    gpio_set_irq_enabled( bus_status[bus_index].gpio, GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, false );
+    gpio_irq_unregister( bus_status[bus_index].gpio );
   }
 
   snprintf( result_line_txt[0], WIDTH_OLED_CHARS, "        76543210" );
@@ -110,52 +159,32 @@ void dbus_page_exit( void )
 	      bus_status[1].flag == SEEN_BOTH ? '.' : gpio_get( bus_status[1].gpio ) ? 'H' : 'L',
 	      bus_status[0].flag == SEEN_BOTH ? '.' : gpio_get( bus_status[0].gpio ) ? 'H' : 'L');
   }
-}
 
-void dbus_page_gpios( uint32_t gpio, uint32_t events )
-{
-  if( dbus_test_running )
+  /* Save which lines are stuck, and which way, unless the run was cut short */
+  if( !sched_cancelled() )
   {
-    if( (gpio >= GPIO_DBUS_D0) && (gpio <= GPIO_DBUS_D7) )
+    RESULT_LOG_BUS_DATA saved = { 0, 0 };
+    for( uint32_t bus_index=0; bus_index<NUM_DBUS_LINES; bus_index++ )
     {
-      uint line_index = gpio - GPIO_DBUS_D0;
- 
-      /*
-       * One of the data bus GPIOs has changed state. Note whether it was
-       * rising or falling. If it's been seen doing both, it behaviour is
-       * confirmed as correct and the GPIO callback is switched off.
-       */
-
-      if( events | GPIO_IRQ_EDGE_FALL )
-      {
-	bus_status[line_index].flag |= SEEN_FALLING;
-      }
-      if( events | GPIO_IRQ_EDGE_RISE )
-      {
-	bus_status[line_index].flag |= SEEN_RISING;
-      }
-
-      if( bus_status[line_index].flag == SEEN_BOTH )
+      if( bus_status[bus_index].flag != SEEN_BOTH )
       {
-	gpio_set_irq_enabled( bus_status[line_index].gpio, GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, false );
+	saved.stuck |= (1 << bus_index);
+	if( gpio_get( bus_status[bus_index].gpio ) )
+	  saved.level |= (1 << bus_index);
       }
     }
-    else
-    {
-      panic("DBUS code received invalid GPIO %d", gpio);
-    }
+    result_log_add( RESULT_LOG_DBUS, &saved, sizeof(saved) );
   }
 }
 
-void dbus_page_run_tests( void )
+void dbus_page_run_tests( const PICO_LINK *link )
 {
   dbus_test_running = false;
 
   /*
    * Reboot the Spectrum.
    */
-  gpio_put( GPIO_Z80_RESET, 1 ); sleep_ms( 5 );
-  gpio_put( GPIO_Z80_RESET, 0 );
+  z80_reset_hold();
 
   /*
    * I had a 
@@ -168,15 +197,21 @@ void dbus_page_run_tests( void )
    * before the code below which sets up the alarm. The alarm never happens
    * and the test apparently runs forever.
    * Maybe, not sure, but taking that sleep out fixes it.
+   *
+   * Now it waits for the Z80 to start, so the test gets its full time with
+   * the Z80 running. The lines are watched from before it's let go, so each
+   * one's switched off as soon as it's been seen both ways and there's no
+   * flood. Nothing moves on the data bus while the Z80's in reset anyway.
    */
-
-  /* Start the alarm which defines the duration of the test */
   dbus_test_running = true;
+  z80_reset_release( Z80_START_TIMEOUT_MS );
+
+  /* Start the alarm which defines the longest the test can take, it usually ends sooner */
   alarm_id_t dbus_alarm_id = add_alarm_in_ms( TEST_TIME_SECS*1000, dbus_alarm_callback, NULL, false );
   if( dbus_alarm_id < 0 )
     panic("No alarms available in DBUS test");
 
-  while( dbus_test_running );
+  sched_wait( &dbus_test_running );
 
   /*
    * Alarm is done with, this reset isn't necessary but if I change the
@@ -197,3 +232,24 @@ void dbus_output(void)
     line++;
   }  
 }
+
+
+/***
+ *      ___         _           ___           
+ *     |   \  __ _ | |_  __ _  | _ ) _  _  ___
+ *     | |) |/ _` ||  _|/ _` | | _ \| || |(_-<
+ *     |___/ \__,_| \__|\__,_| |___/ \_,_|/__/
+ *                                            
+ */
+const PAGE_DESCRIPTOR dbus_page =
+{
+  "DATA BUS",
+  dbus_page_init,
+  dbus_page_entry,
+  dbus_page_run_tests,
+  dbus_page_exit,
+  dbus_output,
+  { "DBUS", SCHED_RES_GPIO_IRQ | SCHED_RES_Z80_RESET, 2700 },
+  NULL,
+  false
+};
@@ -5,8 +5,7 @@
 
 void dbus_page_init( void );
 void dbus_page_entry( void );
-void dbus_page_gpios( uint32_t gpio, uint32_t events );
-void dbus_page_run_tests( void );
+void dbus_page_run_tests( const PICO_LINK *link );
 void dbus_output(void);
 void dbus_page_exit( void );
 
@@ -0,0 +1,24 @@
+/*
+ * The pages, in the order the button steps through them. Each one is a
+ * PAGE_DESCRIPTOR called <name>_page, defined in its page_*.c file.
+ * Hidden pages are skipped, a long press of the button gets to those.
+ *
+ * This file is included more than once, with PAGE_ENTRY defined to do
+ * different things, so it has no include guard.
+ */
+
+PAGE_ENTRY( voltage )
+PAGE_ENTRY( ula )
+PAGE_ENTRY( z80 )
+PAGE_ENTRY( cycles )
+PAGE_ENTRY( dbus )
+PAGE_ENTRY( abus )
+PAGE_ENTRY( rom )
+PAGE_ENTRY( boot )
+PAGE_ENTRY( reset )
+PAGE_ENTRY( refresh )
+PAGE_ENTRY( capture )
+PAGE_ENTRY( self )
+PAGE_ENTRY( log )
+PAGE_ENTRY( baseline )
+PAGE_ENTRY( baseline_set )
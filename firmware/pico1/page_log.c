@@ -0,0 +1,121 @@
+/*
+ * Result log page
+ *
+ * Shows the most recent results kept in flash, newest first, so what a
+ * machine was doing before it was last switched off can be seen. Each
+ * line starts with the power up it came from and how many minutes into
+ * it. It's hidden from the normal button cycle, a long press gets to it.
+ */
+
+#include "oled.h"
+#include "page.h"
+
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "scheduler.h"
+#include "result_log.h"
+#include "page_log.h"
+
+#define NUM_LOG_RESULT_LINES 6
+#define WIDTH_OLED_CHARS 32
+static uint8_t result_line_txt[NUM_LOG_RESULT_LINES][WIDTH_OLED_CHARS+1];
+
+static void format_record( uint8_t *txt, const RESULT_LOG_RECORD *record )
+{
+  char when[12];
+  snprintf( when, sizeof(when), "%lu:%lum", record->boot, record->time_ms / 60000 );
+
+  switch( record->type )
+  {
+  case RESULT_LOG_VOLTAGES:
+  {
+    RESULT_LOG_VOLTAGES_DATA v;
+    memcpy( &v, record->data, sizeof(v) );
+    snprintf( txt, WIDTH_OLED_CHARS, "%s V %0.2f %0.1f %0.1f", when,
+	      v.plus5_mv / 1000.0, v.plus12_mv / 1000.0, v.minus5_mv / 1000.0 );
+  }
+  break;
+
+  case RESULT_LOG_CLOCKS:
+  {
+    RESULT_LOG_CLOCKS_DATA c;
+    memcpy( &c, record->data, sizeof(c) );
+    snprintf( txt, WIDTH_OLED_CHARS, "%s INT %0.1f %0.2f/%0.2f", when,
+	      c.int_centihz / 100.0, c.clk_hz / 1000000.0, c.c_clk_hz / 1000000.0 );
+  }
+  break;
+
+  case RESULT_LOG_ABUS:
+  case RESULT_LOG_DBUS:
+  {
+    RESULT_LOG_BUS_DATA b;
+    memcpy( &b, record->data, sizeof(b) );
+    if( b.stuck == 0 )
+      snprintf( txt, WIDTH_OLED_CHARS, "%s %cBUS ok", when, (record->type == RESULT_LOG_ABUS) ? 'A' : 'D' );
+    else
+      snprintf( txt, WIDTH_OLED_CHARS, "%s %cBUS stuck %04X", when, (record->type == RESULT_LOG_ABUS) ? 'A' : 'D', b.stuck );
+  }
+  break;
+
+  default:
+    snprintf( txt, WIDTH_OLED_CHARS, "%s type %u?", when, record->type );
+    break;
+  }
+}
+
+void log_page_run_tests( const PICO_LINK *link )
+{
+  RESULT_LOG_RECORD record[NUM_LOG_RESULT_LINES-1];
+  uint32_t found = result_log_latest( record, NUM_LOG_RESULT_LINES-1 );
+
+  snprintf( result_line_txt[0], WIDTH_OLED_CHARS, "This is power up %lu", result_log_boot() );
+
+  for( uint32_t index = 0; index < NUM_LOG_RESULT_LINES-1; index++ )
+  {
+    if( index < found )
+      format_record( result_line_txt[index+1], &record[index] );
+    else
+      result_line_txt[index+1][0] = '\0';
+  }
+
+  if( found == 0 )
+    snprintf( result_line_txt[1], WIDTH_OLED_CHARS, "Nothing saved yet" );
+
+  sched_sleep_ms(1000);
+}
+
+
+void log_output(void)
+{
+  uint8_t line=2;
+  for( uint32_t test_index=0; test_index<NUM_LOG_RESULT_LINES; test_index++ )
+  {
+    draw_str(0, line*8, "                         " );
+    draw_str(0, line*8, result_line_txt[test_index] );
+
+    line++;
+  }
+}
+
+
+/***
+ *      _                
+ *     | |    ___  __ _ 
+ *     | |__ / _ \/ _` |
+ *     |____|\___/\__, |
+ *                |___/ 
+ */
+const PAGE_DESCRIPTOR log_page =
+{
+  "RESULT LOG",
+  NULL,
+  NULL,
+  log_page_run_tests,
+  NULL,
+  log_output,
+  { "LOG", SCHED_RES_NONE, 1000 },
+  NULL,
+  true
+};
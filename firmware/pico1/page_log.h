@@ -0,0 +1,9 @@
+#ifndef __PAGE_LOG_H
+#define __PAGE_LOG_H
+
+#include "page.h"
+
+void log_page_run_tests( const PICO_LINK *link );
+void log_output(void);
+
+#endif
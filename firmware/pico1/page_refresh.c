@@ -0,0 +1,182 @@
+/*
+ * DRAM refresh tests
+ */
+
+#include "oled.h"
+#include "page.h"
+#include "gpios.h"
+
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "scheduler.h"
+
+#include "test_data.h"
+#include "link_common.h"
+#include "pico_comm.h"
+#include "z80_reset.h"
+
+#define NUM_REFRESH_TEST_RESULT_LINES 5
+#define WIDTH_OLED_CHARS 32
+static uint8_t result_line_txt[NUM_REFRESH_TEST_RESULT_LINES][WIDTH_OLED_CHARS+1];
+
+/* Long enough to let the Spectrum boot and run a decent part of the ROM */
+#define TEST_TIME_SECS   2
+#define TEST_TIME_SECS_F ((float)(TEST_TIME_SECS))
+
+/* The 4116 datasheet says every row must be refreshed within 2ms */
+#define MAX_REFRESH_GAP_US 2000
+
+static bool refresh_test_running = false;
+
+static int64_t __time_critical_func(refresh_alarm_callback)(alarm_id_t id, void *user_data)
+{
+  refresh_test_running = false;
+  sched_wake();
+  return 0;
+}
+
+void refresh_page_init( void )
+{
+}
+
+void refresh_page_entry( void )
+{
+}
+
+void refresh_page_exit( void )
+{
+}
+
+void refresh_page_run_tests( const PICO_LINK *link )
+{
+  PIO linkin_pio  = link->linkin_pio;
+  PIO linkout_pio = link->linkout_pio;
+  int linkin_sm   = link->linkin_sm;
+  int linkout_sm  = link->linkout_sm;
+
+  refresh_test_running = false;
+
+  /*
+   * Reboot the Spectrum. It's held in reset until the other Pico's
+   * watching, then the test's time starts when the Z80 does.
+   */
+  z80_reset_hold();
+
+  /* Tell the other Pico which test to run */
+  if( !pico_comm_request( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_TEST_REFRESH, NULL, 0 ) )
+  {
+    gpio_put( GPIO_Z80_RESET, 0 );
+    pico_comm_show_status( PICO_COMM_NO_RESPONSE, result_line_txt[0], sizeof(result_line_txt[0]), NUM_REFRESH_TEST_RESULT_LINES );
+    return;
+  }
+
+  /* Flag the other Pico, which monitors the address bus, then let the Z80 go */
+  gpio_put( GPIO_P1_SIGNAL, 1 );
+  busy_wait_us_32( Z80_WATCH_DELAY_US );
+  z80_reset_release( Z80_START_TIMEOUT_MS );
+
+  /* Start the alarm which defines the duration of the test */
+  refresh_test_running = true;
+  alarm_id_t refresh_alarm_id = add_alarm_in_ms( TEST_TIME_SECS*1000, refresh_alarm_callback, NULL, false );
+  if( refresh_alarm_id < 0 )
+    panic("No alarms available in refresh test");
+
+  /* Cancelling the test cuts this short, the other Pico still replies */
+  sched_wait( &refresh_test_running );
+
+  /* Remove flag to stop the other Pico collecting refresh addresses */
+  gpio_put( GPIO_P1_SIGNAL, 0 );
+
+  /*
+   * Alarm is done with, this reset isn't necessary but if I change the
+   * timing system something else might need to go here
+   */
+  cancel_alarm( refresh_alarm_id );
+
+  /* Other Pico sends the rows it saw and how often it saw them */
+  REFRESH_RESULT result;
+  PICO_COMM_STATUS status = pico_comm_response( linkin_pio, linkin_sm, linkout_sm, PICO_COMM_TEST_REFRESH, &result, sizeof(result), NULL );
+  if( status != PICO_COMM_OK )
+  {
+    pico_comm_show_status( status, result_line_txt[0], sizeof(result_line_txt[0]), NUM_REFRESH_TEST_RESULT_LINES );
+    return;
+  }
+
+  uint32_t rows_seen = 0;
+  for( uint32_t row = 0; row < NUM_REFRESH_ROWS; row++ )
+  {
+    if( result.rows_seen[row >> 3] & (1 << (row & 7)) )
+      rows_seen++;
+  }
+
+  /* Refreshes per millisecond is a handier number than per second */
+  uint32_t elapsed_ms = result.elapsed_us / 1000;
+  if( elapsed_ms == 0 )
+    elapsed_ms = 1;
+
+  /* Show the result lines */
+  snprintf( result_line_txt[0], WIDTH_OLED_CHARS, " Rows: %lu/%d%s",
+	    rows_seen, NUM_REFRESH_ROWS, result.overrun ? "!" : "" );
+  snprintf( result_line_txt[1], WIDTH_OLED_CHARS, " Rate: %lu/ms", result.refresh_count / elapsed_ms );
+  snprintf( result_line_txt[2], WIDTH_OLED_CHARS, "  Gap: %luus max", result.max_gap_us );
+  result_line_txt[3][0] = '\0';
+
+  if( rows_seen == 0 )
+  {
+    snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "No refresh seen" );
+  }
+  else if( rows_seen != NUM_REFRESH_ROWS )
+  {
+    snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "Rows missing" );
+  }
+  else if( result.max_gap_us > MAX_REFRESH_GAP_US )
+  {
+    snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "Refresh too slow" );
+  }
+  else
+  {
+    snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "Refresh OK" );
+  }
+
+  /*
+   * Repeat test a regular intervals, but don't do it too fast in case the comms
+   * goes a bit funny. No reason it should, but let's not tempt it
+   */
+  sched_sleep_ms(1000);
+}
+
+
+void refresh_output(void)
+{
+  uint8_t line=2;
+  for( uint32_t test_index=0; test_index<NUM_REFRESH_TEST_RESULT_LINES; test_index++ )
+  {
+    draw_str(0, line*8, "                         " );
+    draw_str(0, line*8, result_line_txt[test_index] );
+
+    line++;
+  }
+}
+
+
+/***
+ *      ___          __                  _    
+ *     | _ \ ___  / _| _ _  ___  ___ | |_  
+ *     |   // -_)|  _|| '_|/ -_)(_-< | ' \ 
+ *     |_|_\\___||_|  |_|  \___|/__/ |_||_|
+ *                                          
+ */
+const PAGE_DESCRIPTOR refresh_page =
+{
+  "REFRESH",
+  refresh_page_init,
+  refresh_page_entry,
+  refresh_page_run_tests,
+  refresh_page_exit,
+  refresh_output,
+  { "REFRESH", SCHED_RES_LINK | SCHED_RES_Z80_RESET, 3100 },
+  NULL,
+  false
+};
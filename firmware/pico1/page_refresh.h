@@ -0,0 +1,13 @@
+#ifndef __PAGE_REFRESH_H
+#define __PAGE_REFRESH_H
+
+#include "page.h"
+#include "hardware/pio.h"
+
+void refresh_page_init( void );
+void refresh_page_entry( void );
+void refresh_page_run_tests( const PICO_LINK *link );
+void refresh_output(void);
+void refresh_page_exit( void );
+
+#endif
@@ -0,0 +1,216 @@
+/*
+ * Reset jitter, how cleanly the Z80 comes out of reset
+ */
+
+#include "oled.h"
+#include "page.h"
+#include "gpios.h"
+
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "scheduler.h"
+
+#include "test_data.h"
+#include "link_common.h"
+#include "pico_comm.h"
+#include "z80_reset.h"
+
+#define NUM_RESET_TEST_RESULT_LINES 6
+#define WIDTH_OLED_CHARS 32
+static uint8_t result_line_txt[NUM_RESET_TEST_RESULT_LINES][WIDTH_OLED_CHARS+1];
+
+/*
+ * C27 can take up to Z80_START_TIMEOUT_MS to let the Z80 go, and it might
+ * bounce a while after that. This leaves well over a second of watching
+ * once it's started, however slow it was.
+ */
+#define TEST_TIME_SECS   2
+#define TEST_TIME_SECS_F ((float)(TEST_TIME_SECS))
+
+static bool reset_test_running = false;
+
+static int64_t __time_critical_func(reset_alarm_callback)(alarm_id_t id, void *user_data)
+{
+  reset_test_running = false;
+  sched_wake();
+  return 0;
+}
+
+/* CLK cycles, in thousands once they get long */
+static void format_clk( uint8_t *buffer, uint32_t size, uint32_t clk )
+{
+  if( clk < 100000 )
+    snprintf( buffer, size, "%lu", clk );
+  else
+    snprintf( buffer, size, "%luk", clk / 1000 );
+}
+
+void reset_page_init( void )
+{
+}
+
+void reset_page_entry( void )
+{
+}
+
+void reset_page_exit( void )
+{
+}
+
+void reset_page_run_tests( const PICO_LINK *link )
+{
+  PIO linkin_pio  = link->linkin_pio;
+  PIO linkout_pio = link->linkout_pio;
+  int linkin_sm   = link->linkin_sm;
+  int linkout_sm  = link->linkout_sm;
+
+  reset_test_running = false;
+
+  /*
+   * Hold the Spectrum in reset. It's let go once the other Pico's
+   * watching, so it sees every start, and knows when reset was.
+   */
+  z80_reset_hold();
+
+  /* Tell the other Pico which test to run */
+  RESET_PARAMS params = { Z80_WATCH_DELAY_US };
+  if( !pico_comm_request( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_TEST_RESET, &params, sizeof(params) ) )
+  {
+    gpio_put( GPIO_Z80_RESET, 0 );
+    pico_comm_show_status( PICO_COMM_NO_RESPONSE, result_line_txt[0], sizeof(result_line_txt[0]), NUM_RESET_TEST_RESULT_LINES );
+    return;
+  }
+
+  /* Flag the other Pico, which monitors the address bus, then let the Z80 go */
+  gpio_put( GPIO_P1_SIGNAL, 1 );
+  busy_wait_us_32( Z80_WATCH_DELAY_US );
+  gpio_put( GPIO_Z80_RESET, 0 );
+
+  /* Start the alarm which defines the duration of the test */
+  reset_test_running = true;
+  alarm_id_t reset_alarm_id = add_alarm_in_ms( TEST_TIME_SECS*1000, reset_alarm_callback, NULL, false );
+  if( reset_alarm_id < 0 )
+    panic("No alarms available in reset test");
+
+  /* Cancelling the test cuts this short, the other Pico still replies */
+  sched_wait( &reset_test_running );
+
+  /* Remove flag to stop the other Pico watching */
+  gpio_put( GPIO_P1_SIGNAL, 0 );
+
+  /*
+   * Alarm is done with, this reset isn't necessary but if I change the
+   * timing system something else might need to go here
+   */
+  cancel_alarm( reset_alarm_id );
+
+  /* Other Pico sends how many times the Z80 started from 0x0000, and when */
+  RESET_RESULT result;
+  PICO_COMM_STATUS status = pico_comm_response( linkin_pio, linkin_sm, linkout_sm, PICO_COMM_TEST_RESET, &result, sizeof(result), NULL );
+  if( status != PICO_COMM_OK )
+  {
+    pico_comm_show_status( status, result_line_txt[0], sizeof(result_line_txt[0]), NUM_RESET_TEST_RESULT_LINES );
+    return;
+  }
+
+  /* Show the result lines, the times are CLK cycles from letting go of reset */
+  uint8_t first[12], last[12], shortest[12], longest[12];
+  format_clk( first,    sizeof(first),    result.first_start  );
+  format_clk( last,     sizeof(last),     result.last_start   );
+  format_clk( shortest, sizeof(shortest), result.shortest_run );
+  format_clk( longest,  sizeof(longest),  result.longest_run  );
+
+  snprintf( result_line_txt[0], WIDTH_OLED_CHARS, " Starts:  %lu", result.starts );
+  if( result.starts == 0 )
+  {
+    result_line_txt[1][0] = '\0';
+    result_line_txt[2][0] = '\0';
+  }
+  else
+  {
+    snprintf( result_line_txt[1], WIDTH_OLED_CHARS, " First:   %s", first );
+    snprintf( result_line_txt[2], WIDTH_OLED_CHARS, " Settled: %s", last );
+  }
+
+  if( result.starts < 2 )
+    result_line_txt[3][0] = '\0';
+  else
+    snprintf( result_line_txt[3], WIDTH_OLED_CHARS, " Runs:    %s-%s", shortest, longest );
+
+  /*
+   * If it was still restarting in the last quarter of the time it was
+   * watched for once it first started, there's no saying it had stopped.
+   * It's from the first start, not the release, or a slow C27 would eat
+   * into the time and look like a reset which doesn't settle.
+   */
+  if( result.starts == 0 )
+  {
+    snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "No start from 0000" );
+  }
+  else if( (result.starts > 1) &&
+	   (result.window - result.last_start < (result.window - result.first_start) / 4) )
+  {
+    snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "Reset not settling" );
+  }
+  else if( result.starts > 1 )
+  {
+    snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "Reset bounced" );
+  }
+  else
+  {
+    snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "Reset clean" );
+  }
+
+  if( result.rate.t_states == 0 )
+  {
+    snprintf( result_line_txt[5], WIDTH_OLED_CHARS, "No CLK, times unknown" );
+  }
+  else
+  {
+    uint32_t per_t_state = (uint32_t)(((uint64_t)result.rate.samples * 100) / result.rate.t_states);
+    snprintf( result_line_txt[5], WIDTH_OLED_CHARS, "Samples/T %lu.%02lu%s",
+	      per_t_state / 100, per_t_state % 100, SAMPLE_RATE_TRUSTWORTHY( result.rate ) ? "" : " LOW" );
+  }
+
+  /*
+   * Repeat test a regular intervals, but don't do it too fast in case the comms
+   * goes a bit funny. No reason it should, but let's not tempt it
+   */
+  sched_sleep_ms(1000);
+}
+
+
+void reset_output(void)
+{
+  uint8_t line=2;
+  for( uint32_t test_index=0; test_index<NUM_RESET_TEST_RESULT_LINES; test_index++ )
+  {
+    draw_str(0, line*8, "                         " );
+    draw_str(0, line*8, result_line_txt[test_index] );
+
+    line++;
+  }
+}
+
+
+/***
+ *      ___                _   
+ *     | _ \ ___  ___ ___ | |_ 
+ *     |   // -_)(_-</ -_)|  _|
+ *     |_|_\\___|/__/\___| \__|
+ *                             
+ */
+const PAGE_DESCRIPTOR reset_page =
+{
+  "RESET",
+  reset_page_init,
+  reset_page_entry,
+  reset_page_run_tests,
+  reset_page_exit,
+  reset_output,
+  { "RESET", SCHED_RES_LINK | SCHED_RES_Z80_RESET, 3100 },
+  NULL,
+  false
+};
@@ -0,0 +1,13 @@
+#ifndef __PAGE_RESET_H
+#define __PAGE_RESET_H
+
+#include "page.h"
+#include "hardware/pio.h"
+
+void reset_page_init( void );
+void reset_page_entry( void );
+void reset_page_run_tests( const PICO_LINK *link );
+void reset_output(void);
+void reset_page_exit( void );
+
+#endif
@@ -10,9 +10,15 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "scheduler.h"
+
 #include "link_common.h"
+#include "pico_comm.h"
+#include "z80_reset.h"
+#include "test_data.h"
+#include "baseline.h"
 
-#define NUM_ROM_TESTS 1
+#define NUM_ROM_TESTS 3
 #define WIDTH_OLED_CHARS 32
 static uint8_t result_line_txt[NUM_ROM_TESTS][WIDTH_OLED_CHARS+1];
 
@@ -20,18 +26,111 @@ static uint8_t result_line_txt[NUM_ROM_TESTS][WIDTH_OLED_CHARS+1];
 #define TEST_TIME_SECS   2
 #define TEST_TIME_SECS_F ((float)(TEST_TIME_SECS))
 
-#define PICO_COMM_TEST_ROM  0x04030201
+/*
+ * The sequences of addresses the Z80 reads from as it starts running each
+ * ROM I know about, in order of preference if more than one turns up.
+ * They're all sent to the other Pico, which says which it saw, so the ROM
+ * which is fitted is identified without having to be told. Another ROM
+ * is another entry, up to ROM_MAX_PATTERNS of them and ROM_MAX_SYMBOLS
+ * addresses between them.
+ *
+ * 16K and 48K machines have the same ROM. The instruction at 0x11E0 is a
+ * jump back to the start of the loop which does the RAM check. I chose
+ * that as the rather arbitrary point to stop. If this sequence appears on
+ * the address bus the Z80 and ROM are clearly communicating at least
+ * reasonably well.
+ */
+static const uint16_t sequence_48k[] = {
+  0x0000, 0x0001, 0x0002, 0x0003,
+  0x0004, 0x0005, 0x0006, 0x0007,
+  0x11cb, 0x11cc, 0x11cd, 0x11ce,
+  0x11cf, 0x11d0, 0x11d1, 0x11d2,
+  0x11d3, 0x11d4, 0x11d5, 0x11d6,
+  0x11d7, 0x11d8, 0x11d9, 0x11da,
+  0x11db, 0x11dc, 0x11dd, 0x11de,
+  0x11df, 0x11e0
+};
+
+/*
+ * The 128K's editor ROM, which starts with a delay loop at 0x0004 while
+ * the machine settles. Twice round the loop is plenty to know it.
+ */
+static const uint16_t sequence_128k[] = {
+  0x0000, 0x0001, 0x0002, 0x0003,
+  0x0004, 0x0005, 0x0006, 0x0007, 0x0008,
+  0x0004, 0x0005, 0x0006, 0x0007, 0x0008,
+  0x0004
+};
+
+typedef struct
+{
+  uint8_t        *name;
+  const uint16_t *sequence;
+  uint32_t        length;
+}
+ROM_SIGNATURE;
+
+#define ROM_SIGNATURE_ENTRY(name,sequence) { name, sequence, sizeof(sequence) / sizeof(sequence[0]) }
+
+static const ROM_SIGNATURE rom_signature[] =
+{
+  ROM_SIGNATURE_ENTRY( "16K/48K", sequence_48k  ),
+  ROM_SIGNATURE_ENTRY( "128K",    sequence_128k ),
+};
+#define NUM_ROM_SIGNATURES (sizeof(rom_signature) / sizeof(ROM_SIGNATURE))
+
+/* The parameters for the other Pico, they're the same every time */
+static ROM_PARAMS rom_params;
 
 static bool rom_test_running = false;
 
 static int64_t __time_critical_func(rom_alarm_callback)(alarm_id_t id, void *user_data)
 {
   rom_test_running = false;
+  sched_wake();
   return 0;
 }
 
+/*
+ * The other Pico stops once its buffer's full, which is well inside the
+ * test's time. Its answer starting to arrive ends the test, the alarm's
+ * only for a Spectrum which doesn't read enough to fill it.
+ */
+static int64_t __time_critical_func(rom_reply_callback)(alarm_id_t id, void *user_data)
+{
+  const PICO_LINK *link = (const PICO_LINK*)user_data;
+
+  if( !rom_test_running )
+    return 0;
+
+  if( pico_comm_response_started( link->linkin_pio, link->linkin_sm ) )
+  {
+    rom_test_running = false;
+    sched_wake();
+    return 0;
+  }
+
+  return PICO_COMM_POLL_US;
+}
+
 void rom_page_init( void )
 {
+  if( NUM_ROM_SIGNATURES > ROM_MAX_PATTERNS )
+    panic("Too many ROM signatures");
+
+  rom_params.capture_length = ROM_MAX_CAPTURE;
+  rom_params.num_patterns   = NUM_ROM_SIGNATURES;
+
+  uint32_t num_symbols = 0;
+  for( uint32_t rom = 0; rom < NUM_ROM_SIGNATURES; rom++ )
+  {
+    if( num_symbols + rom_signature[rom].length > ROM_MAX_SYMBOLS )
+      panic("ROM signatures are too long");
+
+    rom_params.pattern_length[rom] = rom_signature[rom].length;
+    memcpy( &rom_params.symbols[num_symbols], rom_signature[rom].sequence, rom_signature[rom].length * sizeof(uint16_t) );
+    num_symbols += rom_signature[rom].length;
+  }
 }
 
 void rom_page_entry( void )
@@ -42,12 +141,13 @@ void rom_page_exit( void )
 {
 }
 
-void rom_page_gpios( uint32_t gpio, uint32_t events )
+void rom_page_run_seq_test( const PICO_LINK *link )
 {
-}
+  PIO linkin_pio  = link->linkin_pio;
+  PIO linkout_pio = link->linkout_pio;
+  int linkin_sm   = link->linkin_sm;
+  int linkout_sm  = link->linkout_sm;
 
-void rom_page_run_seq_test( PIO linkin_pio, PIO linkout_pio, int linkin_sm, int linkout_sm )
-{
 #if 0
   /* LED can be useful for this one */
   const uint LED_PIN = PICO_DEFAULT_LED_PIN;
@@ -58,26 +158,37 @@ void rom_page_run_seq_test( PIO linkin_pio, PIO linkout_pio, int linkin_sm, int
   rom_test_running = false;
 
   /*
-   * Reboot the Spectrum.
+   * Reboot the Spectrum. It's held in reset until the other Pico's
+   * watching, the start up sequences begin with the very first read.
    */
-  gpio_put( GPIO_Z80_RESET, 1 ); sleep_ms( 5 );
-  gpio_put( GPIO_Z80_RESET, 0 );
+  z80_reset_hold();
 
-  /* Tell the other Pico which test to run */
-  uint32_t test_type = PICO_COMM_TEST_ROM;
-  ui_link_send_buffer( linkout_pio, linkout_sm, linkin_sm, (uint8_t*)&test_type, sizeof(test_type) );
+  /* Tell the other Pico which test to run, and what it's looking for in as many reads as it can hold */
+  if( !pico_comm_request( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_TEST_ROM, &rom_params, sizeof(rom_params) ) )
+  {
+    gpio_put( GPIO_Z80_RESET, 0 );
+    pico_comm_show_status( PICO_COMM_NO_RESPONSE, result_line_txt[0], sizeof(result_line_txt[0]), NUM_ROM_TESTS );
+    return;
+  }
 
-  /* Flag the other Pico, which monitors the address bus */
+  /* Flag the other Pico, which monitors the address bus, then let the Z80 go */
   gpio_put( GPIO_P1_SIGNAL, 1 );
   // gpio_put(LED_PIN, 1);
+  busy_wait_us_32( Z80_WATCH_DELAY_US );
+  z80_reset_release( Z80_START_TIMEOUT_MS );
 
-  /* Start the alarm which defines the duration of the test */
+  /* Start the alarm which defines the longest the test can take, it usually ends sooner */
   rom_test_running = true;
   alarm_id_t rom_alarm_id = add_alarm_in_ms( TEST_TIME_SECS*1000, rom_alarm_callback, NULL, false );
   if( rom_alarm_id < 0 )
     panic("No alarms available in ROM test");
 
-  while( rom_test_running );
+  alarm_id_t rom_reply_id = add_alarm_in_us( PICO_COMM_POLL_US, rom_reply_callback, (void*)link, false );
+  if( rom_reply_id < 0 )
+    panic("No alarms available in ROM test");
+
+  /* Cancelling the test cuts this short, the other Pico still replies */
+  sched_wait( &rom_test_running );
 
   /* Remove flag to stop the other Pico collecting address data */
   gpio_put( GPIO_P1_SIGNAL, 0 );
@@ -88,26 +199,65 @@ void rom_page_run_seq_test( PIO linkin_pio, PIO linkout_pio, int linkin_sm, int
    * timing system something else might need to go here
    */
   cancel_alarm( rom_alarm_id );
+  cancel_alarm( rom_reply_id );
+
+  /*
+   * Other Pico sends which of the sequences of ROM reads were found, and how many
+   * times it looked at the bus for every T-state the Z80 ran
+   */
+  ROM_RESULT result;
+  PICO_COMM_STATUS status = pico_comm_response( linkin_pio, linkin_sm, linkout_sm, PICO_COMM_TEST_ROM, &result, sizeof(result), NULL );
+  if( status != PICO_COMM_OK )
+  {
+    pico_comm_show_status( status, result_line_txt[0], sizeof(result_line_txt[0]), NUM_ROM_TESTS );
+    return;
+  }
+
+  uint32_t    rom_sequence_match = (result.found != 0);
+  SAMPLE_RATE rate               = result.rate;
 
-  /* Other Pico sends a yay or nay as to whether the sequence of ROM reads was found */
-  uint32_t rom_sequence_match;
-  ui_link_receive_buffer( linkin_pio, linkin_sm, linkout_sm, (uint8_t*)&rom_sequence_match, sizeof(uint32_t) );
+  uint32_t fitted = 0;
+  while( (fitted < NUM_ROM_SIGNATURES) && !(result.found & (1u << fitted)) )
+    fitted++;
 
-  /* Show the result line */
+  /* A cut short run, or a miss the other Pico couldn't be sure of, says nothing either way */
+  if( !sched_cancelled() && (rom_sequence_match || SAMPLE_RATE_TRUSTWORTHY( rate )) )
+    baseline_report( BASELINE_ROM_OK, rom_sequence_match ? 1 : 0 );
+
+  /* Show the result lines */
   if( rom_sequence_match )
   {
     snprintf( result_line_txt[0], WIDTH_OLED_CHARS, " ROM: Read correctly" );
+    snprintf( result_line_txt[1], WIDTH_OLED_CHARS, " Fitted: %s", rom_signature[fitted].name );
+  }
+  else if( !SAMPLE_RATE_TRUSTWORTHY( rate ) )
+  {
+    /* It might have been read fine, the other Pico just couldn't keep up */
+    snprintf( result_line_txt[0], WIDTH_OLED_CHARS, " ROM: Unreliable" );
+    result_line_txt[1][0] = '\0';
   }
   else
   {
     snprintf( result_line_txt[0], WIDTH_OLED_CHARS, " ROM: Not read" );
+    snprintf( result_line_txt[1], WIDTH_OLED_CHARS, " No ROM I know seen" );
+  }
+
+  if( rate.t_states == 0 )
+  {
+    snprintf( result_line_txt[2], WIDTH_OLED_CHARS, " No CLK, rate unknown" );
+  }
+  else
+  {
+    uint32_t per_t_state = (uint32_t)(((uint64_t)rate.samples * 100) / rate.t_states);
+    snprintf( result_line_txt[2], WIDTH_OLED_CHARS, " Samples/T %lu.%02lu%s",
+	      per_t_state / 100, per_t_state % 100, SAMPLE_RATE_TRUSTWORTHY( rate ) ? "" : " LOW" );
   }
 
   /*
    * Repeat test a regular intervals, but don't do it too fast in case the comms
    * goes a bit funny. No reason it should, but let's not tempt it
    */
-  sleep_ms(1000);
+  sched_sleep_ms(1000);
 }
 
 
@@ -123,3 +273,24 @@ void rom_output(void)
     line++;
   }  
 }
+
+
+/***
+ *      ___   ___   __  __ 
+ *     | _ \ / _ \ |  \/  |
+ *     |   /| (_) || |\/| |
+ *     |_|_\ \___/ |_|  |_|
+ *                         
+ */
+const PAGE_DESCRIPTOR rom_page =
+{
+  "ROM",
+  rom_page_init,
+  rom_page_entry,
+  rom_page_run_seq_test,
+  rom_page_exit,
+  rom_output,
+  { "ROM", SCHED_RES_LINK | SCHED_RES_Z80_RESET, 3100 },
+  NULL,
+  false
+};
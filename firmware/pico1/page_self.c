@@ -0,0 +1,148 @@
+/*
+ * Self test page
+ *
+ * This one doesn't test the Spectrum, it shows how well the firmware's
+ * keeping up with it, from the instrumentation counters on both Picos.
+ * The numbers are totals since the Picos started, so visit the other
+ * pages first. It's hidden from the normal button cycle, a long press
+ * gets to it.
+ */
+
+#include "oled.h"
+#include "page.h"
+#include "gpios.h"
+
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "scheduler.h"
+
+#include "link_common.h"
+#include "pico_comm.h"
+#include "instrument.h"
+#include "rail_monitor.h"
+
+#define NUM_SELF_RESULT_LINES 6
+#define WIDTH_OLED_CHARS 32
+static uint8_t result_line_txt[NUM_SELF_RESULT_LINES][WIDTH_OLED_CHARS+1];
+
+/* Too big for the core's stack */
+static INST_SNAPSHOT pico1_stats;
+static INST_SNAPSHOT pico2_stats;
+
+void self_page_run_tests( const PICO_LINK *link )
+{
+  PIO linkin_pio  = link->linkin_pio;
+  PIO linkout_pio = link->linkout_pio;
+  int linkin_sm   = link->linkin_sm;
+  int linkout_sm  = link->linkout_sm;
+
+  inst_snapshot( &pico1_stats );
+
+  /*
+   * Ask the other Pico for its numbers. There's no test to run, so no
+   * signal to start it, it answers straight away
+   */
+  PICO_COMM_STATUS pico2_status = PICO_COMM_NO_RESPONSE;
+  if( pico_comm_request( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_TEST_STATS, NULL, 0 ) )
+    pico2_status = pico_comm_response( linkin_pio, linkin_sm, linkout_sm, PICO_COMM_TEST_STATS,
+				       &pico2_stats, sizeof(pico2_stats), NULL );
+
+  const INST_HIST_DATA *irq  = &pico1_stats.hist[INST_HIST_GPIO_IRQ];
+  const INST_HIST_DATA *ack  = &pico1_stats.hist[INST_HIST_LINK_ACK];
+  const INST_HIST_DATA *oled = &pico1_stats.hist[INST_HIST_OLED_FRAME];
+  const INST_HIST_DATA *run  = &pico1_stats.hist[INST_HIST_TEST_RUN];
+
+  /*
+   * GPIO interrupts a second while the tests were running, since that's the
+   * only time they're enabled, and the longest time in a handler. At 3.5MHz a
+   * bus cycle's about 1us.
+   */
+  uint32_t irq_rate = (run->total == 0) ? 0 :
+    (uint32_t)(((uint64_t)pico1_stats.counter[INST_GPIO_IRQ] * 1000) / run->total);
+  snprintf( result_line_txt[0], WIDTH_OLED_CHARS, "IRQ %lu/s max %luus",
+	    irq_rate, irq->max );
+
+  /* The rate the link negotiated, in Mbit/s, then the ack times, in us */
+  uint32_t link_rate = link_bit_rate( link->linkout_pio ) / 100000;
+  snprintf( result_line_txt[1], WIDTH_OLED_CHARS, "%lu.%luM ack %lu/%lu ab %lu",
+	    link_rate / 10, link_rate % 10,
+	    inst_hist_mean( ack ), ack->max, pico1_stats.counter[INST_LINK_ABANDONED] );
+
+  /* Frame times, then how often the rail monitor fell behind the ADC */
+  snprintf( result_line_txt[2], WIDTH_OLED_CHARS, "OLED %lu/%lums adc %lu",
+	    inst_hist_mean( oled ) / 1000, oled->max / 1000, rail_monitor_overruns() );
+
+  /*
+   * An interrupt which arrives with both edges latched had at least one more
+   * edge go by while it was waiting, which is the missed edges, or some of them
+   */
+  snprintf( result_line_txt[3], WIDTH_OLED_CHARS, "Runs %lu %lums miss %lu",
+	    run->count, run->max, pico1_stats.counter[INST_GPIO_IRQ_MERGED] );
+
+  /*
+   * Pico2's sampling loops, in hundredths of a million samples a second, and the
+   * longest it's ever gone between two samples. That's the jitter which matters,
+   * a pulse shorter than it can be missed. Then the address bus test's looks which
+   * came more than two T-states after the last, in tenths of a percent, which is
+   * roughly how much of the bus's activity could have gone by unseen.
+   */
+  if( pico2_status != PICO_COMM_OK )
+  {
+    snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "%s", pico_comm_status_str( pico2_status ) );
+  }
+  else if( pico2_stats.counter[INST_SAMPLE_US] == 0 )
+  {
+    snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "P2 not sampled yet" );
+  }
+  else
+  {
+    uint32_t rate = (uint32_t)(((uint64_t)pico2_stats.counter[INST_SAMPLES] * 100) / pico2_stats.counter[INST_SAMPLE_US]);
+    uint32_t slow = (pico2_stats.counter[INST_GAP_SAMPLES] == 0) ? 0 :
+      (uint32_t)(((uint64_t)pico2_stats.counter[INST_SAMPLE_SLOW_GAPS] * 1000) / pico2_stats.counter[INST_GAP_SAMPLES]);
+    snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "P2 %lu.%02luM %luns %lu.%lu%%",
+	      rate / 100, rate % 100, pico2_stats.hist[INST_HIST_SAMPLE_GAP].max, slow / 10, slow % 10 );
+  }
+
+  /* Link timeouts, bad frames and resyncs, the first resync's the one at startup */
+  snprintf( result_line_txt[5], WIDTH_OLED_CHARS, "Ovr %lu link %lu/%lu/%lu", sched_overrun_count(),
+	    pico1_stats.counter[INST_LINK_TIMEOUTS], pico1_stats.counter[INST_LINK_BAD_FRAMES],
+	    pico1_stats.counter[INST_LINK_RESYNCS] );
+
+  sched_sleep_ms(1000);
+}
+
+
+void self_output(void)
+{
+  uint8_t line=2;
+  for( uint32_t test_index=0; test_index<NUM_SELF_RESULT_LINES; test_index++ )
+  {
+    draw_str(0, line*8, "                         " );
+    draw_str(0, line*8, result_line_txt[test_index] );
+
+    line++;
+  }
+}
+
+
+/***
+ *      ___  ___  _     ___ 
+ *     / __|| __|| |   | __|
+ *     \__ \| _| | |__ | _| 
+ *     |___/|___||____||_|  
+ *                          
+ */
+const PAGE_DESCRIPTOR self_page =
+{
+  "SELF",
+  NULL,
+  NULL,
+  self_page_run_tests,
+  NULL,
+  self_output,
+  { "SELF", SCHED_RES_LINK, 1000 },
+  NULL,
+  true
+};
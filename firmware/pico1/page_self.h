@@ -0,0 +1,9 @@
+#ifndef __PAGE_SELF_H
+#define __PAGE_SELF_H
+
+#include "page.h"
+
+void self_page_run_tests( const PICO_LINK *link );
+void self_output(void);
+
+#endif
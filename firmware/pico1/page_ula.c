@@ -10,6 +10,12 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "scheduler.h"
+#include "gpio_irq.h"
+#include "z80_reset.h"
+#include "result_log.h"
+#include "baseline.h"
+
 #include "hardware/pio.h"
 #include "hardware/clocks.h"
 #include "clk_counter.pio.h"
@@ -45,6 +51,7 @@ static void test_blipper( void )
 static int64_t __time_critical_func(ula_alarm_callback)(alarm_id_t id, void *user_data)
 {
   test_running = false;
+  sched_wake();
   return 0;
 }
 
@@ -57,36 +64,46 @@ void ula_page_init( void )
   gpio_init( GPIO_Z80_INT ); gpio_set_dir( GPIO_Z80_INT, GPIO_IN ); gpio_pull_up( GPIO_Z80_INT );
 }
 
+/*
+ * This is the GPIO handler for this test. It's called when the
+ * 50Hz interrupt line fires. Just count them.
+ */
+static void __time_critical_func(ula_int_handler)( uint32_t gpio, uint32_t events, void *context )
+{
+  if( test_running )
+  {
+    interrupt_counter++;
+  }
+}
+
 void ula_page_entry( void )
 {
-  gpio_set_irq_enabled( GPIO_Z80_INT, GPIO_IRQ_EDGE_FALL, true );
+  gpio_irq_register( GPIO_Z80_INT, GPIO_IRQ_EDGE_FALL, ula_int_handler, NULL );
 }
 
 void ula_page_exit( void )
 {
-  gpio_set_irq_enabled( GPIO_Z80_INT, GPIO_IRQ_EDGE_FALL, false );
+  gpio_irq_unregister( GPIO_Z80_INT );
 
   snprintf( result_line_txt[0], WIDTH_OLED_CHARS, " INT: %0.2fHz", ((float)(interrupt_counter)) / TEST_TIME_SECS_F/2.0 );
   snprintf( result_line_txt[1], WIDTH_OLED_CHARS, " CLK: %0.2fMHz", ((float)(clk_counter)/TEST_TIME_SECS_F) / 1000000.0 );
   snprintf( result_line_txt[2], WIDTH_OLED_CHARS, "cCLK: %0.2fMHz", ((float)(c_clk_counter)/TEST_TIME_SECS_F) / 1000000.0 );
-}
 
-void ula_page_gpios( uint32_t gpio, uint32_t events )
-{
-  /*
-   * This is the GPIO callback for this test. It's called when the
-   * 50Hz interrupt line fires. Just count them.
-   */
-  if( gpio == GPIO_Z80_INT )
+  /* A cancelled run's numbers are from part of the test period, they'd look wrong */
+  if( !sched_cancelled() )
   {
-    if( test_running )
-    {
-      interrupt_counter++;
-    }
+    RESULT_LOG_CLOCKS_DATA saved = { (interrupt_counter * 100) / (TEST_TIME_SECS * 2),
+				     clk_counter / TEST_TIME_SECS,
+				     c_clk_counter / TEST_TIME_SECS };
+    result_log_add( RESULT_LOG_CLOCKS, &saved, sizeof(saved) );
+
+    baseline_report( BASELINE_INT_CENTIHZ, saved.int_centihz );
+    baseline_report( BASELINE_CLK_HZ,      saved.clk_hz );
+    baseline_report( BASELINE_C_CLK_HZ,    saved.c_clk_hz );
   }
 }
 
-void ula_page_run_tests( void )
+void ula_page_run_tests( const PICO_LINK *link )
 {
   /* Assert and hold Z80 reset for first clock test */
   gpio_put( GPIO_Z80_RESET, 1 );
@@ -131,7 +148,22 @@ void ula_page_run_tests( void )
 
   /* Bump the PIO to start the program, then wait for the timer alarm */
   pio_sm_put( pio, sm_clk, 1 );
-  while( test_running );
+  sched_wait( &test_running );
+
+  /*
+   * If it was cancelled the alarm's still pending, and it'd go off in the
+   * middle of whatever runs next. Cancelled, there's no point in the
+   * contended half either, so tidy up and let the Z80 go.
+   */
+  cancel_alarm( ula_alarm_id );
+  if( sched_cancelled() )
+  {
+    pio_sm_set_enabled( pio, sm_clk, false );
+    pio_sm_unclaim( pio, sm_clk );
+    pio_remove_program( pio, &clk_counter_program, offset );
+    gpio_put( GPIO_Z80_RESET, 0 );
+    return;
+  }
 
   /*
    * The alarm went off and test_running is now false. Interrupts aren't being counted.
@@ -163,10 +195,11 @@ void ula_page_run_tests( void )
   pio_sm_set_enabled( pio, sm_clk, true );
 
   /*
-   * Let the Z80 run. The sleep is to let the capacitor C27 in the
-   * Spectrum charge up and release the RESET line
+   * Let the Z80 run. The wait is for the capacitor C27 in the Spectrum
+   * to charge up and release the RESET line, contention only starts
+   * once the Z80's running
    */
-  gpio_put( GPIO_Z80_RESET, 0 ); sleep_ms( 650 );
+  z80_reset_release( Z80_START_TIMEOUT_MS );
 
   /* Restart the alarm which defines the duration of the test */
   test_running = true;
@@ -176,7 +209,7 @@ void ula_page_run_tests( void )
 
   /* Kick the state machine to make it start counting from 0 again */
   pio_sm_put( pio, sm_clk, 1 );
-  while( test_running );
+  sched_wait( &test_running );
 
   /* Fetch contended clock counter */
   pio_sm_put( pio, sm_clk, 0 );
@@ -212,3 +245,24 @@ void ula_output(void)
     line++;
   }  
 }
+
+
+/***
+ *      _   _  _       _   
+ *     | | | || |     /_\  
+ *     | |_| || |__  / _ \ 
+ *      \___/ |____|/_/ \_\
+ *                         
+ */
+const PAGE_DESCRIPTOR ula_page =
+{
+  "ULA SIGNALS",
+  ula_page_init,
+  ula_page_entry,
+  ula_page_run_tests,
+  ula_page_exit,
+  ula_output,
+  { "ULA", SCHED_RES_PIO0 | SCHED_RES_GPIO_IRQ | SCHED_RES_Z80_RESET | SCHED_RES_CORE, 4700 },
+  NULL,
+  false
+};
@@ -9,12 +9,19 @@
 
 #include <stdio.h>
 #include <string.h>
-#include "hardware/adc.h"
+
+#include "result_log.h"
+#include "baseline.h"
+#include "rail_monitor.h"
+#include "page_voltages.h"
 
 /* Store last 50 entries so I can work out the averages */
 #define AVERAGE_ARRAY_LEN (uint32_t)50
 static uint32_t average_index = 0;
 
+/* The averages aren't worth saving until the arrays have been filled once */
+static bool averages_full = false;
+
 static float average_5v[AVERAGE_ARRAY_LEN];
 static float average_12v[AVERAGE_ARRAY_LEN];
 static float average_min5v[AVERAGE_ARRAY_LEN];
@@ -23,30 +30,75 @@ static float average_min5v[AVERAGE_ARRAY_LEN];
 #define WIDTH_OLED_CHARS 32
 static uint8_t result_line_txt[NUM_VOLTAGE_TESTS][WIDTH_OLED_CHARS+1];
 
+/*
+ * Below or above these and the rail's counted as having gone wrong while
+ * a test was running, see rail_monitor.c. They're for catching a rail
+ * dropping out or sagging badly under load, not for judging a marginal
+ * supply, that's what the baseline's for. They're wide enough for the
+ * readings being a bit high on my board, see below, and the -5V's a bit
+ * outside the service manual's -5.5V to -4.0V.
+ */
+typedef struct
+{
+  uint8_t *name;
+  float    low;
+  float    high;
+}
+RAIL_LIMITS;
+
+static const RAIL_LIMITS rail_limits[NUM_RAILS] =
+{
+  [RAIL_MINUS5] = { "-5V",  -5.7,  -3.8 },
+  [RAIL_PLUS12] = { "+12V", 10.8,  13.5 },
+  [RAIL_PLUS5]  = { "+5V",   4.6,   5.5 },
+};
+
+static uint16_t adc_from_voltage( RAIL rail, float volts );
+
 void voltage_page_init( void )
 {
-  adc_init();
-  adc_gpio_init(26);
-  adc_gpio_init(27);
-  adc_gpio_init(28);
+  /* The ADC's the monitor's from now on, it watches the rails whatever page is showing */
+  rail_monitor_init();
+
+  for( uint32_t rail = 0; rail < NUM_RAILS; rail++ )
+  {
+    rail_monitor_set_limits( rail, adc_from_voltage( rail, rail_limits[rail].low ),
+			           adc_from_voltage( rail, rail_limits[rail].high ) );
+  }
 }
 
 void voltage_page_entry( void )
 {
 }
 
+/* Highest less lowest of the recent readings, in mV */
+static int32_t ripple_mv( const float *readings )
+{
+  float lowest  = readings[0];
+  float highest = readings[0];
+  for( uint32_t av_index=1; av_index<AVERAGE_ARRAY_LEN; av_index++ )
+  {
+    if( readings[av_index] < lowest )  lowest  = readings[av_index];
+    if( readings[av_index] > highest ) highest = readings[av_index];
+  }
+
+  return (int32_t)((highest - lowest) * 1000.0);
+}
+
 /*
  * When the tests have all run, work out the new averages
  */
 void voltage_page_exit( void )
 {
   float average;
+  RESULT_LOG_VOLTAGES_DATA saved;
 
   average = 0.0;
   for( uint32_t av_index=0; av_index<AVERAGE_ARRAY_LEN; av_index++ )
     average += average_5v[av_index];
 
   snprintf( result_line_txt[3], WIDTH_OLED_CHARS, "AV  +5V: %0.1fV", average / AVERAGE_ARRAY_LEN );
+  saved.plus5_mv = (int16_t)(average / AVERAGE_ARRAY_LEN * 1000.0);
 
 
   average = 0.0;
@@ -54,6 +106,7 @@ void voltage_page_exit( void )
     average += average_12v[av_index];
 
   snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "AV +12V: %0.1fV", average / AVERAGE_ARRAY_LEN );
+  saved.plus12_mv = (int16_t)(average / AVERAGE_ARRAY_LEN * 1000.0);
 
 
   average = 0.0;
@@ -61,11 +114,28 @@ void voltage_page_exit( void )
     average += average_min5v[av_index];
 
   snprintf( result_line_txt[5], WIDTH_OLED_CHARS, "AV  -5V: %0.1fV", average / AVERAGE_ARRAY_LEN );
+  saved.minus5_mv = (int16_t)(average / AVERAGE_ARRAY_LEN * 1000.0);
 
 
+  /* The log only takes one of these a minute, however often they're offered */
+  if( averages_full )
+  {
+    result_log_add( RESULT_LOG_VOLTAGES, &saved, sizeof(saved) );
+
+    baseline_report( BASELINE_PLUS5_MV,         saved.plus5_mv );
+    baseline_report( BASELINE_PLUS12_MV,        saved.plus12_mv );
+    baseline_report( BASELINE_MINUS5_MV,        saved.minus5_mv );
+    baseline_report( BASELINE_PLUS5_RIPPLE_MV,  ripple_mv( average_5v ) );
+    baseline_report( BASELINE_PLUS12_RIPPLE_MV, ripple_mv( average_12v ) );
+    baseline_report( BASELINE_MINUS5_RIPPLE_MV, ripple_mv( average_min5v ) );
+  }
+
   /* Another set of tests run, move the average circular store index */
   if( ++average_index == AVERAGE_ARRAY_LEN )
+  {
     average_index = 0;
+    averages_full = true;
+  }
 }
 
 /*
@@ -126,10 +196,99 @@ const float _5v_ratio     = 1.0 - (R103 / (R103 + R104));  // 0.50000 on my test
 const float _12v_ratio    = 1.0 - (R105 / (R105 + R106));  // 0.20935 on my test board
 const float _minus5_ratio =       (R101 / (R101 + R102));  // 0.20750 on my test board
 
+/*
+ * An ADC reading of one of the rails in volts. The rail monitor does the
+ * reading, an average of a few of them, see rail_monitor.c.
+ */
+float voltage_from_adc( RAIL rail, uint32_t adc )
+{
+  switch( rail )
+  {
+  case RAIL_PLUS5:
+    return (adc * conversion_factor) / _5v_ratio;
+
+  case RAIL_PLUS12:
+    return (adc * conversion_factor) / _12v_ratio;
+
+  case RAIL_MINUS5:
+    /*
+     * Samples from working -5V supply showing -5.4 on the meter:
+     *
+     * adc_read()     = 1860.0
+     * 1860 * 0.00081 = 1.50    this is the voltage at the sample point
+     * 
+     * Drop across R1 is therefore 3.3 - 1.50 = 1.800V
+     * 1.8000 / 0.20750 (min5 voltage divider ratio) gives drop across
+     *                  entire voltage divider = 8.6746
+     * 3.3 - 8.6746 = -5.3746
+     * 
+     */
+    return 3.3000 - ((3.3000 - (adc * conversion_factor)) / _minus5_ratio);
+
+  default:
+    panic("No such rail %lu", rail);
+  }
+}
+
+/* The other way round, for the limits the monitor compares readings with */
+static uint16_t adc_from_voltage( RAIL rail, float volts )
+{
+  float adc;
+
+  switch( rail )
+  {
+  case RAIL_PLUS5:
+    adc = (volts * _5v_ratio) / conversion_factor;
+    break;
+
+  case RAIL_PLUS12:
+    adc = (volts * _12v_ratio) / conversion_factor;
+    break;
+
+  case RAIL_MINUS5:
+    adc = (3.3000 - ((3.3000 - volts) * _minus5_ratio)) / conversion_factor;
+    break;
+
+  default:
+    panic("No such rail %lu", rail);
+  }
+
+  if( adc < 0.0 )
+    return 0;
+  if( adc > 4095.0 )
+    return 4095;
+  return (uint16_t)adc;
+}
+
+/*
+ * Which rail went wrong while a test ran, and how far, to go on the test's
+ * result. The worst of the low or high reading, whichever was out. If more
+ * than one rail was out, the one highest up the list gets shown.
+ */
+void voltage_excursion_str( const RAIL_WINDOW *window, uint8_t *buffer, uint32_t size )
+{
+  static const RAIL order[NUM_RAILS] = { RAIL_PLUS5, RAIL_PLUS12, RAIL_MINUS5 };
+
+  buffer[0] = '\0';
+
+  for( uint32_t index = 0; index < NUM_RAILS; index++ )
+  {
+    RAIL rail = order[index];
+    if( !(window->excursions & (1 << rail)) )
+      continue;
+
+    float lowest  = voltage_from_adc( rail, window->lowest[rail] );
+    float highest = voltage_from_adc( rail, window->highest[rail] );
+    float worst   = (lowest < rail_limits[rail].low) ? lowest : highest;
+
+    snprintf( buffer, size, "%s %0.1f!", rail_limits[rail].name, worst );
+    return;
+  }
+}
+
 void voltage_page_test_5v( void )
 {
-  adc_select_input( 2 );
-  float reading = (adc_read() * conversion_factor) / _5v_ratio;
+  float reading = voltage_from_adc( RAIL_PLUS5, rail_monitor_latest( RAIL_PLUS5 ) );
   snprintf( result_line_txt[0], WIDTH_OLED_CHARS, "    +5V: %0.3fV", reading );
 
   average_5v[average_index] = reading;
@@ -138,8 +297,7 @@ void voltage_page_test_5v( void )
 
 void voltage_page_test_12v( void )
 {
-  adc_select_input( 1 );
-  float reading = (adc_read() * conversion_factor) / _12v_ratio;
+  float reading = voltage_from_adc( RAIL_PLUS12, rail_monitor_latest( RAIL_PLUS12 ) );
   snprintf( result_line_txt[1], WIDTH_OLED_CHARS, "   +12V: %0.3fV", reading );
 
   average_12v[average_index] = reading;
@@ -148,28 +306,43 @@ void voltage_page_test_12v( void )
 
 void voltage_page_test_minus5v( void )
 {
-  adc_select_input( 0 );
-
-  /*
-   * Samples from working -5V supply showing -5.4 on the meter:
-   *
-   * adc_read()     = 1860.0
-   * 1860 * 0.00081 = 1.50    this is the voltage at the sample point
-   * 
-   * Drop across R1 is therefore 3.3 - 1.50 = 1.800V
-   * 1.8000 / 0.20750 (min5 voltage divider ratio) gives drop across
-   *                  entire voltage divider = 8.6746
-   * 3.3 - 8.6746 = -5.3746
-   * 
-   */
-
-  float reading = 3.3000 - ((3.3000 - (adc_read() * conversion_factor)) / _minus5_ratio);
+  float reading = voltage_from_adc( RAIL_MINUS5, rail_monitor_latest( RAIL_MINUS5 ) );
   snprintf( result_line_txt[2], WIDTH_OLED_CHARS, "    -5V: %0.3fV", reading );
 
   average_min5v[average_index] = reading;
 }
 
 
+void voltage_page_run_tests( const PICO_LINK *link )
+{
+  /* Run the 5V rail test and populate the result line for the display */
+  voltage_page_test_5v();
+
+  /* Run the 12V rail test and populate the result line for the display */
+  voltage_page_test_12v();
+
+  /* Run the -5V rail test and populate the result line for the display */
+  voltage_page_test_minus5v();
+
+  /* No need to read the ADC flat out, the display doesn't update that often */
+  sched_sleep_ms( 100 );
+}
+
+/*
+ * Background task, so the averages are kept up to date while the other
+ * pages' tests run. The rail monitor watches the supplies regardless.
+ */
+static void voltage_page_background( void )
+{
+  voltage_page_test_5v();
+  voltage_page_test_12v();
+  voltage_page_test_minus5v();
+  voltage_page_exit();
+}
+
+static const SCHED_TASK voltage_task = { "VOLTAGES", SCHED_RES_NONE, 100, voltage_page_background };
+
+
 void voltage_output(void)
 {
   /*
@@ -193,3 +366,24 @@ void voltage_output(void)
     line++;
   }
 }
+
+
+/***
+ *     __   __     _  _                        
+ *     \ \ / /___ | || |_  __ _  __ _  ___  ___
+ *      \ V // _ \| ||  _|/ _` |/ _` |/ -_)(_-<
+ *       \_/ \___/|_| \__|\__,_|\__, |\___|/__/
+ *                              |___/          
+ */
+const PAGE_DESCRIPTOR voltage_page =
+{
+  "VOLTAGES",
+  voltage_page_init,
+  voltage_page_entry,
+  voltage_page_run_tests,
+  voltage_page_exit,
+  voltage_output,
+  { "VOLTAGE", SCHED_RES_NONE, 100 },
+  &voltage_task,
+  false
+};
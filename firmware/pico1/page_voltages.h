@@ -3,13 +3,17 @@
 
 #include <stdint.h>
 #include "page.h"
+#include "rail_monitor.h"
 
 void voltage_page_init( void );
 void voltage_page_entry( void );
 void voltage_page_test_5v( void );
 void voltage_page_test_12v( void );
 void voltage_page_test_minus5v( void );
+void voltage_page_run_tests( const PICO_LINK *link );
 void voltage_output(void);
 void voltage_page_exit( void );
+float voltage_from_adc( RAIL rail, uint32_t adc );
+void voltage_excursion_str( const RAIL_WINDOW *window, uint8_t *buffer, uint32_t size );
 
 #endif
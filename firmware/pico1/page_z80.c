@@ -11,6 +11,10 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "scheduler.h"
+#include "gpio_irq.h"
+#include "z80_reset.h"
+
 /*
  * Long enough to let the Spectrum boot and run a decent part of the ROM.
  * IORQ only changes when the Spectrum gets as far as changing the
@@ -19,11 +23,11 @@
 #define TEST_TIME_SECS   2
 #define TEST_TIME_SECS_F ((float)(TEST_TIME_SECS))
 
-static SEEN_EDGE m1_flag   = SEEN_NEITHER;
-static SEEN_EDGE rd_flag   = SEEN_NEITHER;
-static SEEN_EDGE wr_flag   = SEEN_NEITHER;
-static SEEN_EDGE mreq_flag = SEEN_NEITHER;
-static SEEN_EDGE iorq_flag = SEEN_NEITHER;
+static volatile SEEN_EDGE m1_flag   = SEEN_NEITHER;
+static volatile SEEN_EDGE rd_flag   = SEEN_NEITHER;
+static volatile SEEN_EDGE wr_flag   = SEEN_NEITHER;
+static volatile SEEN_EDGE mreq_flag = SEEN_NEITHER;
+static volatile SEEN_EDGE iorq_flag = SEEN_NEITHER;
 
 #define NUM_Z80_TESTS 5
 #define WIDTH_OLED_CHARS 32
@@ -34,6 +38,7 @@ static bool z80_test_running = false;
 static int64_t __time_critical_func(z80_alarm_callback)(alarm_id_t id, void *user_data)
 {
   z80_test_running = false;
+  sched_wake();
   return 0;
 }
 
@@ -47,155 +52,91 @@ void z80_page_init( void )
   gpio_init( GPIO_Z80_IORQ ); gpio_set_dir( GPIO_Z80_IORQ, GPIO_IN ); gpio_pull_up( GPIO_Z80_IORQ );
 }
 
-void z80_page_entry( void )
-{
-  m1_flag   = SEEN_NEITHER;
-  rd_flag   = SEEN_NEITHER;
-  wr_flag   = SEEN_NEITHER;
-  mreq_flag = SEEN_NEITHER;
-  iorq_flag = SEEN_NEITHER;
-
-  gpio_set_irq_enabled( GPIO_Z80_M1,   GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, true );
-  gpio_set_irq_enabled( GPIO_Z80_RD,   GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, true );
-  gpio_set_irq_enabled( GPIO_Z80_WR,   GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, true );
-  gpio_set_irq_enabled( GPIO_Z80_MREQ, GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, true );
-  gpio_set_irq_enabled( GPIO_Z80_IORQ, GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, true );
-}
-
-void z80_page_exit( void )
+/*
+ * GPIO handler, the same for all the lines. The context is the line's
+ * flag. Once a line's been seen going both ways it's working, and
+ * there's no need to hear from it again. Once they all have there's
+ * nothing left to find out, so the test ends there rather than waiting
+ * for the alarm.
+ */
+static void __time_critical_func(z80_edge_handler)( uint32_t gpio, uint32_t events, void *context )
 {
-  gpio_set_irq_enabled( GPIO_Z80_M1,   GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, false );
-  gpio_set_irq_enabled( GPIO_Z80_RD,   GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, false );
-  gpio_set_irq_enabled( GPIO_Z80_WR,   GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, false );
-  gpio_set_irq_enabled( GPIO_Z80_MREQ, GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, false );
-  gpio_set_irq_enabled( GPIO_Z80_IORQ, GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, false );
-
-  snprintf( result_line_txt[0], WIDTH_OLED_CHARS, "  M1: %s", m1_flag   == SEEN_BOTH ? "OK" : "Inactive" );
-  snprintf( result_line_txt[1], WIDTH_OLED_CHARS, "  RD: %s", rd_flag   == SEEN_BOTH ? "OK" : "Inactive" );
-  snprintf( result_line_txt[2], WIDTH_OLED_CHARS, "  WR: %s", wr_flag   == SEEN_BOTH ? "OK" : "Inactive" );
-  snprintf( result_line_txt[3], WIDTH_OLED_CHARS, "MREQ: %s", mreq_flag == SEEN_BOTH ? "OK" : "Inactive" );
-  snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "IORQ: %s", iorq_flag == SEEN_BOTH ? "OK" : "Inactive" );
-}
+  volatile SEEN_EDGE *flag = (volatile SEEN_EDGE*)context;
 
-void z80_page_gpios( uint32_t gpio, uint32_t events )
-{
   if( z80_test_running )
   {
-    switch( gpio )
-    {
-    case GPIO_Z80_M1:
+    if( events & GPIO_IRQ_EDGE_FALL )
     {
-      if( events | GPIO_IRQ_EDGE_FALL )
-      {
-	m1_flag |= SEEN_FALLING;
-      }
-      if( events | GPIO_IRQ_EDGE_RISE )
-      {
-	m1_flag |= SEEN_RISING;
-      }
-
-      if( m1_flag == SEEN_BOTH )
-      {
-	gpio_set_irq_enabled( GPIO_Z80_M1,   GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, false );
-      }
+      *flag |= SEEN_FALLING;
     }
-    break;
-
-    case GPIO_Z80_RD:
+    if( events & GPIO_IRQ_EDGE_RISE )
     {
-      if( events | GPIO_IRQ_EDGE_FALL )
-      {
-	rd_flag |= SEEN_FALLING;
-      }
-      if( events | GPIO_IRQ_EDGE_RISE )
-      {
-	rd_flag |= SEEN_RISING;
-      }
-
-      if( rd_flag == SEEN_BOTH )
-      {
-	gpio_set_irq_enabled( GPIO_Z80_RD,   GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, false );
-      }
+      *flag |= SEEN_RISING;
     }
-    break;
 
-    case GPIO_Z80_WR:
+    if( *flag == SEEN_BOTH )
     {
-      if( events | GPIO_IRQ_EDGE_FALL )
-      {
-	wr_flag |= SEEN_FALLING;
-      }
-      if( events | GPIO_IRQ_EDGE_RISE )
-      {
-	wr_flag |= SEEN_RISING;
-      }
+      gpio_irq_mute( gpio );
 
-      if( wr_flag == SEEN_BOTH )
+      if( (m1_flag   == SEEN_BOTH) &&
+	  (rd_flag   == SEEN_BOTH) &&
+	  (wr_flag   == SEEN_BOTH) &&
+	  (mreq_flag == SEEN_BOTH) &&
+	  (iorq_flag == SEEN_BOTH) )
       {
-	gpio_set_irq_enabled( GPIO_Z80_WR,   GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, false );
+	z80_test_running = false;
+	sched_wake();
       }
     }
-    break;
-
-    case GPIO_Z80_MREQ:
-    {
-      if( events | GPIO_IRQ_EDGE_FALL )
-      {
-	mreq_flag |= SEEN_FALLING;
-      }
-      if( events | GPIO_IRQ_EDGE_RISE )
-      {
-	mreq_flag |= SEEN_RISING;
-      }
+  }
+}
 
-      if( mreq_flag == SEEN_BOTH )
-      {
-	gpio_set_irq_enabled( GPIO_Z80_MREQ,   GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, false );
-      }
-    }
-    break;
+void z80_page_entry( void )
+{
+  m1_flag   = SEEN_NEITHER;
+  rd_flag   = SEEN_NEITHER;
+  wr_flag   = SEEN_NEITHER;
+  mreq_flag = SEEN_NEITHER;
+  iorq_flag = SEEN_NEITHER;
 
-    case GPIO_Z80_IORQ:
-    {
-      if( events | GPIO_IRQ_EDGE_FALL )
-      {
-	iorq_flag |= SEEN_FALLING;
-      }
-      if( events | GPIO_IRQ_EDGE_RISE )
-      {
-	iorq_flag |= SEEN_RISING;
-      }
+  gpio_irq_register( GPIO_Z80_M1,   GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, z80_edge_handler, (void*)&m1_flag );
+  gpio_irq_register( GPIO_Z80_RD,   GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, z80_edge_handler, (void*)&rd_flag );
+  gpio_irq_register( GPIO_Z80_WR,   GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, z80_edge_handler, (void*)&wr_flag );
+  gpio_irq_register( GPIO_Z80_MREQ, GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, z80_edge_handler, (void*)&mreq_flag );
+  gpio_irq_register( GPIO_Z80_IORQ, GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, z80_edge_handler, (void*)&iorq_flag );
+}
 
-      if( iorq_flag == SEEN_BOTH )
-      {
-	gpio_set_irq_enabled( GPIO_Z80_IORQ,   GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, false );
-      }
-    }
-    break;
+void z80_page_exit( void )
+{
+  gpio_irq_unregister( GPIO_Z80_M1 );
+  gpio_irq_unregister( GPIO_Z80_RD );
+  gpio_irq_unregister( GPIO_Z80_WR );
+  gpio_irq_unregister( GPIO_Z80_MREQ );
+  gpio_irq_unregister( GPIO_Z80_IORQ );
 
-    default:
-      break;
-    }
-  }
+  snprintf( result_line_txt[0], WIDTH_OLED_CHARS, "  M1: %s", m1_flag   == SEEN_BOTH ? "OK" : "Inactive" );
+  snprintf( result_line_txt[1], WIDTH_OLED_CHARS, "  RD: %s", rd_flag   == SEEN_BOTH ? "OK" : "Inactive" );
+  snprintf( result_line_txt[2], WIDTH_OLED_CHARS, "  WR: %s", wr_flag   == SEEN_BOTH ? "OK" : "Inactive" );
+  snprintf( result_line_txt[3], WIDTH_OLED_CHARS, "MREQ: %s", mreq_flag == SEEN_BOTH ? "OK" : "Inactive" );
+  snprintf( result_line_txt[4], WIDTH_OLED_CHARS, "IORQ: %s", iorq_flag == SEEN_BOTH ? "OK" : "Inactive" );
 }
 
-void z80_page_run_tests( void )
+void z80_page_run_tests( const PICO_LINK *link )
 {
   /*
    * Restart the Z80. This test runs as the computer boots up and runs the
-   * ROM code. The sleep is to let the capacitor C27 in the Spectrum charge
-   * up and release the RESET line
+   * ROM code. The wait is for the capacitor C27 in the Spectrum to charge
+   * up and release the RESET line, the test's time starts when the Z80 does
    */
-  gpio_put( GPIO_Z80_RESET, 1 ); sleep_ms( 5 );
-  gpio_put( GPIO_Z80_RESET, 0 ); sleep_ms( 650 );
+  z80_restart( Z80_START_TIMEOUT_MS );
 
-  /* Restart the alarm which defines the duration of the test */
+  /* Restart the alarm which defines the longest the test can take, it usually ends sooner */
   z80_test_running = true;
   alarm_id_t z80_alarm_id = add_alarm_in_ms( TEST_TIME_SECS*1000, z80_alarm_callback, NULL, false );
   if( z80_alarm_id < 0 )
     panic("No alarms available in Z80 test");
 
-  while( z80_test_running );
+  sched_wait( &z80_test_running );
 
   /*
    * Alarm is done with, this reset isn't necessary but if I change the
@@ -216,3 +157,24 @@ void z80_output(void)
     line++;
   }  
 }
+
+
+/***
+ *      ____ ___   __  
+ *     |_  /( _ ) /  \ 
+ *      / / / _ \| () |
+ *     /___|\___/ \__/ 
+ *                     
+ */
+const PAGE_DESCRIPTOR z80_page =
+{
+  "Z80 SIGNALS",
+  z80_page_init,
+  z80_page_entry,
+  z80_page_run_tests,
+  z80_page_exit,
+  z80_output,
+  { "Z80", SCHED_RES_GPIO_IRQ | SCHED_RES_Z80_RESET, 2700 },
+  NULL,
+  false
+};
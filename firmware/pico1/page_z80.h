@@ -5,8 +5,7 @@
 
 void z80_page_init( void );
 void z80_page_entry( void );
-void z80_page_gpios( uint32_t gpio, uint32_t events );
-void z80_page_run_tests( void );
+void z80_page_run_tests( const PICO_LINK *link );
 void z80_output(void);
 void z80_page_exit( void );
 
@@ -0,0 +1,242 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Supply rail monitor.
+ *
+ * The voltages page used to read each rail once every 100ms, and only
+ * when nothing else was using the core. A rail which sags while the ROM
+ * is hammering the RAM, which is what the bus tests make it do, was
+ * never going to be seen like that.
+ *
+ * So the ADC runs all the time, whatever page is showing, going round
+ * the three rails by itself. DMA copies the readings into a ring, the
+ * same arrangement as the logic analyser. Every 10ms an alarm goes
+ * through what's arrived. Single readings are too noisy to go on, so
+ * each rail's averaged over RAIL_GROUP readings, a few milliseconds'
+ * worth, then compared with its limits. The lowest and highest of those
+ * averages are kept for the test which is running, along with which
+ * rails went outside their limits, so the test's results can say the
+ * supply wasn't right while it ran.
+ *
+ * Everything here is in raw ADC counts. What they are in volts, and what
+ * the limits are, belongs to the voltages page.
+ *
+ * The alarm runs on core0, the tests and the voltages page are on core1,
+ * so the two take turns with a critical section.
+ */
+
+#include "pico/stdlib.h"
+#include "pico/critical_section.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+
+#include "rail_monitor.h"
+
+/* All three rails between them, so each is read 2000 times a second */
+#define RAIL_SAMPLE_HZ      6000
+#define ADC_CLOCK_HZ        48000000.0f
+
+/* About 680ms of readings, far longer than core0's ever kept from the alarm by the flash */
+#define RAIL_RING_BITS      13
+#define RAIL_RING_BYTES     (1 << RAIL_RING_BITS)
+#define RAIL_RING_SAMPLES   (RAIL_RING_BYTES / sizeof(uint16_t))
+
+static uint16_t rail_ring[RAIL_RING_SAMPLES] __attribute__((aligned(RAIL_RING_BYTES)));
+
+/* Readings of each rail averaged together, 4ms of them */
+#define RAIL_GROUP          8
+#define RAIL_GROUP_SAMPLES  (RAIL_GROUP * NUM_RAILS)
+
+#define RAIL_SCAN_US        10000
+
+/*
+ * The DMA is given this many transfers, which lasts over a week. When
+ * it's getting near the end the sampling's started again.
+ */
+#define RAIL_DMA_COUNT      0xFFFFFFFF
+#define RAIL_RESTART_AT     0xF0000000
+
+static int                dma_chan = -1;
+static critical_section_t rail_lock;
+
+/* Readings from the ring which have been dealt with, always a whole number of rounds of the rails */
+static uint32_t scanned = 0;
+
+static uint16_t    limit_low[NUM_RAILS];
+static uint16_t    limit_high[NUM_RAILS];
+static uint16_t    latest[NUM_RAILS];
+static RAIL_WINDOW window;
+
+/* Times the alarm was held up so long the DMA went round the ring on it */
+static uint32_t    overruns = 0;
+
+/* Number of readings the DMA has written so far */
+static inline uint32_t samples_written( void )
+{
+  return RAIL_DMA_COUNT - dma_hw->ch[dma_chan].transfer_count;
+}
+
+static void start_sampling( void )
+{
+  adc_run( false );
+  dma_channel_abort( dma_chan );
+  adc_fifo_drain();
+
+  /* The round robin goes from whichever input's selected, so the first reading is rail 0 */
+  adc_select_input( RAIL_MINUS5 );
+  adc_set_round_robin( (1 << NUM_RAILS) - 1 );
+  adc_fifo_setup( true, true, 1, false, false );
+  adc_set_clkdiv( (ADC_CLOCK_HZ / RAIL_SAMPLE_HZ) - 1.0f );
+
+  dma_channel_config dma_config = dma_channel_get_default_config( dma_chan );
+  channel_config_set_transfer_data_size( &dma_config, DMA_SIZE_16 );
+  channel_config_set_read_increment( &dma_config, false );
+  channel_config_set_write_increment( &dma_config, true );
+  channel_config_set_ring( &dma_config, true, RAIL_RING_BITS );
+  channel_config_set_dreq( &dma_config, DREQ_ADC );
+  dma_channel_configure( dma_chan, &dma_config, rail_ring, &adc_hw->fifo, RAIL_DMA_COUNT, true );
+
+  scanned = 0;
+  adc_run( true );
+}
+
+static void reset_window( void )
+{
+  for( uint32_t rail = 0; rail < NUM_RAILS; rail++ )
+  {
+    window.lowest[rail]  = 0xFFFF;
+    window.highest[rail] = 0;
+  }
+  window.excursions = 0;
+}
+
+/* Deal with whatever's arrived in the ring. Called with the lock held */
+static void scan_ring( void )
+{
+  uint32_t written = samples_written();
+
+  /* Too far behind, the oldest readings have been overwritten. Pick up from half a ring back */
+  if( written - scanned > RAIL_RING_SAMPLES - RAIL_GROUP_SAMPLES )
+  {
+    scanned  = written - (RAIL_RING_SAMPLES / 2);
+    scanned -= scanned % NUM_RAILS;
+    overruns++;
+  }
+
+  while( written - scanned >= RAIL_GROUP_SAMPLES )
+  {
+    uint32_t sum[NUM_RAILS] = { 0 };
+    for( uint32_t i = 0; i < RAIL_GROUP_SAMPLES; i++ )
+      sum[i % NUM_RAILS] += rail_ring[(scanned + i) & (RAIL_RING_SAMPLES - 1)];
+    scanned += RAIL_GROUP_SAMPLES;
+
+    for( uint32_t rail = 0; rail < NUM_RAILS; rail++ )
+    {
+      uint16_t average = (uint16_t)(sum[rail] / RAIL_GROUP);
+
+      latest[rail] = average;
+
+      if( average < window.lowest[rail] )  window.lowest[rail]  = average;
+      if( average > window.highest[rail] ) window.highest[rail] = average;
+
+      if( (average < limit_low[rail]) || (average > limit_high[rail]) )
+	window.excursions |= (1 << rail);
+    }
+  }
+
+  if( written >= RAIL_RESTART_AT )
+    start_sampling();
+}
+
+static int64_t rail_scan_callback( alarm_id_t id, void *user_data )
+{
+  critical_section_enter_blocking( &rail_lock );
+  scan_ring();
+  critical_section_exit( &rail_lock );
+
+  return RAIL_SCAN_US;
+}
+
+void rail_monitor_init( void )
+{
+  adc_init();
+  adc_gpio_init(26);
+  adc_gpio_init(27);
+  adc_gpio_init(28);
+
+  critical_section_init( &rail_lock );
+
+  /* Nothing's out of limits until the voltages page says what they are */
+  for( uint32_t rail = 0; rail < NUM_RAILS; rail++ )
+  {
+    limit_low[rail]  = 0;
+    limit_high[rail] = 0xFFFF;
+    latest[rail]     = 0;
+  }
+  reset_window();
+
+  dma_chan = dma_claim_unused_channel( true );
+  start_sampling();
+
+  /* Alarms run on core0, so this keeps going whatever core1's doing */
+  if( add_alarm_in_us( RAIL_SCAN_US, rail_scan_callback, NULL, true ) < 0 )
+    panic("No alarms available for the rail monitor");
+}
+
+void rail_monitor_set_limits( RAIL rail, uint16_t low, uint16_t high )
+{
+  critical_section_enter_blocking( &rail_lock );
+  limit_low[rail]  = low;
+  limit_high[rail] = high;
+  critical_section_exit( &rail_lock );
+}
+
+/* The most recent average for the rail, up to RAIL_SCAN_US old */
+uint16_t rail_monitor_latest( RAIL rail )
+{
+  critical_section_enter_blocking( &rail_lock );
+  uint16_t reading = latest[rail];
+  critical_section_exit( &rail_lock );
+
+  return reading;
+}
+
+/* A test's starting, what the rails did before it isn't its concern */
+void rail_monitor_window_start( void )
+{
+  critical_section_enter_blocking( &rail_lock );
+  scan_ring();
+  reset_window();
+  critical_section_exit( &rail_lock );
+}
+
+/* The test's finished, what did the rails do while it ran? Includes the readings up to now */
+void rail_monitor_window_end( RAIL_WINDOW *result )
+{
+  critical_section_enter_blocking( &rail_lock );
+  scan_ring();
+  *result = window;
+  critical_section_exit( &rail_lock );
+}
+
+uint32_t rail_monitor_overruns( void )
+{
+  return overruns;
+}
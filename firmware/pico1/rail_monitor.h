@@ -0,0 +1,40 @@
+#ifndef __RAIL_MONITOR_H
+#define __RAIL_MONITOR_H
+
+#include "pico/stdlib.h"
+
+/* The Spectrum's supply rails, in the order of the ADC inputs they're on */
+typedef enum
+{
+  RAIL_MINUS5 = 0,                      // ADC0, GPIO26
+  RAIL_PLUS12 = 1,                      // ADC1, GPIO27
+  RAIL_PLUS5  = 2,                      // ADC2, GPIO28
+
+  NUM_RAILS
+}
+RAIL;
+
+/*
+ * What the rails did while a test was running, in raw ADC counts. Each
+ * value is an average of a few readings, see rail_monitor.c.
+ */
+typedef struct
+{
+  uint16_t lowest[NUM_RAILS];
+  uint16_t highest[NUM_RAILS];
+  uint32_t excursions;                  // Bit per rail which went outside its limits
+}
+RAIL_WINDOW;
+
+/*
+ * Called from core1, by the tests and the voltages page. The readings
+ * are gathered by an alarm which runs on core0, see rail_monitor.c.
+ */
+void     rail_monitor_init( void );
+void     rail_monitor_set_limits( RAIL rail, uint16_t low, uint16_t high );
+uint16_t rail_monitor_latest( RAIL rail );
+void     rail_monitor_window_start( void );
+void     rail_monitor_window_end( RAIL_WINDOW *window );
+uint32_t rail_monitor_overruns( void );
+
+#endif
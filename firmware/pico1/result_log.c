@@ -0,0 +1,303 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Result log, kept in flash.
+ *
+ * The log is a ring of flash sectors. The first slot of each sector is a
+ * header with a sequence number in it. The sector with the highest one
+ * is being written to, and the one after it is the oldest. When the
+ * current sector fills up, the oldest is erased and takes over, so the
+ * sectors all get erased the same number of times. Nothing's ever
+ * overwritten, a record goes into an erased slot, so a power cut part
+ * way through a write can only spoil what was being written.
+ *
+ * Results come from the tests on core1, which send them to core0 as
+ * messages. Core0 queues them up and writes them a page at a time, or
+ * when the oldest has been waiting a while. It can only write while
+ * core1 is parked, and core1 only parks between tests, so the tests are
+ * never held up. The parking's done in main(), which writes everything
+ * that's waiting, from here and from the baseline, in one go. Each test
+ * sends at most one of each type of result a minute, so the log covers
+ * hours of use, not minutes.
+ */
+
+#include "pico/stdlib.h"
+#include <string.h>
+#include <stddef.h>
+
+#include "ipc.h"
+#include "flash_store.h"
+#include "link_common.h"
+#include "result_log.h"
+
+#define SLOT_SIZE        sizeof(RESULT_LOG_RECORD)
+#define SLOTS_PER_SECTOR (FLASH_SECTOR_SIZE / SLOT_SIZE)
+#define SLOTS_PER_PAGE   (FLASH_PAGE_SIZE / SLOT_SIZE)
+
+/* Slot 0 of each sector */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t sequence;
+  uint8_t  unused[SLOT_SIZE - 8];
+}
+SECTOR_HEADER;
+
+#define SECTOR_MAGIC 0x474C585A         // "ZXLG"
+
+/* At most one of each type of result in this long */
+#define RESULT_LOG_INTERVAL_US (60 * 1000000ULL)
+
+/* A part filled page is written once its oldest record has waited this long */
+#define RESULT_LOG_FLUSH_US    (10 * 1000000ULL)
+
+#define RESULT_LOG_QUEUE_SIZE  32
+
+/* This power up, set before core1 starts and read-only after */
+static uint32_t boot = 1;
+
+/* Where the log's up to. Core0's, core1 only reads them between writes */
+static int32_t  current_sector = -1;    // -1 for an empty log
+static uint32_t current_sequence;
+static uint32_t next_slot;
+
+/* Core0's queue of records waiting to be written */
+static RESULT_LOG_RECORD queue[RESULT_LOG_QUEUE_SIZE];
+static uint32_t          queue_tail  = 0;
+static uint32_t          queue_count = 0;
+static uint64_t          oldest_queued_us;
+
+/* Core1's, when each type of result was last sent */
+static bool              sent[NUM_RESULT_LOG_TYPES];
+static uint64_t          last_sent_us[NUM_RESULT_LOG_TYPES];
+
+static uint32_t sector_offset( uint32_t sector )
+{
+  return FLASH_STORE_LOG_OFFSET + sector * FLASH_SECTOR_SIZE;
+}
+
+static const SECTOR_HEADER *sector_header( uint32_t sector )
+{
+  return (const SECTOR_HEADER*)flash_store_read( sector_offset( sector ) );
+}
+
+static const RESULT_LOG_RECORD *slot_record( uint32_t sector, uint32_t slot )
+{
+  return (const RESULT_LOG_RECORD*)flash_store_read( sector_offset( sector ) + slot * SLOT_SIZE );
+}
+
+static uint16_t record_checksum( const RESULT_LOG_RECORD *record )
+{
+  return fletcher16( (uint8_t*)record, offsetof( RESULT_LOG_RECORD, checksum ) );
+}
+
+static bool record_valid( const RESULT_LOG_RECORD *record )
+{
+  return (record->magic == RESULT_LOG_MAGIC) && (record->checksum == record_checksum( record ));
+}
+
+/*
+ * Core0, at boot, before core1 starts. Find the current sector and the
+ * first free slot in it, and work out which power up this is.
+ */
+void result_log_init( void )
+{
+  uint32_t last_boot = 0;
+  for( uint32_t sector = 0; sector < FLASH_STORE_LOG_SECTORS; sector++ )
+  {
+    const SECTOR_HEADER *header = sector_header( sector );
+    if( header->magic != SECTOR_MAGIC )
+      continue;
+
+    if( (current_sector < 0) || (header->sequence > current_sequence) )
+    {
+      current_sector   = sector;
+      current_sequence = header->sequence;
+    }
+
+    for( uint32_t slot = 1; slot < SLOTS_PER_SECTOR; slot++ )
+    {
+      const RESULT_LOG_RECORD *record = slot_record( sector, slot );
+      if( record_valid( record ) && (record->boot > last_boot) )
+	last_boot = record->boot;
+    }
+  }
+  boot = last_boot + 1;
+
+  /* Carry on after whatever's in the current sector. No sector means start one */
+  next_slot = SLOTS_PER_SECTOR;
+  if( current_sector >= 0 )
+  {
+    next_slot = 1;
+    while( (next_slot < SLOTS_PER_SECTOR) && (slot_record( current_sector, next_slot )->magic != 0xFFFF) )
+      next_slot++;
+  }
+}
+
+uint32_t result_log_boot( void )
+{
+  return boot;
+}
+
+/*
+ * Core1, from the tests. Results of a type which was sent recently are
+ * dropped, as are ones which don't fit in the message ring.
+ */
+void result_log_add( RESULT_LOG_TYPE type, const void *data, uint32_t length )
+{
+  if( (type >= NUM_RESULT_LOG_TYPES) || (length > RESULT_LOG_DATA_SIZE) )
+    panic("Bad result log record, type %d length %lu", type, length);
+
+  uint64_t now_us = time_us_64();
+  if( sent[type] && (now_us - last_sent_us[type] < RESULT_LOG_INTERVAL_US) )
+    return;
+
+  RESULT_LOG_RECORD record;
+  memset( &record, 0, sizeof(record) );
+
+  record.magic   = RESULT_LOG_MAGIC;
+  record.type    = type;
+  record.length  = length;
+  record.boot    = boot;
+  record.time_ms = now_us / 1000;
+  memcpy( record.data, data, length );
+  record.checksum = record_checksum( &record );
+
+  if( ipc_send( IPC_MSG_LOG, type, &record, sizeof(record) ) )
+  {
+    sent[type]         = true;
+    last_sent_us[type] = now_us;
+  }
+}
+
+/* Core0, from core1's message. If the queue's full the record's lost */
+void result_log_queue( const RESULT_LOG_RECORD *record )
+{
+  if( queue_count == RESULT_LOG_QUEUE_SIZE )
+    return;
+
+  if( queue_count == 0 )
+    oldest_queued_us = time_us_64();
+
+  memcpy( &queue[(queue_tail + queue_count) % RESULT_LOG_QUEUE_SIZE], record, sizeof(*record) );
+  queue_count++;
+}
+
+/* Erase the oldest sector and make it the current one */
+static void start_sector( void )
+{
+  current_sector = (current_sector < 0) ? 0 : (current_sector + 1) % FLASH_STORE_LOG_SECTORS;
+  current_sequence++;
+  next_slot = 1;
+
+  flash_store_erase( sector_offset( current_sector ) );
+}
+
+/* Core0, with core1 parked. Write everything that's queued, a page at a time */
+static void write_queued( void )
+{
+  static uint8_t page_image[FLASH_PAGE_SIZE];
+
+  while( queue_count )
+  {
+    if( next_slot == SLOTS_PER_SECTOR )
+      start_sector();
+
+    uint32_t page_slot   = next_slot - (next_slot % SLOTS_PER_PAGE);
+    uint32_t page_offset = sector_offset( current_sector ) + page_slot * SLOT_SIZE;
+
+    /* What's already in the page goes back in unchanged */
+    memcpy( page_image, flash_store_read( page_offset ), FLASH_PAGE_SIZE );
+
+    if( page_slot == 0 )
+    {
+      SECTOR_HEADER header;
+      memset( &header, 0xFF, sizeof(header) );
+      header.magic    = SECTOR_MAGIC;
+      header.sequence = current_sequence;
+      memcpy( page_image, &header, sizeof(header) );
+    }
+
+    while( queue_count && (next_slot < page_slot + SLOTS_PER_PAGE) )
+    {
+      memcpy( &page_image[(next_slot - page_slot) * SLOT_SIZE], &queue[queue_tail], SLOT_SIZE );
+
+      queue_tail = (queue_tail + 1) % RESULT_LOG_QUEUE_SIZE;
+      queue_count--;
+      next_slot++;
+    }
+
+    flash_store_program( page_offset, page_image );
+  }
+}
+
+/*
+ * Core0. Once there's a page's worth queued, or the oldest has waited
+ * long enough, the queue wants writing.
+ */
+bool result_log_due( void )
+{
+  if( queue_count == 0 )
+    return false;
+
+  return (queue_count >= SLOTS_PER_PAGE) || (time_us_64() - oldest_queued_us >= RESULT_LOG_FLUSH_US);
+}
+
+/* Core0, with core1 parked. Anything that's queued goes, due or not */
+void result_log_write( void )
+{
+  write_queued();
+}
+
+/*
+ * The most recent records, newest first, up to max of them. Returns how
+ * many were found. Core1 can call this from a test, core0 never writes
+ * while one's running.
+ */
+uint32_t result_log_latest( RESULT_LOG_RECORD *record, uint32_t max )
+{
+  uint32_t found = 0;
+
+  if( current_sector < 0 )
+    return 0;
+
+  /* Back through the sectors, stopping at one which isn't next in sequence */
+  for( uint32_t age = 0; age < FLASH_STORE_LOG_SECTORS; age++ )
+  {
+    uint32_t sector = (current_sector + FLASH_STORE_LOG_SECTORS - age) % FLASH_STORE_LOG_SECTORS;
+
+    const SECTOR_HEADER *header = sector_header( sector );
+    if( (header->magic != SECTOR_MAGIC) || (header->sequence != current_sequence - age) )
+      break;
+
+    for( uint32_t slot = SLOTS_PER_SECTOR - 1; slot > 0; slot-- )
+    {
+      const RESULT_LOG_RECORD *candidate = slot_record( sector, slot );
+      if( !record_valid( candidate ) )
+	continue;
+
+      memcpy( &record[found++], candidate, sizeof(*candidate) );
+      if( found == max )
+	return found;
+    }
+  }
+
+  return found;
+}
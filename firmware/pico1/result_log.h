@@ -0,0 +1,70 @@
+#ifndef __RESULT_LOG_H
+#define __RESULT_LOG_H
+
+#include "pico/stdlib.h"
+
+/*
+ * Test results which are kept in flash, so there's a history of the
+ * machine across power cycles. Values are stored as integers, in the
+ * units noted, so there's no floating point in the flash.
+ */
+typedef enum
+{
+  RESULT_LOG_VOLTAGES = 0x01,           // RESULT_LOG_VOLTAGES_DATA, the rails' averages
+  RESULT_LOG_CLOCKS   = 0x02,           // RESULT_LOG_CLOCKS_DATA, from the ULA page
+  RESULT_LOG_ABUS     = 0x03,           // RESULT_LOG_BUS_DATA, address bus
+  RESULT_LOG_DBUS     = 0x04,           // RESULT_LOG_BUS_DATA, data bus
+
+  NUM_RESULT_LOG_TYPES
+}
+RESULT_LOG_TYPE;
+
+typedef struct
+{
+  int16_t plus5_mv;
+  int16_t plus12_mv;
+  int16_t minus5_mv;
+}
+RESULT_LOG_VOLTAGES_DATA;
+
+typedef struct
+{
+  uint32_t int_centihz;                 // INT, hundredths of a Hz
+  uint32_t clk_hz;                      // CLK with the Z80 held in reset
+  uint32_t c_clk_hz;                    // CLK with the Z80 running, so contended
+}
+RESULT_LOG_CLOCKS_DATA;
+
+typedef struct
+{
+  uint16_t stuck;                       // Lines which weren't seen going both ways
+  uint16_t level;                       // Which of those were high at the end
+}
+RESULT_LOG_BUS_DATA;
+
+#define RESULT_LOG_DATA_SIZE 18
+
+/* One result, 32 bytes, so 8 fit a flash page */
+typedef struct
+{
+  uint16_t magic;                       // RESULT_LOG_MAGIC, an erased slot is 0xFFFF
+  uint8_t  type;                        // RESULT_LOG_TYPE
+  uint8_t  length;                      // Bytes of data used
+  uint32_t boot;                        // Which power up it's from, counting from 1
+  uint32_t time_ms;                     // Since that power up
+  uint8_t  data[RESULT_LOG_DATA_SIZE];
+  uint16_t checksum;                    // Fletcher16 of everything before it
+}
+RESULT_LOG_RECORD;
+
+#define RESULT_LOG_MAGIC 0x5A52
+
+void     result_log_init( void );
+void     result_log_add( RESULT_LOG_TYPE type, const void *data, uint32_t length );
+void     result_log_queue( const RESULT_LOG_RECORD *record );
+bool     result_log_due( void );
+void     result_log_write( void );
+uint32_t result_log_latest( RESULT_LOG_RECORD *record, uint32_t max );
+uint32_t result_log_boot( void );
+
+#endif
@@ -0,0 +1,261 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Cooperative scheduler for the test core.
+ *
+ * Most tests spend nearly all their time waiting: for an alarm to say
+ * the test period is over, or for the Spectrum to come out of reset.
+ * They used to spin while they did it. Now they call sched_wait() or
+ * sched_sleep_ms(), which put the core to sleep with __wfe() until
+ * something happens, so it's not burning power and warming the Pico up
+ * for nothing.
+ *
+ * While the foreground test is waiting, background tasks get a chance
+ * to run. Each test declares what it uses, and a task only runs if it
+ * doesn't need any of the same things. A test which needs the core to
+ * itself, because it's polling a FIFO or its timing would suffer,
+ * declares SCHED_RES_CORE and nothing runs alongside it.
+ *
+ * The alarms which end tests run on the other core, so an alarm callback
+ * calls sched_wake() to rouse this core once it's changed the flag this
+ * core is waiting on.
+ *
+ * A test can be cancelled, when the user's moved on to another page and
+ * its results aren't wanted any more. The waits return early, and tests
+ * with loops of their own check sched_cancelled(). Whatever's asking for
+ * the cancel has to wake this core, but a push into the inter-core FIFO
+ * does that anyway.
+ */
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "scheduler.h"
+
+#define MAX_SCHED_TASKS 8
+
+typedef struct
+{
+  const SCHED_TASK *task;
+  uint64_t          next_run_us;
+}
+TASK_SLOT;
+
+static TASK_SLOT         task_slot[MAX_SCHED_TASKS];
+static uint32_t          num_tasks = 0;
+
+/* The foreground test, and when it started */
+static const SCHED_TEST *current_test = NULL;
+static uint64_t          test_start_us;
+
+/*
+ * The last test to begin, which sched_end_test() leaves alone, and
+ * whether the current one's the same test as that, which ran to the end
+ */
+static const SCHED_TEST *last_test  = NULL;
+static bool              continuing = false;
+
+/* Number of tests which took much longer than they said they would */
+static uint32_t          overrun_count = 0;
+
+/* Says whether the current test should give up, and whether it's been told to */
+static bool            (*cancel_check)( void ) = NULL;
+static volatile bool     cancelled = false;
+
+void sched_init( void )
+{
+  num_tasks     = 0;
+  current_test  = NULL;
+  last_test     = NULL;
+  continuing    = false;
+  overrun_count = 0;
+}
+
+void sched_add_task( const SCHED_TASK *task )
+{
+  if( num_tasks == MAX_SCHED_TASKS )
+    panic("Too many scheduler tasks, can't add %s", task->name);
+
+  task_slot[num_tasks].task        = task;
+  task_slot[num_tasks].next_run_us = time_us_64();
+  num_tasks++;
+}
+
+void sched_begin_test( const SCHED_TEST *test )
+{
+  continuing    = (test == last_test) && !cancelled;
+  current_test  = test;
+  last_test     = test;
+  test_start_us = time_us_64();
+  cancelled     = false;
+}
+
+/*
+ * A page's tests run over and over while it's showing. This says the
+ * last run was this test and it wasn't cut short, so the user hasn't
+ * been anywhere else in between.
+ */
+bool sched_continuing( void )
+{
+  return continuing;
+}
+
+/*
+ * The check is polled from the test loops, so it needs to be quick. Once
+ * it's said yes, the test stays cancelled until the next one begins.
+ */
+void sched_set_cancel_check( bool (*check)( void ) )
+{
+  cancel_check = check;
+}
+
+/* Polled from inside the sampling loops, which run from RAM, so this does too */
+bool __time_critical_func(sched_cancelled)( void )
+{
+  if( !cancelled && (cancel_check != NULL) && cancel_check() )
+    cancelled = true;
+
+  return cancelled;
+}
+
+/*
+ * The declared duration is a guide, not a limit. If a test takes twice
+ * as long as it said it would something's probably not right with it,
+ * so that's counted, unless it was cancelled. Returns how long the test
+ * took.
+ */
+uint32_t sched_end_test( void )
+{
+  uint64_t elapsed_ms = 0;
+
+  if( (current_test != NULL) && !cancelled )
+  {
+    elapsed_ms = (time_us_64() - test_start_us) / 1000;
+    if( elapsed_ms > 2 * (uint64_t)current_test->duration_ms )
+      overrun_count++;
+  }
+
+  current_test = NULL;
+
+  return (uint32_t)elapsed_ms;
+}
+
+uint32_t sched_overrun_count( void )
+{
+  return overrun_count;
+}
+
+/* Wake the test core if it's waiting. Safe to call from an interrupt on either core */
+void sched_wake( void )
+{
+  __sev();
+}
+
+/*
+ * Run any background tasks which are due and are allowed to run beside
+ * the current test. Returns the time the next one's due, so the caller
+ * knows how long it can sleep.
+ */
+static uint64_t run_due_tasks( void )
+{
+  uint32_t busy      = (current_test != NULL) ? current_test->resources : SCHED_RES_NONE;
+  uint64_t next_due  = UINT64_MAX;
+
+  if( busy & SCHED_RES_CORE )
+    return next_due;
+
+  for( uint32_t index = 0; index < num_tasks; index++ )
+  {
+    TASK_SLOT *slot = &task_slot[index];
+
+    if( slot->task->resources & busy )
+      continue;
+
+    uint64_t now = time_us_64();
+    if( now >= slot->next_run_us )
+    {
+      (slot->task->run)();
+      slot->next_run_us = now + slot->task->interval_ms * 1000ULL;
+    }
+
+    if( slot->next_run_us < next_due )
+      next_due = slot->next_run_us;
+  }
+
+  return next_due;
+}
+
+/*
+ * Sleep until the next background task is due, or until woken by an
+ * event, whichever's first. best_effort_wfe_or_timeout() sets an alarm
+ * to make the event if there's a task due, otherwise it's just __wfe().
+ */
+static void sleep_until( uint64_t wake_us )
+{
+  if( wake_us == UINT64_MAX )
+    __wfe();
+  else
+    best_effort_wfe_or_timeout( from_us_since_boot( wake_us ) );
+}
+
+/*
+ * Wait for *running to go false, which is what the test's alarm callback
+ * does when the test period's up. Background tasks run in the meantime.
+ * Returns false if the test was cancelled instead.
+ */
+bool sched_wait( volatile bool *running )
+{
+  while( *running )
+  {
+    if( sched_cancelled() )
+      return false;
+
+    uint64_t next_due = run_due_tasks();
+
+    /* The flag might have changed while the tasks were running */
+    if( !*running )
+      break;
+
+    sleep_until( next_due );
+  }
+
+  return true;
+}
+
+/*
+ * Like sleep_ms(), but background tasks run while it's sleeping. Returns
+ * false if the test was cancelled before the time was up.
+ */
+bool sched_sleep_ms( uint32_t ms )
+{
+  uint64_t wake_us = time_us_64() + ms * 1000ULL;
+
+  while( time_us_64() < wake_us )
+  {
+    if( sched_cancelled() )
+      return false;
+
+    uint64_t next_due = run_due_tasks();
+
+    sleep_until( (next_due < wake_us) ? next_due : wake_us );
+  }
+
+  return true;
+}
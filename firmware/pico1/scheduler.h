@@ -0,0 +1,56 @@
+#ifndef __SCHEDULER_H
+#define __SCHEDULER_H
+
+#include "pico/stdlib.h"
+
+/*
+ * Things a test can need exclusive use of. A background task only runs
+ * while a test is waiting if none of its resources are also the test's.
+ */
+typedef enum
+{
+  SCHED_RES_NONE      = 0x00,
+  SCHED_RES_PIO0      = 0x01,           // State machines on pio0, which the tests share
+  SCHED_RES_GPIO_IRQ  = 0x02,           // Interrupts on the Z80 signal GPIOs
+  SCHED_RES_LINK      = 0x04,           // The link to Pico2, and the signal line
+  SCHED_RES_Z80_RESET = 0x08,           // The test resets the Spectrum
+  SCHED_RES_CORE      = 0x20,           // The test needs this core to itself to get its timing right
+}
+SCHED_RESOURCE;
+
+/* A test which the scheduler runs in the foreground */
+typedef struct
+{
+  const char *name;
+  uint32_t    resources;                // SCHED_RESOURCE bits
+  uint32_t    duration_ms;              // How long the test is expected to take
+}
+SCHED_TEST;
+
+/* Something which runs in the background, every so often, whatever test is running */
+typedef struct
+{
+  const char *name;
+  uint32_t    resources;                // SCHED_RESOURCE bits
+  uint32_t    interval_ms;              // How often it wants to run
+  void      (*run)( void );             // Must be quick, a few hundred microseconds at most
+}
+SCHED_TASK;
+
+void     sched_init( void );
+void     sched_add_task( const SCHED_TASK *task );
+
+void     sched_begin_test( const SCHED_TEST *test );
+uint32_t sched_end_test( void );
+bool     sched_continuing( void );
+
+bool     sched_wait( volatile bool *running );
+bool     sched_sleep_ms( uint32_t ms );
+void     sched_wake( void );
+
+void     sched_set_cancel_check( bool (*check)( void ) );
+bool     sched_cancelled( void );
+
+uint32_t sched_overrun_count( void );
+
+#endif
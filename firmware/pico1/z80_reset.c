@@ -0,0 +1,111 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Restarting the Z80.
+ *
+ * Most of the tests reset the Spectrum so they see the ROM start up.
+ * Letting go of the reset line isn't the same as the Z80 starting
+ * though: the Spectrum's reset line is held by C27, which has to charge
+ * up before the Z80 sees it go away. The tests used to sleep 650ms and
+ * hope that was enough, or not wait at all and hope the other Pico was
+ * watching before anything happened.
+ *
+ * Instead this watches for the Z80 reading memory, MREQ and RD low
+ * together, which it can't do while it's held in reset. The first thing
+ * it does after a reset is fetch from 0x0000, so the first memory read
+ * is the start. M1 would say so more directly, but Sinclair fitted some
+ * Z80s with M1s which don't work.
+ *
+ * The tests start timing from that, so they get the whole of their
+ * window with the Z80 running however long C27 took. The 650ms is kept
+ * as the longest to wait, a Z80 which doesn't start by then isn't going
+ * to, and the test runs anyway to say what's not moving.
+ */
+
+#include "pico/stdlib.h"
+
+#include "gpios.h"
+#include "scheduler.h"
+#include "z80_reset.h"
+
+#define Z80_FETCH_MASK ((1 << GPIO_Z80_MREQ) | (1 << GPIO_Z80_RD))
+
+/* Put the Z80 in reset. It only needs a few clocks, this is plenty */
+void z80_reset_hold( void )
+{
+  gpio_put( GPIO_Z80_RESET, 1 ); sleep_ms( 5 );
+}
+
+/*
+ * Once it's going the Z80 reads memory every few T-states, even a HALT
+ * fetches NOPs. Looking for this long sees one whatever it's doing,
+ * contended memory included.
+ */
+#define Z80_FETCH_LOOK_US 10
+
+static bool z80_fetching( void )
+{
+  uint32_t look_from_us = time_us_32();
+
+  do
+  {
+    if( (gpio_get_all() & Z80_FETCH_MASK) == 0 )
+      return true;
+  }
+  while( time_us_32() - look_from_us < Z80_FETCH_LOOK_US );
+
+  return false;
+}
+
+/*
+ * Let the Z80 go, then wait for it to start fetching instructions.
+ * Returns how many microseconds that took, or Z80_NOT_STARTED if it
+ * didn't happen in timeout_ms or the test was cancelled.
+ *
+ * C27 takes hundreds of milliseconds, so this sleeps between looks
+ * rather than spinning, and the background tasks get to run. That makes
+ * the time it returns good to a millisecond, none of the tests need it
+ * any closer than that.
+ */
+uint32_t z80_reset_release( uint32_t timeout_ms )
+{
+  gpio_put( GPIO_Z80_RESET, 0 );
+
+  uint32_t released_us = time_us_32();
+  uint32_t timeout_us  = timeout_ms * 1000;
+
+  while( !z80_fetching() )
+  {
+    if( time_us_32() - released_us >= timeout_us )
+      return Z80_NOT_STARTED;
+
+    if( !sched_sleep_ms( 1 ) )
+      return Z80_NOT_STARTED;
+  }
+
+  return time_us_32() - released_us;
+}
+
+/* Both of those, for the tests which don't need to do anything while it's held */
+uint32_t z80_restart( uint32_t timeout_ms )
+{
+  z80_reset_hold();
+  return z80_reset_release( timeout_ms );
+}
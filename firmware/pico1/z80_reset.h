@@ -0,0 +1,18 @@
+#ifndef __Z80_RESET_H
+#define __Z80_RESET_H
+
+#include "pico/stdlib.h"
+
+/* Longest C27 gets to let the Z80 go, it's what the tests used to wait blind */
+#define Z80_START_TIMEOUT_MS 650
+
+/* How long the other Pico gets to start watching before the Z80 comes out of reset */
+#define Z80_WATCH_DELAY_US   100
+
+#define Z80_NOT_STARTED      0xFFFFFFFF
+
+void     z80_reset_hold( void );
+uint32_t z80_reset_release( uint32_t timeout_ms );
+uint32_t z80_restart( uint32_t timeout_ms );
+
+#endif
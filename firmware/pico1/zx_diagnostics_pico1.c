@@ -30,6 +30,7 @@
  */
 
 #include <string.h>
+#include <stdio.h>
 
 #include "pico/platform.h"
 #include "pico/stdlib.h"
@@ -40,62 +41,22 @@
 #include "oled.h"
 #include "gpios.h"
 
+#include "usb_stream.h"
+#include "scheduler.h"
+#include "gpio_irq.h"
+#include "ipc.h"
+#include "flash_store.h"
+#include "result_log.h"
+#include "baseline.h"
+#include "rail_monitor.h"
 #include "page_voltages.h"
-#include "page_ula.h"
-#include "page_z80.h"
-#include "page_dbus.h"
-#include "page_abus.h"
-#include "page_rom.h"
+#include "instrument.h"
+#include "sys_clock.h"
 
+#include "link_common.h"
+#include "pico_comm.h"
 #include "picoputer.pio.h"
 
-static uint8_t input1_pressed = 0;
-
-/* Set of pages, press button 1 to cycle these */
-typedef enum
-{
-  VOLTAGE_PAGE = 0,
-  ULA_PAGE,
-  Z80_PAGE,
-  DBUS_PAGE,
-  ABUS_PAGE,
-  ROM_PAGE,
-
-  LAST_PAGE = ROM_PAGE
-}
-PAGE;
-
-PAGE current_page;
-
-/* All the tests the unit currently runs */
-typedef enum
-{
-  TEST_VOLTAGE_5V     = 0,
-  TEST_VOLTAGE_12V,
-  TEST_VOLTAGE_MIN5V,
-  TEST_VOLTAGE_AV5V,
-  TEST_VOLTAGE_AV12V,
-  TEST_VOLTAGE_AVMIN5V,
-
-  TEST_ULA_INT,
-  TEST_ULA_CLK,
-  TEST_ULA_CCLK,
-
-  TEST_Z80_M1,
-  TEST_Z80_RD,
-  TEST_Z80_WR,
-  TEST_Z80_MREQ,
-
-  TEST_DBUS_DBUS,
-
-  TEST_ABUS_ABUS,
-
-  TEST_ROM_SEQ,
-
-  NUM_TESTS,
-}
-TEST_INDEX;
-
 typedef enum
 {
   NEEDS_RUNNING,
@@ -115,32 +76,51 @@ static const PIO                linkout_pio      = pio1;
 static const enum gpio_function linkout_function = GPIO_FUNC_PIO1;
 static       uint               linkout_offset;
 
-/* Paging, for the user interface */
-typedef struct
-{
-  PAGE              page;
-  uint8_t          *gui_title;
-  void            (*init_func)(void);                       // Initialise
-  void            (*gpio_func)( uint32_t, uint32_t );       // A GPIO line has changed state
-  void            (*display_func)( void );                  // Display your output now
-  SHOW_RESULT_FLAG  show_result;
-}
-DISPLAY_PAGE;
+/* Handed to the tests which talk to the other Pico */
+static PICO_LINK link;
+
+/*
+ * Paging, for the user interface. The pages are listed in page_list.h,
+ * each page's file provides its descriptor, so there's nothing here
+ * which needs changing when a page is added.
+ */
+#define PAGE_ENTRY(name) extern const PAGE_DESCRIPTOR name##_page;
+#include "page_list.h"
+#undef PAGE_ENTRY
 
-DISPLAY_PAGE page[] =
+static const PAGE_DESCRIPTOR *const page[] =
 {
-  { VOLTAGE_PAGE, "VOLTAGES",    voltage_page_init, NULL,               voltage_output, NEEDS_RUNNING },
-  { ULA_PAGE,     "ULA SIGNALS", ula_page_init,     ula_page_gpios,     ula_output,     NEEDS_RUNNING },
-  { Z80_PAGE,     "Z80 SIGNALS", z80_page_init,     z80_page_gpios,     z80_output,     NEEDS_RUNNING },
-  { DBUS_PAGE,    "DATA BUS",    dbus_page_init,    dbus_page_gpios,    dbus_output,    NEEDS_RUNNING },
-  { ABUS_PAGE,    "ADDRESS BUS", abus_page_init,    abus_page_gpios,    abus_output,    NEEDS_RUNNING },
-  { ROM_PAGE,     "ROM",         rom_page_init,     rom_page_gpios,     rom_output,     NEEDS_RUNNING },
+#define PAGE_ENTRY(name) &name##_page,
+#include "page_list.h"
+#undef PAGE_ENTRY
 };
-#define NUM_PAGES (sizeof(page) / sizeof(DISPLAY_PAGE))
+#define NUM_PAGES (sizeof(page) / sizeof(page[0]))
+
+/*
+ * The user interface's view of things, which only core0 touches. Core1
+ * is told which page to run, and says when there are results, through
+ * the inter-core messages.
+ */
+
+/* Whether each page has results to show */
+static SHOW_RESULT_FLAG show_result[NUM_PAGES];
+
+/* What the supply rails did while each page's tests last ran */
+static RAIL_WINDOW page_rails[NUM_PAGES];
+
+/* Where that goes if they went wrong, right hand end of the title line, clear of the longest title */
+#define EXCURSION_CHARS 10
+#define EXCURSION_X     (128 - (EXCURSION_CHARS * 6))
+
+/* Page currently showing, index into page[] */
+static uint32_t current_page;
+
+/* Core1 hasn't been told about a page change yet, its FIFO was full */
+static bool page_change_pending = false;
 
 
 /* From the timer_lowlevel.c example */
-static uint64_t get_time_us( void )
+static uint64_t __time_critical_func(get_time_us)( void )
 {
   uint32_t lo = timer_hw->timelr;
   uint32_t hi = timer_hw->timehr;
@@ -148,230 +128,327 @@ static uint64_t get_time_us( void )
 }
 
 /*
- * GPIO event handler callback. This manages the user input button, plus
- * any GPIO handling the tests require
+ * GPIO handler for the user input button. Falling edge is the button
+ * going down, that's just noted. Rising edge is a click up, which is
+ * when something happens. Holding the button down for a second before
+ * letting go is a long press.
  */
 static uint64_t debounce_timestamp_us = 0;
-void gpios_callback( uint gpio, uint32_t events ) 
+static uint64_t press_timestamp_us    = 0;
+static void __time_critical_func(input1_handler)( uint32_t gpio, uint32_t events, void *context )
 {
-  /*
-   * Switch event, set to interrupt on rising edge, so this is a click up.
-   */
-  if( gpio == GPIO_INPUT1 )
+#define DEBOUNCE_USECS   100000
+#define LONG_PRESS_USECS 1000000
+  if( events & GPIO_IRQ_EDGE_FALL )
   {
-#define DEBOUNCE_USECS 100000
-    /* Debounce pause, the switch is a bit noisy */
-    if( (get_time_us() - debounce_timestamp_us) < DEBOUNCE_USECS )
-    {
-      /* If last switch action was very recently, assume it's a bounce and ignore it */
-      debounce_timestamp_us = get_time_us();
-    }
-    else
-    {
-      /* Debounced, take action - just set a flag */
-      if( gpio == GPIO_INPUT1 )
-      {
-	input1_pressed = 1;
-      }
+    if( (get_time_us() - debounce_timestamp_us) >= DEBOUNCE_USECS )
+      press_timestamp_us = get_time_us();
+  }
 
-      /* Note this point as when we last actioned a switch */
-      debounce_timestamp_us = get_time_us();
-    }
+  if( !(events & GPIO_IRQ_EDGE_RISE) )
+    return;
+
+  /* Debounce pause, the switch is a bit noisy */
+  if( (get_time_us() - debounce_timestamp_us) < DEBOUNCE_USECS )
+  {
+    /* If last switch action was very recently, assume it's a bounce and ignore it */
+    debounce_timestamp_us = get_time_us();
   }
   else
   {
-    /*
-     * A GPIO (which isn't the user interface switches) has changed.
-     * Pass the details into the code which is running the tests.
-     */
-    if( page[current_page].gpio_func != NULL )
-    {
-      (page[current_page].gpio_func)( gpio, events );
-    }
+    /* Debounced, take action - tell the user interface on the other core */
+    if( (get_time_us() - press_timestamp_us) >= LONG_PRESS_USECS )
+      ipc_send( IPC_MSG_LONG_PRESS, 0, NULL, 0 );
+    else
+      ipc_send( IPC_MSG_BUTTON, 0, NULL, 0 );
+
+    /* Note this point as when we last actioned a switch */
+    debounce_timestamp_us = get_time_us();
   }
 }
 
 
+/*
+ * Find the fastest rate the link between the Picos copes with, see
+ * link_rate_lead(). Pico2 takes this like a test, but it's the link's
+ * rate it's working out. The link has to be in step. It's left at the
+ * starting rate if anything goes wrong, or Pico2's firmware doesn't
+ * know how. Returns the bit rate it's left at.
+ */
+static uint32_t negotiate_link_rate( void )
+{
+  if( !pico_comm_request( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_LINK_RATE, NULL, 0 ) )
+    return link_bit_rate( linkout_pio );
+
+  gpio_put( GPIO_P1_SIGNAL, 1 );
+  if( pico_comm_response( linkin_pio, linkin_sm, linkout_sm, PICO_COMM_LINK_RATE, NULL, 0, NULL ) == PICO_COMM_OK )
+    link_rate_lead( linkout_pio, linkout_sm, linkin_sm );
+  gpio_put( GPIO_P1_SIGNAL, 0 );
+
+  return link_bit_rate( linkout_pio );
+}
+
+
 /*
  * Core 1 runs the tests
  */
 static void core1_main( void )
 {
   /*
-   * This core handles the test GPIO handling, and therefore has to handle the
-   * user interface buttons as well (because only one GPIO IRQ handler is allowed)
-   *
-   * Initialise the switch button GPIOs
+   * This core handles the test GPIO interrupts, and therefore has to handle the
+   * user interface buttons as well (because the interrupt is per core)
    */
+  gpio_irq_init();
+
+  /* Initialise the switch button GPIOs */
   gpio_init( GPIO_INPUT1 ); gpio_set_dir( GPIO_INPUT1, GPIO_IN ); gpio_pull_up( GPIO_INPUT1 );
 
-  /* Put GPIOs callback in place so the user buttons work */
-  gpio_set_irq_enabled_with_callback( GPIO_INPUT1, GPIO_IRQ_EDGE_RISE, true, &gpios_callback );
+  /* Put the button's handler in place so the user buttons work */
+  gpio_irq_register( GPIO_INPUT1, GPIO_IRQ_EDGE_FALL|GPIO_IRQ_EDGE_RISE, input1_handler, NULL );
 
-  /* Run all the pages' initialisation functions */
+  sched_init();
+
+  /*
+   * A message from the user interface while a test is running means the
+   * page has changed, so the test is cancelled. Waits on the link to the
+   * other Pico can be abandoned if that happens.
+   */
+  sched_set_cancel_check( ipc_pending );
+  link_set_abort_check( sched_cancelled );
+
+  /* Run all the pages' initialisation functions, and start any background tasks they have */
   for( uint32_t page_index = 0; page_index < NUM_PAGES; page_index++ )
   {
-    if( page[page_index].init_func != NULL )
+    if( page[page_index]->init_func != NULL )
+    {
+      (page[page_index]->init_func)();
+    }
+
+    if( page[page_index]->background_task != NULL )
     {
-      (page[page_index].init_func)();
+      sched_add_task( page[page_index]->background_task );
     }
   }
 
+  /* The user interface starts on the first page */
+  uint32_t running_page = 0;
+
+  /*
+   * The first time the link's up, and again whenever a resync's had to
+   * drop it back to the rate it started at
+   */
+  uint32_t start_bit_rate       = link_bit_rate( linkout_pio );
+  uint32_t negotiated_bit_rate  = start_bit_rate;
+  bool     link_rate_negotiated = false;
+
   while( 1 )
   {
-    switch( current_page )
-    {
-    case VOLTAGE_PAGE:
+    /* Between tests is the only time core0 can have this core out of its way */
+    ipc_park_point();
+
+    /*
+     * Pick up any page change from the user interface. If the button's
+     * been pressed several times while the last tests were running, the
+     * last page asked for is the one that runs.
+     */
+    IPC_MESSAGE msg;
+    while( ipc_receive( &msg, 0 ) )
     {
-      /***
-       *     __   __     _  _                        
-       *     \ \ / /___ | || |_  __ _  __ _  ___  ___
-       *      \ V // _ \| ||  _|/ _` |/ _` |/ -_)(_-<
-       *       \_/ \___/|_| \__|\__,_|\__, |\___|/__/
-       *                              |___/          
-       */
-      
-      /* Initialise the voltage tests */
-      voltage_page_entry();
-
-      /* Run the 5V rail test and populate the result line for the display */
-      voltage_page_test_5v();
-      
-      /* Run the 12V rail test and populate the result line for the display */
-      voltage_page_test_12v();
-      
-      /* Run the -5V rail test and populate the result line for the display */
-      voltage_page_test_minus5v();
-      
-      /* Tear down voltage tests */
-      voltage_page_exit();
-
-      page[VOLTAGE_PAGE].show_result = RESULT_READY;
+      if( msg.type == IPC_CMD_RUN_PAGE )
+      {
+	if( msg.arg >= NUM_PAGES )
+	  panic("Asked to run invalid page %lu", msg.arg);
+
+	running_page = msg.arg;
+      }
     }
-    break;
 
-    case ULA_PAGE:
+    /*
+     * The page can change while its tests are running, so everything here
+     * refers to the page which was asked for when they started
+     */
+    const PAGE_DESCRIPTOR *running = page[running_page];
+
+    sched_begin_test( &running->test );
+    rail_monitor_window_start();
+
+    /*
+     * Anything going wrong on the link leaves it out of step with the other
+     * Pico, which then waits for this one to resync it. That happens here,
+     * before a test which needs the link, rather than in the middle of one.
+     * If Pico2 doesn't answer the test's frames fail straight away and
+     * it's tried again next time.
+     */
+    if( running->test.resources & SCHED_RES_LINK )
     {
-      /***
-       *      _   _  _       _   
-       *     | | | || |     /_\  
-       *     | |_| || |__  / _ \ 
-       *      \___/ |____|/_/ \_\
-       *                         
-       */
-      
-      /* Initialise the ULA tests */
-      ula_page_entry();
-
-      /* The ULA tests are all run in one function */
-      ula_page_run_tests();
-    
-      /* Tear down ULA tests */
-      ula_page_exit();
-
-      page[ULA_PAGE].show_result = RESULT_READY;
+      if( link_out_of_step( linkout_pio ) )
+	link_resync( linkout_pio, linkout_sm, linkin_sm );
+
+      /* It only fell back if it was faster, one which stayed put isn't worth trying again */
+      if( (negotiated_bit_rate > start_bit_rate) && (link_bit_rate( linkout_pio ) == start_bit_rate) )
+	link_rate_negotiated = false;
+
+      if( !link_rate_negotiated && !link_out_of_step( linkout_pio ) )
+      {
+	negotiated_bit_rate  = negotiate_link_rate();
+	link_rate_negotiated = true;
+      }
     }
-    break;
 
-    case Z80_PAGE:
-    {
-      /***
-       *      ____ ___   __  
-       *     |_  /( _ ) /  \ 
-       *      / / / _ \| () |
-       *     /___|\___/ \__/ 
-       *                     
-       */
+    /* Initialise the page's tests */
+    if( running->entry_func != NULL )
+      (running->entry_func)();
 
-      /* Initialise the Z80 tests */
-      z80_page_entry();
+    /* Run the tests and populate the result lines for the display */
+    (running->run_func)( &link );
 
-      /* Run the Z80 tests and populate the result lines for the display */
-      z80_page_run_tests();
+    /* Tear down the page's tests */
+    if( running->exit_func != NULL )
+      (running->exit_func)();
 
-      /* Tear down Z80 tests */
-      z80_page_exit();
+    /* Cancelled tests' results aren't wanted, they're probably incomplete anyway */
+    bool cancelled = sched_cancelled();
 
-      page[Z80_PAGE].show_result = RESULT_READY;
-    }
-    break;
+    /* If core0's not keeping up it'll see the results next time round */
+    IPC_RESULT result = { sched_end_test() };
+    rail_monitor_window_end( &result.rails );
+    if( !cancelled )
+      ipc_send( IPC_MSG_RESULT, running_page, &result, sizeof(result) );
+  }
+}
 
-    case DBUS_PAGE:
-    {
-      /***
-       *      ___         _           ___           
-       *     |   \  __ _ | |_  __ _  | _ ) _  _  ___
-       *     | |) |/ _` ||  _|/ _` | | _ \| || |(_-<
-       *     |___/ \__,_| \__|\__,_| |___/ \_,_|/__/
-       *                                            
-       */
 
-      /* Initialise the data bus tests */
-      dbus_page_entry();
+/*
+ * Tell core1 which page to run. If its FIFO's full it's in the middle of
+ * a long test and hasn't picked up the earlier presses yet, so try again
+ * next time round the main loop.
+ */
+static void request_page( uint32_t page_index )
+{
+  page_change_pending = !ipc_send( IPC_CMD_RUN_PAGE, page_index, NULL, 0 );
+}
 
-      /* Run the data bus tests and populate the result lines for the display */
-      dbus_page_run_tests();
+/*
+ * The next page after this one, wrapping round, which is hidden or
+ * isn't. If there isn't one it stays where it is.
+ */
+static uint32_t find_page( uint32_t from, bool hidden )
+{
+  uint32_t index = from;
+  do
+  {
+    if( ++index == NUM_PAGES )
+      index = 0;
 
-      /* Tear down data bus tests */
-      dbus_page_exit();
+    if( page[index]->hidden == hidden )
+      return index;
+  }
+  while( index != from );
 
-      page[DBUS_PAGE].show_result = RESULT_READY;
-    }
-    break;
+  return from;
+}
+
+/*
+ * Move to a page. It's flagged as needing to be run so stale test result
+ * data it's holding isn't shown.
+ */
+static void show_page( uint32_t page_index )
+{
+  show_result[page_index] = NEEDS_RUNNING;
+  current_page = page_index;
+  request_page( current_page );
+
+  clear_screen();
+}
+
+/*
+ * Core1 has to be parked while the flash is written, see ipc.h. When the
+ * result log or the baseline has something to write, it's asked to park,
+ * then once it has everything that's waiting is written in one go.
+ */
+static bool flash_parking = false;
 
-    case ABUS_PAGE:
+static void flash_service( void )
+{
+  if( !flash_parking )
+  {
+    if( result_log_due() || baseline_due() )
     {
-      /***
-       *        _       _     _                     ___           
-       *       /_\   __| | __| | _ _  ___  ___ ___ | _ ) _  _  ___
-       *      / _ \ / _` |/ _` || '_|/ -_)(_-<(_-< | _ \| || |(_-<
-       *     /_/ \_\\__,_|\__,_||_|  \___|/__//__/ |___/ \_,_|/__/
-       *                                                          
-       */
+      flash_parking = true;
+      ipc_park_request();
+    }
+    return;
+  }
 
-      /* Initialise the address bus tests */
-      abus_page_entry();
+  if( !ipc_parked() )
+    return;
 
-      /* Run the address bus tests and populate the result lines for the display */
-      abus_page_run_tests( linkin_pio, linkout_pio, linkin_sm, linkout_sm );
+  result_log_write();
+  baseline_write();
 
-      /* Tear down address bus tests */
-      abus_page_exit();
+  flash_parking = false;
+  ipc_park_release();
+}
 
-      page[ABUS_PAGE].show_result = RESULT_READY;
-    }
+/*
+ * Deal with a message from core1.
+ */
+static void handle_message( const IPC_MESSAGE *msg )
+{
+  switch( msg->type )
+  {
+  case IPC_MSG_BUTTON:
+    /* The user button has been pressed, move to the next page */
+    show_page( find_page( current_page, false ) );
     break;
 
-    case ROM_PAGE:
-    {
-      /***
-       *      ___   ___   __  __ 
-       *     | _ \ / _ \ |  \/  |
-       *     |   /| (_) || |\/| |
-       *     |_|_\ \___/ |_|  |_|
-       *                         
-       */
-
-      /* Initialise the ROM tests */
-      rom_page_entry();
-      
-      /* Run the ROM sequential bytes test and populate the result lines for the display */
-      rom_page_run_seq_test( linkin_pio, linkout_pio, linkin_sm, linkout_sm );
-
-      /* Tear down ROM tests */
-      rom_page_exit();
-
-      page[ROM_PAGE].show_result = RESULT_READY;
-    }
+  case IPC_MSG_LONG_PRESS:
+    /* Long press, move to the next of the pages which are normally hidden */
+    show_page( find_page( current_page, true ) );
     break;
 
-    default:
+  case IPC_MSG_RESULT:
+  {
+    IPC_RESULT result;
+    memcpy( &result, msg->payload, sizeof(result) );
+
+    show_result[msg->arg] = RESULT_READY;
+    page_rails[msg->arg]  = result.rails;
+    inst_hist_record( INST_HIST_TEST_RUN, result.elapsed_ms );
+  }
+  break;
+
+  case IPC_MSG_LOG:
+  {
+    RESULT_LOG_RECORD record;
+    memcpy( &record, msg->payload, sizeof(record) );
+
+    result_log_queue( &record );
+  }
+  break;
+
+  case IPC_MSG_BASELINE:
+  {
+    BASELINE_VECTOR vector;
+    memcpy( &vector, msg->payload, sizeof(vector) );
+
+    baseline_queue_save( &vector );
+  }
+  break;
+
+  case IPC_MSG_PARKED:
+    /* Core1 has stopped to let the flash be written. It's on its way into RAM, don't keep it waiting */
+    while( !ipc_parked() )
+      tight_loop_contents();
+
+    flash_service();
     break;
-    }
+
+  default:
+    panic("Unexpected message type 0x%02X from core1", msg->type);
   }
 }
 
-
 /*
  * Core 0 runs the user interface/screen
  */
@@ -379,6 +456,9 @@ void main( void )
 {
   bi_decl(bi_program_description("ZX Spectrum Diagnostics Pico1 Board Binary."));
 
+  /* Before anything which works out a divider from the clocks */
+  sys_clock_init();
+
   sleep_ms( 1000 );
 
   /* Inbound link, from address bus handling Pico2. The GPIO is labelled from Pico2's view */
@@ -407,46 +487,80 @@ void main( void )
   /* Start with the Z80 running */
   gpio_init( GPIO_Z80_RESET ); gpio_set_dir( GPIO_Z80_RESET, GPIO_OUT ); gpio_put( GPIO_Z80_RESET, 0 );
 
+  /* USB, for streaming captures to a host */
+  usb_stream_init( STREAM_SOURCE_PICO1 );
+
+  /* The tests which need the other Pico get the link from this */
+  link.linkin_pio  = linkin_pio;
+  link.linkout_pio = linkout_pio;
+  link.linkin_sm   = linkin_sm;
+  link.linkout_sm  = linkout_sm;
+
+  /* Start with the first page, the voltages */
+  current_page = 0;
+
+  /* Find where the result log's up to, and the saved baseline, before core1 wants them */
+  flash_store_init();
+  result_log_init();
+  baseline_init();
+
+  /* Nothing can go between the cores until the second one's launched */
+  ipc_init();
+
   /* Init complete, run 2nd core code */
   multicore_launch_core1( core1_main ); 
 
-  /* Start with voltages page */
-  current_page = VOLTAGE_PAGE;
-
   /* Main loop just loops over the result text lines displaying them */
   while( 1 )
   {
-    /*
-     * If the user button has been pressed, as indicated by the GPIO callback routine,
-     * move to the next page. The new page to show is flagged as needing to be run so
-     * stale test result data it's holding isn't shown.
-     */
-    if( input1_pressed )
-    {
-      if( current_page++ == LAST_PAGE )
-	current_page = VOLTAGE_PAGE;
-
-      page[current_page].show_result = NEEDS_RUNNING;
+    if( page_change_pending )
+      request_page( current_page );
 
-      input1_pressed = 0;
+    draw_str(0, 0, page[current_page]->gui_title );
 
-      clear_screen();
-    }
+    /*
+     * A test which runs the Spectrum, which a supply rail went wrong during,
+     * says so at the end of the title line. Its results might well be down
+     * to that rather than what they look like.
+     */
+    uint8_t excursion[EXCURSION_CHARS+1] = "";
+    if( (show_result[current_page] == RESULT_READY) && (page[current_page]->test.resources & SCHED_RES_Z80_RESET) )
+      voltage_excursion_str( &page_rails[current_page], excursion, sizeof(excursion) );
 
-    draw_str(0, 0, page[current_page].gui_title );
+    uint8_t title_end[EXCURSION_CHARS+1];
+    snprintf( title_end, sizeof(title_end), "%*s", EXCURSION_CHARS, excursion );
+    draw_str( EXCURSION_X, 0, title_end );
 
-    if( page[current_page].show_result == RESULT_READY )
+    if( show_result[current_page] == RESULT_READY )
     {
       /* Call the module's display function, it prints its own results */
-      (page[current_page].display_func)();
+      (page[current_page]->display_func)();
     }
     else
     {
       draw_str(0, 2*8, "  Tests running...   " );
     }
+    uint32_t frame_start_us = inst_now();
     update_screen();    
+    inst_hist_since( INST_HIST_OLED_FRAME, frame_start_us );
+
+    /*
+     * Wait for the next redraw, or for core1 to say something. A button
+     * press or a result gets dealt with and shown straight away, along
+     * with anything else which has come in meanwhile.
+     */
+    IPC_MESSAGE msg;
+    if( ipc_receive( &msg, 100000 ) )
+    {
+      do
+      {
+	handle_message( &msg );
+      }
+      while( ipc_receive( &msg, 0 ) );
+    }
 
-    sleep_ms( 100 );
+    /* Nothing else to do, write results to the flash if it's time */
+    flash_service();
   }
 
 }
@@ -0,0 +1,85 @@
+/*
+ * ZX Diagnostics Firmware, a Raspberry Pi Pico based Spectrum test device
+ * Copyright (C) 2024 Derek Fountain
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Link soak test, Pico2's end, see link_bench.c. Flashed instead of the
+ * diagnostics, with pico1_linkbench on the other Pico. It sends back
+ * whatever Pico1 sends it, and prints what it found over USB serial
+ * every second. Pico1's report is the one with the timings in it.
+ */
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "pico/binary_info.h"
+#include "hardware/pio.h"
+
+#include "gpios.h"
+#include "sys_clock.h"
+#include "link_common.h"
+#include "link_bench.h"
+#include "picoputer.pio.h"
+
+#define REPORT_INTERVAL_US 1000000
+
+static LINK_BENCH_STATS stats;
+
+void main( void )
+{
+  bi_decl(bi_program_description("ZX Spectrum Diagnostics Pico2 link soak test."));
+
+  sys_clock_init();
+  stdio_init_all();
+
+  const PIO pio = pio0;
+
+  /* The same GPIOs and PIO as the diagnostics use */
+  gpio_set_function( GPIO_P2_LINKOUT, GPIO_FUNC_PIO0 );
+  int  linkout_sm = pio_claim_unused_sm( pio, true );
+  uint offset     = pio_add_program( pio, &picoputerlinkout_program );
+  picoputerlinkout_program_init( pio, linkout_sm, offset, GPIO_P2_LINKOUT );
+
+  gpio_set_function( GPIO_P2_LINKIN, GPIO_FUNC_PIO0 );
+  int  linkin_sm  = pio_claim_unused_sm( pio, true );
+       offset     = pio_add_program( pio, &picoputerlinkin_program );
+  picoputerlinkin_program_init( pio, linkin_sm, offset, GPIO_P2_LINKIN );
+
+  link_bench_start( NULL );
+
+  uint32_t report_start_us = time_us_32();
+  link_bench_reset( &stats );
+
+  while( 1 )
+  {
+    link_bench_echo( pio, linkin_sm, linkout_sm, &stats );
+
+    uint32_t elapsed_us = time_us_32() - report_start_us;
+    if( elapsed_us >= REPORT_INTERVAL_US )
+    {
+      LINK_BENCH_REPORT report;
+      link_bench_report( &stats, elapsed_us, &report );
+
+      printf("%lu B/s  %lu frames  %lu timeouts  %lu bad  %lu resyncs\n",
+	     report.bytes_per_sec, report.transfers, report.timeouts, report.checksum_failures, report.resyncs);
+
+      link_bench_reset( &stats );
+      report_start_us = time_us_32();
+    }
+  }
+}
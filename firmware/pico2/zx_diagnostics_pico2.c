@@ -29,8 +29,6 @@
  *  continue
  */
 
-#define _GNU_SOURCE      /* Expose memmem() in string.h */
-
 #include "pico/platform.h"
 #include "pico/stdlib.h"
 #include "pico/binary_info.h"
@@ -40,11 +38,80 @@
 #include "gpios.h"
 
 #include "link_common.h"
+#include "pico_comm.h"
+#include "seq_match.h"
 #include "picoputer.pio.h"
+#include "refresh_capture.pio.h"
+#include "clk_counter.pio.h"
+#include "logic_capture.h"
+#include "usb_stream.h"
+#include "instrument.h"
+#include "sys_clock.h"
+
+/* Pico1 raises the signal as soon as the request's gone, so it's not long coming */
+#define SIGNAL_TIMEOUT_US      10000
+
+/* When the signal went up for the current test, tests which time things from Pico1's cue want it */
+static uint32_t signal_seen_us;
+
+/* The link to Pico1, the tests send their own responses on it */
+static const PIO                linkout_pio      = pio0;
+static const enum gpio_function linkout_function = GPIO_FUNC_PIO0;
+static       int                linkout_sm;
+static const PIO                linkin_pio       = pio0;
+static const enum gpio_function linkin_function  = GPIO_FUNC_PIO0;
+static       int                linkin_sm;
+
+/* The link uses pio0, captures which need a PIO use this one */
+static const PIO capture_pio = pio1;
+
+/* Logic analyser captures run until Pico1 drops the signal */
+static bool p2_signal_held( void )
+{
+  return gpio_get( GPIO_P2_SIGNAL ) == 1;
+}
+
+/*
+ * Z80 clock counter, for measuring how many samples per T-state the
+ * sampling loops manage. It runs on the capture PIO, which nothing else
+ * is using while those loops run.
+ */
+static uint clk_sm;
+static uint clk_offset;
+
+static void clk_count_start( void )
+{
+  clk_offset = pio_add_program( capture_pio, &clk_counter_program );
+  clk_sm     = pio_claim_unused_sm( capture_pio, true );
+
+  clk_counter_program_init( capture_pio, clk_sm, clk_offset, GPIO_Z80_CLK );
+  pio_sm_set_enabled( capture_pio, clk_sm, true );
+
+  /* Any non-zero value starts it counting */
+  pio_sm_put( capture_pio, clk_sm, 1 );
+}
+
+/*
+ * Stop the counter and return the count. The state machine only looks
+ * for the stop on a clock edge, so if the clock's dead there's nothing
+ * to read back. That counts as zero.
+ */
+static uint32_t clk_count_stop( void )
+{
+  pio_sm_put( capture_pio, clk_sm, 0 );
+  busy_wait_us_32( 100 );
 
-/* Test indicators, one of these is sent by Pico1 to say which test we are to run */
-#define PICO_COMM_TEST_ABUS 0x01020304
-#define PICO_COMM_TEST_ROM  0x04030201
+  uint32_t t_states = 0;
+  if( !pio_sm_is_rx_fifo_empty( capture_pio, clk_sm ) )
+    t_states = ~pio_sm_get( capture_pio, clk_sm );
+
+  pio_sm_set_enabled( capture_pio, clk_sm, false );
+  pio_sm_clear_fifos( capture_pio, clk_sm );
+  pio_sm_unclaim( capture_pio, clk_sm );
+  pio_remove_program( capture_pio, &clk_counter_program, clk_offset );
+
+  return t_states;
+}
 
 static void test_blipper( void )
 {
@@ -56,19 +123,792 @@ static void test_blipper( void )
   gpio_put( GPIO_P2_BLIPPER, 0 );
 }
 
+/*
+ * The sampling loops. These run from RAM rather than flash, so a miss in
+ * the flash cache can't stall one of them part way round and let a short
+ * pulse on the bus go by unseen. USB is paused while they run, for the
+ * same reason, see usb_stream.c.
+ */
+
+/*
+ * Two T-states at 3.5MHz, in processor cycles, which is the shortest an address line
+ * stays put. A look at the bus longer than this after the one before could have
+ * missed a pulse on one altogether, so they're counted, and the self page shows them
+ * as an estimate of how much goes by unseen.
+ */
+#define SLOW_GAP_CYCLES (2 * ZXDIAG_SYS_CLK_KHZ / 3500)
+
+/*
+ * Address bus test, just monitor the address lines and confirm they got low->high and high->low.
+ * Loop while the first Pico is holding the "test running" signal, or until every line in
+ * line_mask has been seen going both ways. Returns the number of
+ * samples taken, and the longest gap between two of them in processor cycles. Lines not in
+ * line_mask never appear to move, so they stay as they were.
+ */
+static uint32_t __time_critical_func(abus_sample)( SEEN_EDGE *line_edge, uint32_t line_mask, uint32_t *max_gap_cycles )
+{
+  line_mask &= 0x0000FFFF;
+
+  uint32_t previous_gpios_state = gpio_get_all() & line_mask;
+
+  /* A bit per line, set once it's been seen going that way */
+  uint32_t seen_rising  = 0;
+  uint32_t seen_falling = 0;
+
+  /* Lines which haven't been seen going both ways yet */
+  uint32_t unresolved = line_mask;
+
+  uint32_t samples     = 0;
+  uint32_t longest_gap = 0;
+  uint32_t slow_gaps   = 0;
+  uint32_t last_cycles = inst_cycles();
+
+  while( (gpio_get( GPIO_P2_SIGNAL ) == 1) && unresolved )
+  {
+    samples++;
+
+    /*
+     * Each iteration I look at all 16 address lines at once for transitions.
+     * Previous GPIO state is taken at the very start. The lines which are
+     * different from last time have changed; the ones of those which are
+     * now set have gone low to high, the ones which are now unset have
+     * gone high to low. Then the current state becomes the previous one.
+     *
+     * This used to work along the lines one at a time, but that took a
+     * couple of hundred processor cycles a look, longer than the shortest
+     * pulse on the address bus. Doing them together is a few dozen.
+     *
+     * When every line has been seen going both ways, which would be the
+     * typical case with a healthy Spectrum, the test is complete. There's
+     * nothing more to learn from looking, so I stop and send the results
+     * straight away. Pico1 sees them start to arrive and doesn't wait out
+     * the rest of its time.
+     */
+
+    uint32_t current_gpios_state = gpio_get_all() & line_mask;
+
+    /* Note the longest time between two looks at the bus, that's when an edge could be missed */
+    uint32_t now_cycles = inst_cycles();
+    uint32_t gap_cycles = INST_CYCLES_DIFF( last_cycles, now_cycles );
+    if( gap_cycles > longest_gap )
+      longest_gap = gap_cycles;
+    if( gap_cycles > SLOW_GAP_CYCLES )
+      slow_gaps++;
+    last_cycles = now_cycles;
+
+    uint32_t changed = current_gpios_state ^ previous_gpios_state;
+
+    seen_rising  |= changed &  current_gpios_state;
+    seen_falling |= changed & ~current_gpios_state;
+    unresolved    = line_mask & ~(seen_rising & seen_falling);
+
+    previous_gpios_state = current_gpios_state;
+
+  } /* End while P2 signal is held by Pico1 and there's a line still to see */
+
+  /* Now what each line did, for the results */
+  for( uint32_t gpio_index = 0; gpio_index < 16; gpio_index++ )
+  {
+    uint32_t mask = (1 << gpio_index);
+
+    if( seen_rising & mask )
+      line_edge[gpio_index] |= SEEN_RISING;
+    if( seen_falling & mask )
+      line_edge[gpio_index] |= SEEN_FALLING;
+  }
+
+  inst_add( INST_GAP_SAMPLES,      samples );
+  inst_add( INST_SAMPLE_SLOW_GAPS, slow_gaps );
+
+  *max_gap_cycles = longest_gap;
+  return samples;
+}
+
+/*
+ * ROM test, stash the address of each memory read until the buffer's full or the
+ * first Pico drops the "test running" signal. Returns the number of samples taken,
+ * and how many addresses were stashed in *captured.
+ */
+static uint32_t __time_critical_func(rom_sample)( uint16_t *address_buffer, uint32_t buffer_size, uint32_t *captured )
+{
+  uint32_t buffer_index = 0;
+  uint32_t samples      = 0;
+
+  /* Loop while the first Pico is holding the "test running" signal */
+  while( (gpio_get( GPIO_P2_SIGNAL ) == 1) && (buffer_index < buffer_size) )
+  {
+    samples++;
+
+    /* Wait for a memory request to start */
+    if( gpio_get( GPIO_Z80_MREQ ) == 0 )
+    {
+      /* Wait for a read to start, as opposed to a write */
+      if( gpio_get( GPIO_Z80_RD ) == 0 )
+      {
+	/* OK, a Z80 memory read has begun, the address is already on the address bus */
+	uint16_t address_bus = gpio_get_all() & 0xFFFF;
+
+	/* Read the address bus, stash the value while there's room in the buffer */
+	address_buffer[buffer_index++] = address_bus;
+
+	/* Wait for the Z80 to complete the memory request, unless Pico1 gives up first. That's sampling too */
+	while( (gpio_get( GPIO_Z80_MREQ ) == 0) && (gpio_get( GPIO_P2_SIGNAL ) == 1) )
+	  samples++;
+
+      } /* Endif it's a RD */
+
+    } /* Endif if it's a MREQ */
+
+  } /* End while P2 signal is held and the buffer isn't empty */
+
+  *captured = buffer_index;
+  return samples;
+}
+
+/*
+ * Refresh test, note when each row is refreshed until the first Pico drops the
+ * "test running" signal. The PIO program is already running on sm.
+ */
+static void __time_critical_func(refresh_sample)( uint sm, REFRESH_RESULT *result, uint32_t *row_last_seen_us )
+{
+  /* Loop while the first Pico is holding the "test running" signal */
+  while( gpio_get( GPIO_P2_SIGNAL ) == 1 )
+  {
+    if( pio_sm_is_rx_fifo_empty( capture_pio, sm ) )
+      continue;
+
+    uint32_t rows   = pio_sm_get( capture_pio, sm );
+    uint32_t now_us = time_us_32();
+
+    /* Four rows per word, oldest in the bottom byte. They all get the same timestamp */
+    for( uint32_t i = 0; i < 4; i++ )
+    {
+      uint32_t row  = rows & (NUM_REFRESH_ROWS-1);
+      uint8_t  mask = 1 << (row & 7);
+
+      if( result->rows_seen[row >> 3] & mask )
+      {
+	uint32_t gap_us = now_us - row_last_seen_us[row];
+	if( gap_us > result->max_gap_us )
+	  result->max_gap_us = gap_us;
+      }
+      else
+      {
+	result->rows_seen[row >> 3] |= mask;
+      }
+      row_last_seen_us[row] = now_us;
+
+      rows >>= 8;
+    }
+    result->refresh_count += 4;
+
+  } /* End while P2 signal is held by Pico1 */
+}
+
+/*
+ * Boot timeline, note when the Z80 first reads from each milestone address, and
+ * count the reads from each, until the first Pico drops the "test running" signal.
+ * The milestones are looked for as each read happens, a handful of compares fits
+ * well inside a memory cycle, so nothing has to be stored. Returns the number of
+ * samples taken.
+ */
+static uint32_t __time_critical_func(boot_sample)( const BOOT_PARAMS *params, uint32_t *first_us, uint32_t *times )
+{
+  uint32_t samples = 0;
+
+  /* Loop while the first Pico is holding the "test running" signal */
+  while( gpio_get( GPIO_P2_SIGNAL ) == 1 )
+  {
+    samples++;
+
+    /* Wait for a memory request to start */
+    if( gpio_get( GPIO_Z80_MREQ ) == 0 )
+    {
+      /* Wait for a read to start, as opposed to a write */
+      if( gpio_get( GPIO_Z80_RD ) == 0 )
+      {
+	uint16_t address_bus = gpio_get_all() & 0xFFFF;
+	uint32_t now_us      = time_us_32();
+
+	for( uint32_t milestone = 0; milestone < params->num_milestones; milestone++ )
+	{
+	  if( address_bus == params->address[milestone] )
+	  {
+	    if( times[milestone]++ == 0 )
+	      first_us[milestone] = now_us;
+	  }
+	}
+
+	/* Wait for the Z80 to complete the memory request, unless Pico1 gives up first. That's sampling too */
+	while( (gpio_get( GPIO_Z80_MREQ ) == 0) && (gpio_get( GPIO_P2_SIGNAL ) == 1) )
+	  samples++;
+
+      } /* Endif it's a RD */
+
+    } /* Endif if it's a MREQ */
+
+  } /* End while P2 signal is held by Pico1 */
+
+  return samples;
+}
+
+/* When each run from 0x0000 started, for the reset jitter test */
+typedef struct
+{
+  uint32_t starts;
+  uint32_t first_us;
+  uint32_t last_us;
+  uint32_t shortest_us;
+  uint32_t longest_us;
+}
+RESET_STARTS;
+
+/*
+ * Reset jitter, note when each run from 0x0000 starts until the first Pico drops the
+ * "test running" signal. A run starts with a read from 0x0000 which doesn't follow
+ * another, a Z80 coming out of a bouncing reset reads it several times over. That's
+ * a compare with zero per read, which keeps up easily. Returns the number of samples
+ * taken.
+ */
+static uint32_t __time_critical_func(reset_sample)( RESET_STARTS *runs )
+{
+  uint32_t samples    = 0;
+  bool     after_zero = false;
+
+  /* Loop while the first Pico is holding the "test running" signal */
+  while( gpio_get( GPIO_P2_SIGNAL ) == 1 )
+  {
+    samples++;
+
+    /* Wait for a memory request to start */
+    if( gpio_get( GPIO_Z80_MREQ ) == 0 )
+    {
+      /* Wait for a read to start, as opposed to a write */
+      if( gpio_get( GPIO_Z80_RD ) == 0 )
+      {
+	bool zero = (gpio_get_all() & 0xFFFF) == 0;
+
+	if( zero && !after_zero )
+	{
+	  uint32_t now_us = time_us_32();
+
+	  if( runs->starts++ == 0 )
+	  {
+	    runs->first_us = now_us;
+	  }
+	  else
+	  {
+	    uint32_t run_us = now_us - runs->last_us;
+	    if( run_us < runs->shortest_us )
+	      runs->shortest_us = run_us;
+	    if( run_us > runs->longest_us )
+	      runs->longest_us = run_us;
+	  }
+	  runs->last_us = now_us;
+	}
+	after_zero = zero;
+
+	/* Wait for the Z80 to complete the memory request, unless Pico1 gives up first. That's sampling too */
+	while( (gpio_get( GPIO_Z80_MREQ ) == 0) && (gpio_get( GPIO_P2_SIGNAL ) == 1) )
+	  samples++;
+
+      } /* Endif it's a RD */
+
+    } /* Endif if it's a MREQ */
+
+  } /* End while P2 signal is held by Pico1 */
+
+  return samples;
+}
+
+/*
+ * The tests. Each one runs once Pico1 has raised the signal, until it
+ * drops it again or the test's done by itself, then sends the response.
+ * Its parameters have been checked by then.
+ *
+ * The results go back when Pico1 drops the signal, or sooner if the test
+ * finishes by itself, so Pico1 might not be ready for them yet. The
+ * response waits for it as long as it takes. If Pico1 gives up and
+ * resyncs instead, that breaks the wait.
+ */
+
+static void run_abus( const void *p )
+{
+  /*
+   * Pico1 has asked for the address bus test. This test checks each of the Z80 address
+   * lines and confirms each one is seeing going from high to low, and low to high.
+   * As the Spectrum starts up you'd expect to see all lines make these transitions.
+   * If one or more doesn't, that implies a stuck or unconnected address line.
+   */
+  const ABUS_PARAMS *params = p;
+
+  ABUS_RESULT result;
+  for( uint32_t line = 0; line < 16; line++ )
+    result.line_edge[line] = SEEN_NEITHER;
+
+  /* Count the samples and the T-states, so it's possible to see whether this keeps up with the bus */
+  uint32_t start_us = inst_now();
+  clk_count_start();
+
+  uint32_t max_gap_cycles;
+  usb_stream_pause();
+  uint32_t samples = abus_sample( result.line_edge, params->line_mask, &max_gap_cycles );
+  usb_stream_resume();
+
+  result.rate.samples  = samples;
+  result.rate.t_states = clk_count_stop();
+
+  inst_add( INST_SAMPLES,   samples );
+  inst_add( INST_SAMPLE_US, inst_now() - start_us );
+  inst_hist_record( INST_HIST_SAMPLE_GAP, inst_cycles_to_ns( max_gap_cycles ) );
+
+  /* Raw GPIO state so other Pico can see what lines are stuck, if any */
+  result.gpio_state = gpio_get_all();
+
+  pico_comm_respond( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_TEST_ABUS, PICO_COMM_OK, &result, sizeof(result) );
+}
+
+/* Built from the sequences Pico1 sends with the ROM test */
+static SEQ_MATCHER rom_matcher;
+
+static bool check_rom( const void *p )
+{
+  const ROM_PARAMS *params = p;
+
+  if( (params->capture_length == 0) || (params->capture_length > ROM_MAX_CAPTURE) )
+    return false;
+
+  if( (params->num_patterns == 0) || (params->num_patterns > ROM_MAX_PATTERNS) )
+    return false;
+
+  uint32_t num_symbols = 0;
+  for( uint32_t pattern = 0; pattern < params->num_patterns; pattern++ )
+    num_symbols += params->pattern_length[pattern];
+
+  if( num_symbols > ROM_MAX_SYMBOLS )
+    return false;
+
+  /*
+   * Building the matcher turns down empty sequences, and this gets it
+   * done before Pico1 raises the signal and the Z80's away
+   */
+  return seq_match_build( &rom_matcher, params->num_patterns, params->pattern_length, params->symbols );
+}
+
+static void run_rom( const void *p )
+{
+  /*
+   * Pico1 has asked for the ROM test. This test checks that the Z80 asks for the
+   * sequence of addresses of the start up program sequence in the Spectrum ROM,
+   * thus proving that the Z80 is working and the ROM is supplying the instruction
+   * bytes correctly. Pico1 sends the sequence it expects from each ROM it knows
+   * about, and how many reads to look for them in. Which one turns up says which
+   * ROM is fitted.
+   *
+   * The Z80 is allowed to run (by Pico1) then the Z80 control bus lines are monitored
+   * looking for memory reads. For each memory read, the address of the memory location
+   * is stored away. The buffer for storing those addresses isn't very large, this
+   * only checks the first few dozen expected instructions are fetched from the ROM.
+   * It's assumed that if the Z80 runs the first few instructions from the ROM
+   * correctly then everything must be running as expected.
+   *
+   * A complication is that the Z80 appears to restart several times. Looking at the
+   * contents of the addresses buffer it shows it starts at 0000, goes to 0001, then
+   * 0002, and then there's a burst of 0000s and it starts again. This happens about
+   * 10 times, each restart getting a bit further than the last. Eventually the Z80
+   * runs and doesn't restart. I think this is caused by jitter on the /RESET line,
+   * the reset test measures it. It doesn't really matter for this test, other than
+   * to note that the contents of the addresses buffer isn't a nice clean run from
+   * address 0000.
+   */
+  const ROM_PARAMS *params = p;
+
+  /*
+   * (gdb) p sizeof(address_buffer)
+   * $2 = 4096
+   *
+   * (gdb) x/1024xh address_buffer
+   */
+  static uint16_t address_buffer[ROM_MAX_CAPTURE];
+  memset( address_buffer, 0, sizeof(address_buffer) );
+
+  ROM_RESULT result;
+
+  uint32_t start_us = inst_now();
+  clk_count_start();
+
+  usb_stream_pause();
+  uint32_t samples = rom_sample( address_buffer, params->capture_length, &result.captured );
+  usb_stream_resume();
+
+  result.rate.samples  = samples;
+  result.rate.t_states = clk_count_stop();
+
+  inst_add( INST_SAMPLES,   samples );
+  inst_add( INST_SAMPLE_US, inst_now() - start_us );
+
+  /* Find the expected address sequences in the collected address sequence, all in one go */
+  result.found = seq_match_scan( &rom_matcher, address_buffer, result.captured );
+
+  /* Report result to the other Pico so it can update the screen */
+  pico_comm_respond( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_TEST_ROM, PICO_COMM_OK, &result, sizeof(result) );
+}
+
+static void run_refresh( const void *p )
+{
+  /*
+   * Pico1 has asked for the refresh test. The 4116 RAMs in the lower 16K
+   * need each of their 128 rows refreshing at least every 2ms, otherwise
+   * they lose their contents. The refresh addresses come from the Z80's
+   * R register, which it puts on A0-A6 during the refresh part of every
+   * opcode fetch. This test picks those addresses off the bus and checks
+   * every row is visited, and how long each row goes between visits.
+   *
+   * The address bus test can't spot a problem here; a refresh counter
+   * which only counts part way, for example, still toggles all the lines.
+   *
+   * Refreshes arrive around one per microsecond. The PIO does the capture
+   * and packs 4 row numbers into each word it sends back, so all this
+   * loop has to do is note when each row was seen.
+   */
+  static uint32_t row_last_seen_us[NUM_REFRESH_ROWS];
+
+  REFRESH_RESULT result;
+  memset( &result, 0, sizeof(result) );
+
+  uint32_t offset = pio_add_program( capture_pio, &refresh_capture_program );
+  uint32_t sm     = pio_claim_unused_sm( capture_pio, true );
+  refresh_capture_program_init( capture_pio, sm, offset, GPIO_ABUS_A0, GPIO_Z80_MREQ );
+
+  /* Clear the PIO's sticky "dropped a result" flag so I can tell if it happens */
+  capture_pio->fdebug = (1u << (PIO_FDEBUG_RXSTALL_LSB + sm));
+  pio_sm_set_enabled( capture_pio, sm, true );
+
+  uint32_t start_us = time_us_32();
+
+  usb_stream_pause();
+  refresh_sample( sm, &result, row_last_seen_us );
+  usb_stream_resume();
+
+  uint32_t end_us = time_us_32();
+  result.elapsed_us = end_us - start_us;
+
+  /* A row which stopped being refreshed part way through has been waiting since */
+  for( uint32_t row = 0; row < NUM_REFRESH_ROWS; row++ )
+  {
+    if( (result.rows_seen[row >> 3] & (1 << (row & 7))) &&
+	(end_us - row_last_seen_us[row] > result.max_gap_us) )
+    {
+      result.max_gap_us = end_us - row_last_seen_us[row];
+    }
+  }
+
+  pio_sm_set_enabled( capture_pio, sm, false );
+  result.overrun = (capture_pio->fdebug & (1u << (PIO_FDEBUG_RXSTALL_LSB + sm))) != 0;
+
+  pio_sm_clear_fifos( capture_pio, sm );
+  pio_sm_unclaim( capture_pio, sm );
+  pio_remove_program( capture_pio, &refresh_capture_program, offset );
+
+  /* Report result to the other Pico so it can update the screen */
+  pico_comm_respond( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_TEST_REFRESH, PICO_COMM_OK, &result, sizeof(result) );
+}
+
+static bool check_capture( const void *p )
+{
+  const CAPTURE_PARAMS *params = p;
+  const LA_TRIGGER     *trigger = &params->trigger;
+
+  if( (trigger->type > LA_TRIGGER_ADDRESS16) || (trigger->pin >= NUM_BANK0_GPIOS) || (trigger->second_pin >= NUM_BANK0_GPIOS) )
+    return false;
+
+  if( (trigger->type == LA_TRIGGER_ADDRESS16) && (trigger->second_pin != trigger->pin + 16) )
+    return false;
+
+  return (params->pre_samples <= LA_MAX_SAMPLES) && (params->post_samples <= LA_MAX_SAMPLES - params->pre_samples);
+}
+
+static void run_capture( const void *p )
+{
+  /*
+   * Pico1 has asked for a logic analyser capture. The trigger, and how
+   * many samples to keep either side of it, come with the request.
+   *
+   * The capture runs until the trigger fires and the post-trigger samples
+   * are in, or Pico1 drops the signal. Pico1 only gets a summary, the
+   * samples go out of this Pico's USB port.
+   */
+  const CAPTURE_PARAMS *params = p;
+
+  static LA_CAPTURE last_capture;
+
+  la_capture( capture_pio, GPIO_Z80_CLK, &params->trigger,
+	      params->pre_samples, params->post_samples, p2_signal_held, &last_capture );
+
+  CAPTURE_SUMMARY summary;
+  summary.triggered      = last_capture.triggered;
+  summary.num_samples    = last_capture.num_samples;
+  summary.trigger_sample = last_capture.trigger_sample;
+  summary.trigger_state  = last_capture.triggered ? la_capture_sample( &last_capture, last_capture.trigger_sample ) : 0;
+
+  /* Report result to the other Pico so it can update the screen */
+  pico_comm_respond( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_TEST_CAPTURE, PICO_COMM_OK, &summary, sizeof(summary) );
+
+  /* Then send the whole capture to the host, if there's one listening */
+  usb_stream_capture( &params->trigger, &last_capture, GPIO_Z80_CLK );
+}
+
+static void run_stats( const void *p )
+{
+  /*
+   * Not a test, Pico1 wants this Pico's instrumentation numbers for
+   * its self test page. It's more than one frame's worth, so it goes
+   * back in pieces.
+   */
+  static INST_SNAPSHOT stats;
+  inst_snapshot( &stats );
+
+  pico_comm_respond( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_TEST_STATS, PICO_COMM_OK, &stats, sizeof(stats) );
+}
+
+/* Pico1 holds the Z80 in reset until this is in its loop, a second's far more than it ever needs */
+#define BOOT_MAX_RESET_DELAY_US 1000000
+
+static bool check_boot( const void *p )
+{
+  const BOOT_PARAMS *params = p;
+
+  return (params->num_milestones >= 1) && (params->num_milestones <= BOOT_MAX_MILESTONES) &&
+         (params->reset_delay_us <= BOOT_MAX_RESET_DELAY_US);
+}
+
+/*
+ * The tests which time things from reset use the Pico's timer, and count the Z80's
+ * clock over the whole run. That gives how many CLK cycles each microsecond is, so
+ * the times can go back in CLK cycles. The Spectrum's clock comes from a crystal, so
+ * it's the same all the way through.
+ */
+static uint32_t us_to_clk( uint32_t us, const SAMPLE_RATE *rate, uint32_t elapsed_us )
+{
+  if( elapsed_us == 0 )
+    return 0;
+
+  return (uint32_t)(((uint64_t)us * rate->t_states) / elapsed_us);
+}
+
+/* Nothing should happen before the reset's let go, but it's only a few microseconds either way */
+static uint32_t since_reset_us( uint32_t reset_us, uint32_t at_us )
+{
+  int32_t since_us = (int32_t)(at_us - reset_us);
+
+  return (since_us < 0) ? 0 : since_us;
+}
+
+static void run_boot( const void *p )
+{
+  /*
+   * Pico1 has asked for the boot timeline. It's holding the Z80 in reset, and lets
+   * it go reset_delay_us after it raised the signal, so this is well into its loop
+   * by then. The Z80 doesn't start until C27's charged though, which takes a while
+   * and varies from one machine to the next. So the first read from 0x0000 is
+   * time zero, and the milestone there says how long after the release that was.
+   *
+   * A machine with bad RAM which keeps retrying, or which restarts, shows up as a
+   * timeline which takes longer than it should, or passes the same milestone
+   * more than once.
+   */
+  const BOOT_PARAMS *params = p;
+
+  uint32_t reset_us = signal_seen_us + params->reset_delay_us;
+
+  uint32_t    first_us[BOOT_MAX_MILESTONES];
+  BOOT_RESULT result;
+  memset( &result, 0, sizeof(result) );
+
+  clk_count_start();
+  uint32_t start_us = time_us_32();
+
+  usb_stream_pause();
+  uint32_t samples = boot_sample( params, first_us, result.times );
+  usb_stream_resume();
+
+  uint32_t elapsed_us = time_us_32() - start_us;
+
+  result.rate.samples  = samples;
+  result.rate.t_states = clk_count_stop();
+
+  inst_add( INST_SAMPLES,   samples );
+  inst_add( INST_SAMPLE_US, elapsed_us );
+
+  /* If it never got to 0x0000 the release will have to do */
+  uint32_t zero_us = reset_us;
+  for( uint32_t milestone = 0; milestone < params->num_milestones; milestone++ )
+  {
+    if( (params->address[milestone] == 0x0000) && (result.times[milestone] != 0) )
+    {
+      zero_us = first_us[milestone];
+      break;
+    }
+  }
+
+  for( uint32_t milestone = 0; milestone < params->num_milestones; milestone++ )
+  {
+    if( result.times[milestone] == 0 )
+      result.reached[milestone] = BOOT_NOT_REACHED;
+    else if( params->address[milestone] == 0x0000 )
+      result.reached[milestone] = us_to_clk( since_reset_us( reset_us, first_us[milestone] ), &result.rate, elapsed_us );
+    else
+      result.reached[milestone] = us_to_clk( since_reset_us( zero_us, first_us[milestone] ), &result.rate, elapsed_us );
+  }
+
+  pico_comm_respond( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_TEST_BOOT, PICO_COMM_OK, &result, sizeof(result) );
+}
+
+static bool check_reset( const void *p )
+{
+  const RESET_PARAMS *params = p;
+
+  return params->reset_delay_us <= BOOT_MAX_RESET_DELAY_US;
+}
+
+static void run_reset( const void *p )
+{
+  /*
+   * Pico1 has asked for the reset jitter test. As with the boot timeline, it's
+   * holding the Z80 in reset and lets it go reset_delay_us after it raised the
+   * signal.
+   *
+   * /RESET comes up slowly, C27 on the Spectrum charges through a resistor, and
+   * if it's noisy on the way the Z80 gets part way and starts again. The ROM
+   * test sees that as bursts of reads from 0x0000. This counts them, times them,
+   * and says when the last one was, after which the Z80 kept going. A healthy
+   * reset circuit starts it once.
+   */
+  const RESET_PARAMS *params = p;
+
+  uint32_t reset_us = signal_seen_us + params->reset_delay_us;
+
+  RESET_STARTS runs = { 0, 0, 0, 0xFFFFFFFF, 0 };
+  RESET_RESULT result;
+
+  clk_count_start();
+  uint32_t start_us = time_us_32();
+
+  usb_stream_pause();
+  uint32_t samples = reset_sample( &runs );
+  usb_stream_resume();
+
+  uint32_t elapsed_us = time_us_32() - start_us;
+
+  result.rate.samples  = samples;
+  result.rate.t_states = clk_count_stop();
+
+  inst_add( INST_SAMPLES,   samples );
+  inst_add( INST_SAMPLE_US, elapsed_us );
+
+  result.starts = runs.starts;
+  result.window = us_to_clk( since_reset_us( reset_us, start_us + elapsed_us ), &result.rate, elapsed_us );
+
+  if( runs.starts == 0 )
+  {
+    result.first_start = BOOT_NOT_REACHED;
+    result.last_start  = BOOT_NOT_REACHED;
+  }
+  else
+  {
+    result.first_start = us_to_clk( since_reset_us( reset_us, runs.first_us ), &result.rate, elapsed_us );
+    result.last_start  = us_to_clk( since_reset_us( reset_us, runs.last_us ),  &result.rate, elapsed_us );
+  }
+
+  if( runs.starts < 2 )
+  {
+    result.shortest_run = 0;
+    result.longest_run  = 0;
+  }
+  else
+  {
+    result.shortest_run = us_to_clk( runs.shortest_us, &result.rate, elapsed_us );
+    result.longest_run  = us_to_clk( runs.longest_us,  &result.rate, elapsed_us );
+  }
+
+  pico_comm_respond( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_TEST_RESET, PICO_COMM_OK, &result, sizeof(result) );
+}
+
+static void run_link_rate( const void *p )
+{
+  /*
+   * Not a test either, Pico1 is working out how fast the link can go.
+   * Say yes, then go along with it, see link_rate_follow().
+   */
+  if( pico_comm_respond( linkout_pio, linkout_sm, linkin_sm, PICO_COMM_LINK_RATE, PICO_COMM_OK, NULL, 0 ) )
+    link_rate_follow( linkin_pio, linkin_sm, linkout_sm );
+}
+
+/*
+ * What Pico1 can ask this Pico to do. A new test goes in here, with its
+ * parameters and results in test_data.h. A Pico1 which doesn't know about
+ * it won't ask, and a Pico1 which asks an older Pico2 is told it's not
+ * there.
+ */
+typedef struct
+{
+  PICO_COMM_TYPE type;
+  uint32_t       params_length;                 // Has to be exactly this
+  bool           (*check)( const void *params ); // Optional, false if the parameters don't make sense
+  void           (*run)( const void *params );   // Runs the test and sends the response
+  bool           signalled;                      // Waits for Pico1's signal before it runs
+}
+PICO2_TEST;
+
+static const PICO2_TEST pico2_test[] =
+{
+  { PICO_COMM_TEST_ABUS,    sizeof(ABUS_PARAMS),    NULL,          run_abus,      true  },
+  { PICO_COMM_TEST_ROM,     sizeof(ROM_PARAMS),     check_rom,     run_rom,       true  },
+  { PICO_COMM_TEST_REFRESH, 0,                      NULL,          run_refresh,   true  },
+  { PICO_COMM_TEST_CAPTURE, sizeof(CAPTURE_PARAMS), check_capture, run_capture,   true  },
+  { PICO_COMM_TEST_STATS,   0,                      NULL,          run_stats,     false },
+  { PICO_COMM_LINK_RATE,    0,                      NULL,          run_link_rate, true  },
+  { PICO_COMM_TEST_BOOT,    sizeof(BOOT_PARAMS),    check_boot,    run_boot,      true  },
+  { PICO_COMM_TEST_RESET,   sizeof(RESET_PARAMS),   check_reset,   run_reset,     true  },
+};
+#define NUM_PICO2_TESTS (sizeof(pico2_test) / sizeof(pico2_test[0]))
+
+static const PICO2_TEST *find_test( uint32_t type )
+{
+  for( uint32_t i = 0; i < NUM_PICO2_TESTS; i++ )
+  {
+    if( pico2_test[i].type == type )
+      return &pico2_test[i];
+  }
+
+  return NULL;
+}
+
 /*
  * Code for the second Pico. This one has the address bus lines connected
- * to GPIOs 0-15. It sits waiting for an instruction from Pico1 to arrive
- * on the Pico-Pico link. That instruction consists of an indication of
- * which test it's expected to run. Once that's arrived it spins on a GPIO
- * controlled by Pico1. The moment that GPIO goes high, the test starts.
- * The test continues to run until the GPIO is pulled low again by Pico1.
- * It reports the result then goes back to waiting.
+ * to GPIOs 0-15. It sits waiting for a request from Pico1 to arrive on
+ * the Pico-Pico link. That says which test it's expected to run, and how,
+ * see pico_comm.h. Once that's arrived it spins on a GPIO controlled by
+ * Pico1. The moment that GPIO goes high, the test starts. The test
+ * continues to run until the GPIO is pulled low again by Pico1. It sends
+ * the response then goes back to waiting.
+ *
+ * Pico1 also pulls the GPIO low early to abort a test, when the user has
+ * moved on to another page. So every loop here which can take any time
+ * watches it, and the response is always sent, even if it's only partial
+ * or it's to say the test couldn't be run, so the two Picos stay in step
+ * on the link.
  */
 void main( void )
 {
   bi_decl(bi_program_description("ZX Spectrum Diagnostics Pico2 Board Binary."));
 
+  /* Before anything which works out a divider from the clocks */
+  sys_clock_init();
+
+  /* For timing the sampling loops */
+  inst_cycles_start();
+
   /* Let the main Pico get going */
   sleep_ms( 2000 );
 
@@ -99,264 +939,86 @@ void main( void )
   gpio_init(LED_PIN);
   gpio_set_dir(LED_PIN, GPIO_OUT);
 
-  const enum gpio_function linkout_function = GPIO_FUNC_PIO0;
-  const PIO                linkout_pio      = pio0;
-  const enum gpio_function linkin_function  = GPIO_FUNC_PIO0;
-  const PIO                linkin_pio       = pio0;
-
   /* Outbound link, to Pico1 */
   gpio_set_function(GPIO_P2_LINKOUT, linkout_function);
 
-  int  linkout_sm = pio_claim_unused_sm(linkout_pio, true);
-  uint offset     = pio_add_program(linkout_pio, &picoputerlinkout_program);
+  linkout_sm  = pio_claim_unused_sm(linkout_pio, true);
+  uint offset = pio_add_program(linkout_pio, &picoputerlinkout_program);
   picoputerlinkout_program_init(linkout_pio, linkout_sm, offset, GPIO_P2_LINKOUT);
 
   /* Inbound link, from Pico1 */
   gpio_set_function(GPIO_P2_LINKIN, linkin_function);
 
-  int  linkin_sm  = pio_claim_unused_sm(linkin_pio, true);
-       offset     = pio_add_program(linkin_pio, &picoputerlinkin_program);
+  linkin_sm   = pio_claim_unused_sm(linkin_pio, true);
+       offset = pio_add_program(linkin_pio, &picoputerlinkin_program);
   picoputerlinkin_program_init(linkin_pio, linkin_sm, offset, GPIO_P2_LINKIN);
 
+  /* USB, for streaming captures to a host */
+  usb_stream_init( STREAM_SOURCE_PICO2 );
+
   /* Let everything settle before this end starts listening */
   sleep_ms( 1000 );
 
-  uint32_t test_counter = 0;
   while( 1 )
   {
-    /* Wait for test type from the other Pico */
-    uint32_t test_type = PICO_COMM_TEST_ABUS;
-    ui_link_receive_buffer( linkin_pio, linkin_sm, linkout_sm, (uint8_t*)&test_type, sizeof(test_type) );
-
     /*
-     * Pico1 has told this Pico to run a test. The requested test type is in test_type.
-     * The signal to start the test is the GPIO_P2_SIGNAL going high, which is how the
-     * first Pico drives it when it wants the test to start.
+     * If anything's gone wrong on the link Pico1 will resync it before its
+     * next test, so wait for that. Nothing's going to happen until it does.
      */
+    if( link_out_of_step( linkin_pio ) )
+      link_wait_for_resync( linkin_pio, linkin_sm, linkout_sm );
 
-    /* Read the GPIO_P2_SIGNAL, wait for it to go high */
-    while( gpio_get( GPIO_P2_SIGNAL ) == 0 );
+    /* Wait for a request from the other Pico */
+    PICO_COMM_REQUEST_HEADER request;
+    static uint8_t           params[PICO_COMM_MAX_PARAMS];
+    PICO_COMM_STATUS         status;
+    if( !pico_comm_receive_request( linkin_pio, linkin_sm, linkout_sm, &request, params, &status ) )
+      continue;
 
-    /* Go! Run the requested test */
-    switch( test_type )
-    {
-    case PICO_COMM_TEST_ABUS:
+    /*
+     * The frame's CRC was good so it's not a glitch on the line. If this
+     * firmware doesn't have the test, or the parameters are wrong, Pico1
+     * is told so. It still raises the signal first.
+     */
+    const PICO2_TEST *test = NULL;
+    if( status == PICO_COMM_OK )
     {
-      /*
-       * Pico1 has asked for the address bus test. This test checks each of the Z80 address
-       * lines and confirms each one is seeing going from high to low, and low to high.
-       * As the Spectrum starts up you'd expect to see all lines make these transitions.
-       * If one or more doesn't, that implies a stuck or unconnected address line.
-       */
-
-      /*
-       * Address bus test, just monitor the address lines and confirm they got low->high and high->low
-       * Loop while the first Pico is holding the "test running" signal
-       */
-      SEEN_EDGE line_edge[16] =	{ SEEN_NEITHER, SEEN_NEITHER, SEEN_NEITHER, SEEN_NEITHER, 
-				  SEEN_NEITHER, SEEN_NEITHER, SEEN_NEITHER, SEEN_NEITHER, 
-				  SEEN_NEITHER, SEEN_NEITHER, SEEN_NEITHER, SEEN_NEITHER, 
-				  SEEN_NEITHER, SEEN_NEITHER, SEEN_NEITHER, SEEN_NEITHER };
-      
-      uint32_t previous_gpios_state = gpio_get_all() & 0x0000FFFF;
-
-      while( gpio_get( GPIO_P2_SIGNAL ) == 1 )
-      {
-	/*
-	 * Each iteration I loop over the 16 address lines looking for transitions.
-	 * Previous GPIO state is taken at the very start. When a bit is seen going
-	 * high to low, or low to high, the output array entry is updated and the
-	 * previous bit store is updated.
-	 * 
-	 * SEEN_FALLING | SEEN_RISING = SEEN_BOTH
-	 *
-	 * (Imagine one bit: it starts at 0. I read it's state, it hasn't changed.
-	 * Just keep looping until it changes to 1. It's seen rising. It's 
-	 * previous-state is then set 1, and I loop. I read it's state again,
-	 * this time with a previous-state of 1, so I'm now looking for a transition
-	 * to 0. When I see that, it's been seen falling. Repeat for each of the
-	 * 16 address lines.)
-	 * 
-	 * When all bits are at SEEN_BOTH, which would be the typical case with a
-	 * healthy Spectrum, the test is complete. But I have nothing else to do
-	 * do I keep looping.
-	 */
-
-	uint32_t current_gpios_state = gpio_get_all();
-
-	/* Work along the address bus lines */
-	for( uint32_t gpio_index = 0; gpio_index < 16; gpio_index++ )
-	{
-	  uint32_t mask = (1 << gpio_index);
+      test = find_test( request.type );
 
-	  uint32_t current_gpio_state  = current_gpios_state & mask;
-	  
-	  if( previous_gpios_state & mask )
-	  {
-	    /* This GPIO was previously set */
-
-	    if( current_gpio_state )
-	    {
-	      /* It was set, it's still set, NOP */
-	    }
-	    else
-	    {
-	      /* It was set, it's now not set, it's gone high to low */
-	      line_edge[gpio_index] |= SEEN_FALLING;
-
-	      /* Clear the bit in the previous state, it's now unset */
-	      previous_gpios_state &= ~mask;
-	    }
-	  }
-	  else
-	  {
-	    /* This GPIO was previously unset */
-
-	    if(! current_gpio_state )
-	    {
-	      /* It was unset, it's still unset, NOP */
-	    }
-	    else
-	    {
-	      /* It was unset, it's now set, it's gone low to high */
-	      line_edge[gpio_index] |= SEEN_RISING;
-
-	      /* Set the bit in the previous state, it's now set */
-	      previous_gpios_state |= mask;
-	    }
-	  }
-
-	} /* End for 16 address lines */     
-
-      } /* End while P2 signal is held by Pico1 */
-
-      /* Send response  - send buffer load */
-      ui_link_send_buffer( linkout_pio, linkout_sm, linkin_sm, (uint8_t*)line_edge, sizeof(line_edge)*sizeof(line_edge[0]) );
-
-      /* Send 32-bit raw GPIO state so other Pico can see what lines are stuck, if any */
-      uint32_t gpio_state = gpio_get_all();
-      ui_link_send_buffer( linkout_pio, linkout_sm, linkin_sm, (uint8_t*)&gpio_state, sizeof(gpio_state) );
+      if( test == NULL )
+	status = PICO_COMM_UNKNOWN_TYPE;
+      else if( (request.params_length != test->params_length) ||
+	       ((test->check != NULL) && !test->check( params )) )
+	status = PICO_COMM_BAD_PARAMS;
     }
-    break;
-
 
-
-    case PICO_COMM_TEST_ROM:
+    /* Not a test, there's nothing to time and it's answered straight away */
+    if( (status == PICO_COMM_OK) && !test->signalled )
     {
-      /*
-       * Pico1 has asked for the ROM test. This test checks that the Z80 asks for the
-       * sequence of addresses of the start up program sequence in the Spectrum ROM,
-       * thus proving that the Z80 is working and the ROM is supplying the instruction
-       * bytes correctly.
-       *
-       * The Z80 is allowed to run (by Pico1) then the Z80 control bus lines are monitored
-       * looking for memory reads. For each memory read, the address of the memory location
-       * is stored away. The buffer for storing those addresses isn't very large, this
-       * only checks the first few dozen expected instructions are fetched from the ROM.
-       * It's assumed that if the Z80 runs the first few instructions from the ROM
-       * correctly then everything must be running as expected.
-       *
-       * A complication is that the Z80 appears to restart several times. Looking at the
-       * contents of the addresses buffer it shows it starts at 0000, goes to 0001, then
-       * 0002, and then there's a burst of 0000s and it starts again. This happens about
-       * 10 times, each restart getting a bit further than the last. Eventually the Z80
-       * runs and doesn't restart. I think this is caused by jitter on the /RESET line.
-       * It doesn't really matter for this test, other than to note that the contents
-       * of the addresses buffer isn't a nice clean run from address 0000.
-       */
-
-      /*
-       * With ADDR_BUF_SIZE=2048:
-       *
-       * (gdb) p sizeof(address_buffer)
-       * $2 = 4096
-       *
-       * (gdb) x/1024xh address_buffer
-       */
-#define ADDR_BUF_SIZE 2048
-      static uint16_t address_buffer[ADDR_BUF_SIZE];
-
-      /* Clear buffer */
-      uint32_t buffer_index = 0;
-      for(buffer_index=0; buffer_index<ADDR_BUF_SIZE;buffer_index++)
-	address_buffer[buffer_index] = 0;
-
-      /*
-       * This is the sequence of addresses the Z80 reads from as it starts running
-       * the ROM program. The instruction at 0x11E0 is a jump back to the start of
-       * the loop which does the RAM check. I chose that as the rather arbitrary
-       * point to stop. If this sequence appears on the address bus the Z80 and
-       * ROM are clearly communicating at least reasonably well.
-       *
-       * (gdb) p sizeof(expected_sequence)
-       * $1 = 60
-       *
-       * (gdb) x/128xh expected_sequence
-       */
-      uint16_t expected_sequence[] = {
-	0x0000, 0x0001, 0x0002, 0x0003,
-	0x0004, 0x0005, 0x0006, 0x0007,
-	0x11cb, 0x11cc, 0x11cd, 0x11ce,
-	0x11cf, 0x11d0, 0x11d1, 0x11d2,
-	0x11d3, 0x11d4, 0x11d5, 0x11d6,
-	0x11d7, 0x11d8, 0x11d9, 0x11da,
-	0x11db, 0x11dc, 0x11dd, 0x11de,
-	0x11df, 0x11e0
-      };
-
-      buffer_index = 0;
-
-      /* Loop while the first Pico is holding the "test running" signal */
-      while( (gpio_get( GPIO_P2_SIGNAL ) == 1) && (buffer_index < ADDR_BUF_SIZE) )
-      {
-	/* Wait for a memory request to start */
-	if( gpio_get( GPIO_Z80_MREQ ) == 0 )
-	{
-	  /* Wait for a read to start, as opposed to a write */
-	  if( gpio_get( GPIO_Z80_RD ) == 0 )
-	  {
-	    /* OK, a Z80 memory read has begun, the address is already on the address bus */
-	    uint16_t address_bus = gpio_get_all() & 0xFFFF;
-
-	    /* Read the address bus, stash the value while there's room in the buffer */
-	    address_buffer[buffer_index++] = address_bus;
-
-	    /* Wait for the Z80 to complete the memory request */
-	    while( gpio_get( GPIO_Z80_MREQ ) == 0 );
-
-	  } /* Endif it's a RD */
-	  
-	} /* Endif if it's a MREQ */
-
-      } /* End while P2 signal is held and the buffer isn't empty */
-
-      /* Now try to find the expected sequence of addresses in the buffer of collected ones */
-      uint32_t rom_sequence_match = 0;
-
-      /* Find the expected address sequence in the collected address sequence */
-      if( memmem( address_buffer, sizeof( address_buffer ), expected_sequence, sizeof( expected_sequence ) ) != NULL )
-      {
-	rom_sequence_match = 1;
-      }
-
-      /* Report result to the other Pico so it can update the screen */
-      ui_link_send_buffer( linkout_pio, linkout_sm, linkin_sm, (uint8_t*)&rom_sequence_match, sizeof(uint32_t) );
+      test->run( params );
+      continue;
     }
-    break;
 
-    default:
-    {
-      /*
-       * Unknown test type. No idea what to do. It's probably just a glitch on
-       * the line, it sometimes does that at startup. Pause for a moment to let
-       * it settle (maybe, probably not actually helpful) then ignore it.
-       */
-      sleep_ms(1);
-    }
-    break;
+    /*
+     * The signal to start the test is the GPIO_P2_SIGNAL going high, which is how the
+     * first Pico drives it when it wants the test to start. If it doesn't, Pico1 didn't
+     * see its request arrive and is about to resync.
+     */
+    uint32_t signal_wait_us = time_us_32();
+    while( (gpio_get( GPIO_P2_SIGNAL ) == 0) && ((time_us_32() - signal_wait_us) < SIGNAL_TIMEOUT_US) );
 
+    if( gpio_get( GPIO_P2_SIGNAL ) == 0 )
+    {
+      link_lost_step( linkin_pio );
+      continue;
     }
+    signal_seen_us = time_us_32();
 
+    /* Go! Run the requested test, or say why not */
+    if( status == PICO_COMM_OK )
+      test->run( params );
+    else
+      pico_comm_respond( linkout_pio, linkout_sm, linkin_sm, request.type, status, NULL, 0 );
   }
 
 }